@@ -36,7 +36,7 @@ ep_desc_t::ep_desc_t()
   version = "";
 }
 
-endpoint_list_t::endpoint_list_t() : runthread(true)
+endpoint_list_t::endpoint_list_t()
 {
   endpoints.resize(MAX_STAGE_ID);
   statusthread = std::thread(&endpoint_list_t::checkstatus, this);
@@ -44,7 +44,7 @@ endpoint_list_t::endpoint_list_t() : runthread(true)
 
 endpoint_list_t::~endpoint_list_t()
 {
-  runthread = false;
+  stopsig.stop();
   statusthread.join();
 }
 
@@ -88,8 +88,7 @@ void endpoint_list_t::cid_setpingtime(stage_device_id_t cid, double pingtime)
 void endpoint_list_t::checkstatus()
 {
   uint32_t statlogcnt(STATLOGPERIOD);
-  while(runthread) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(PINGPERIODMS));
+  while(!stopsig.wait_for(1000 * PINGPERIODMS)) {
     for(stage_device_id_t ep = 0; ep != MAX_STAGE_ID; ++ep) {
       if(endpoints[ep].timeout) {
         // bookkeeping of connected endpoints:
@@ -69,7 +69,7 @@ protected:
 
 private:
   void checkstatus();
-  bool runthread;
+  stop_signal_t stopsig;
   std::thread statusthread;
   std::mutex mstat;
 };
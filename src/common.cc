@@ -82,18 +82,21 @@ size_t addmsg(char* destbuf, size_t maxlen, size_t currentlen, const char* msg,
   return currentlen + msglen;
 }
 
+timestamp_ns_t get_timestamp_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 double get_pingtime(char*& msg, size_t& msglen)
 {
-  if(msglen >= sizeof(std::chrono::high_resolution_clock::time_point)) {
-    const std::chrono::high_resolution_clock::time_point t1(
-        *(std::chrono::high_resolution_clock::time_point*)msg);
-    std::chrono::high_resolution_clock::time_point t2(
-        std::chrono::high_resolution_clock::now());
-    std::chrono::duration<double> time_span =
-        std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
-    msglen -= sizeof(std::chrono::high_resolution_clock::time_point);
-    msg += sizeof(std::chrono::high_resolution_clock::time_point);
-    return (1000.0 * time_span.count());
+  if(msglen >= sizeof(timestamp_ns_t)) {
+    timestamp_ns_t t1(*(timestamp_ns_t*)msg);
+    timestamp_ns_t t2(get_timestamp_ns());
+    msglen -= sizeof(timestamp_ns_t);
+    msg += sizeof(timestamp_ns_t);
+    return 1e-6 * (double)(t2 - t1);
   }
   return -1;
 }
@@ -73,6 +73,18 @@ enum {
   PORT_PONG_SRV,
   PORT_PING_LOCAL,
   PORT_PONG_LOCAL,
+  // The following ports were added after PORT_PONG_LOCAL, which moved
+  // MAXSPECIALPORT from 11 to 14. Older devices and servers treat
+  // ports 12 and 13 as audio data and forward them, therefore these
+  // messages are sent only to devices which announce B_EXTCONTROL,
+  // and PORT_PING_SRV_MULTI only to servers which announce
+  // B_SRVMULTIPING.
+  /// Ping to several peers via server, to be distributed by the server
+  PORT_PING_SRV_MULTI,
+  /// Announce the path selected for sending to a peer
+  PORT_PATHSEL,
+  /// Confirm reception of the proxy multicast group to the proxy
+  PORT_MCASTACK,
   MAXSPECIALPORT
 };
 
@@ -124,6 +136,22 @@ typedef uint8_t epmode_t;
  * This device is using a proxy.
  */
 #define B_USINGPROXY 0x10
+/**
+ * @ingroup operationmodes
+ *
+ * This device handles PORT_PATHSEL and PORT_MCASTACK. It is added to
+ * the mode in each registration, other devices learn it from the
+ * device list of the server.
+ */
+#define B_EXTCONTROL 0x20
+/**
+ * @ingroup operationmodes
+ *
+ * Set by the server in the device list if it distributes
+ * PORT_PING_SRV_MULTI. Devices never set this flag, thus a server
+ * which only relays the mode of a device does not announce it.
+ */
+#define B_SRVMULTIPING 0x40
 
 // the message header is a byte array with:
 // - secret
@@ -270,6 +298,20 @@ size_t packmsg(char* destbuf, size_t maxlen, secret_t secret,
 size_t addmsg(char* destbuf, size_t maxlen, size_t currentlen, const char* msg,
               size_t msglen);
 
+/**
+ * @ingroup networkprotocol
+ * Time stamp in ping messages, in nanoseconds of a monotonic clock.
+ */
+typedef int64_t timestamp_ns_t;
+
+/**
+ * Return the current time of the monotonic clock in nanoseconds.
+ *
+ * The origin of the clock is unspecified, e.g., the boot time, and
+ * differs between hosts.
+ */
+timestamp_ns_t get_timestamp_ns();
+
 /**
  * @ingroup networkprotocol
  * Extract time stamp from message and compare with current time to
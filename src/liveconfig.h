@@ -0,0 +1,113 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIVECONFIG_H
+#define LIVECONFIG_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+/**
+ * Configuration value which can be replaced while other threads are
+ * reading it.
+ *
+ * Readers access the current value without locking, through a
+ * reader_t which counts the active readers. A new value is published
+ * with one atomic pointer exchange. The replaced value is deleted as
+ * soon as no reader is active, thus no reader can hold a reference
+ * to a deleted value, regardless of how long it was preempted.
+ *
+ * Readers should be short, e.g., one reader per processed message,
+ * because set() waits for a moment without active readers.
+ *
+ * @tparam T Type of configuration value
+ */
+template <class T> class live_config_t {
+public:
+  /**
+   * Read access to the current value, valid for the life time of the
+   * reader.
+   *
+   * Creating a reader is lock-free and does not allocate memory, thus
+   * it can be used in real-time threads. Readers must not call set()
+   * of the same object.
+   */
+  class reader_t {
+  public:
+    reader_t(const live_config_t& cfg) : cfg(cfg)
+    {
+      // the counter is incremented before the value is loaded, thus
+      // set() either sees this reader, or this reader gets the new
+      // value:
+      cfg.readers.fetch_add(1);
+      val = cfg.cur.load();
+    };
+    reader_t(const reader_t&) = delete;
+    ~reader_t() { cfg.readers.fetch_sub(1, std::memory_order_release); };
+    const T& operator*() const { return *val; };
+    const T* operator->() const { return val; };
+
+  private:
+    const live_config_t& cfg;
+    const T* val;
+  };
+  live_config_t() : cur(new T()), readers(0){};
+  live_config_t(const live_config_t&) = delete;
+  ~live_config_t() { delete cur.load(); };
+  /**
+   * Return a copy of the current value.
+   */
+  T copy() const
+  {
+    reader_t r(*this);
+    return *r;
+  };
+  /**
+   * Replace the current value.
+   * @param v New value
+   *
+   * Returns after all readers of the previous value have finished.
+   */
+  void set(const T& v)
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    T* old(cur.exchange(new T(v)));
+    // readers which started after the exchange use the new value,
+    // thus the old value is unused once no reader is active:
+    while(readers.load() != 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    delete old;
+  };
+
+private:
+  std::atomic<T*> cur;
+  mutable std::atomic<size_t> readers;
+  std::mutex mtx;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
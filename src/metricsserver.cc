@@ -0,0 +1,165 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(WIN32) || defined(UNDER_CE)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define close closesocket
+#elif defined(LINUX) || defined(linux) || defined(__APPLE__)
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "errmsg.h"
+#include "metricsserver.h"
+#include <errno.h>
+#include <string.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+metrics_server_t::metrics_server_t(port_t port,
+                                   std::function<std::string()> provider)
+    : port(port), provider(provider), sockfd(-1), run(true)
+{
+  sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if(sockfd < 0)
+    throw ErrMsg("Opening metrics socket failed: ", errno);
+  int optval(1);
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char*)&optval,
+             sizeof(optval));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if((bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+     (listen(sockfd, 8) < 0)) {
+    int err(errno);
+    close(sockfd);
+    throw ErrMsg("Binding metrics socket to port " + std::to_string(port) +
+                     " failed: ",
+                 err);
+  }
+  if(port == 0) {
+    // get the port which was assigned by the system:
+    socklen_t len(sizeof(addr));
+    getsockname(sockfd, (struct sockaddr*)&addr, &len);
+    this->port = ntohs(addr.sin_port);
+  }
+  thread = std::thread(&metrics_server_t::srv, this);
+}
+
+metrics_server_t::~metrics_server_t()
+{
+  run = false;
+  if(thread.joinable())
+    thread.join();
+  close(sockfd);
+}
+
+void metrics_server_t::srv()
+{
+  while(run) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sockfd, &fds);
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    if(select(sockfd + 1, &fds, NULL, NULL, &tv) > 0) {
+      int fd(accept(sockfd, NULL, NULL));
+      if(fd >= 0) {
+        handle_request(fd);
+        close(fd);
+      }
+    }
+  }
+}
+
+void metrics_server_t::handle_request(int fd)
+{
+  // do not block the server for slow clients:
+  struct timeval tv;
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+  char buf[2048];
+  ssize_t n(recv(fd, buf, sizeof(buf) - 1, 0));
+  if(n <= 0)
+    return;
+  buf[n] = 0;
+  std::string request(buf);
+  std::string status("200 OK");
+  std::string body;
+  if((request.compare(0, 13, "GET /metrics ") == 0) ||
+     (request.compare(0, 6, "GET / ") == 0)) {
+    try {
+      body = provider();
+    }
+    catch(const std::exception& e) {
+      status = "500 Internal Server Error";
+      body = std::string(e.what()) + "\n";
+    }
+  } else {
+    status = "404 Not Found";
+    body = "not found\n";
+  }
+  std::string response("HTTP/1.0 " + status +
+                       "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " +
+                       std::to_string(body.size()) +
+                       "\r\nConnection: close\r\n\r\n" + body);
+  const char* p(response.c_str());
+  size_t len(response.size());
+  while(len > 0) {
+    ssize_t sent(send(fd, p, len, MSG_NOSIGNAL));
+    if(sent <= 0)
+      return;
+    p += sent;
+    len -= sent;
+  }
+}
+
+std::string metric_header(const std::string& name, const std::string& type,
+                          const std::string& help)
+{
+  return "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type +
+         "\n";
+}
+
+std::string metric_value(const std::string& name, const std::string& labels,
+                         double value)
+{
+  char ctmp[64];
+  snprintf(ctmp, sizeof(ctmp), " %.10g\n", value);
+  if(labels.empty())
+    return name + ctmp;
+  return name + "{" + labels + "}" + ctmp;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
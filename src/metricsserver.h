@@ -0,0 +1,90 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include "common.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * Minimal HTTP server for scraping of metrics.
+ *
+ * The server listens on the loopback interface only and answers
+ * requests to "/metrics" with the text returned by the provider
+ * function, in the Prometheus text exposition format. The provider
+ * is called in the server thread for each request, thus collecting
+ * metrics costs nothing as long as nobody is scraping.
+ */
+class metrics_server_t {
+public:
+  /**
+   * Start the server.
+   * @param port TCP port on localhost, or zero for any free port
+   * @param provider Function returning the metrics text
+   *
+   * Upon error, an exception of type ErrMsg is thrown.
+   */
+  metrics_server_t(port_t port, std::function<std::string()> provider);
+  ~metrics_server_t();
+  metrics_server_t(const metrics_server_t&) = delete;
+  /**
+   * Return the TCP port on which the server listens.
+   */
+  port_t get_port() const { return port; };
+
+private:
+  void srv();
+  void handle_request(int fd);
+  port_t port;
+  std::function<std::string()> provider;
+  int sockfd;
+  std::atomic_bool run;
+  std::thread thread;
+};
+
+/**
+ * Return the HELP and TYPE lines of a metric.
+ * @param name Metric name
+ * @param type Metric type, e.g., "counter" or "gauge"
+ * @param help Description
+ */
+std::string metric_header(const std::string& name, const std::string& type,
+                          const std::string& help);
+
+/**
+ * Return one sample line of a metric.
+ * @param name Metric name
+ * @param labels Label list without braces, e.g., "cid=\"3\"", or empty
+ * @param value Value
+ */
+std::string metric_value(const std::string& name, const std::string& labels,
+                         double value);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,424 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netaudio.h"
+#include "errmsg.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+// frames reserved for the largest audio block:
+#define MAXBLOCK 8192
+// time constant of the fill level low pass filter in seconds:
+#define TAU_FILL 0.5
+// time in seconds to compensate a fill level error:
+#define T_CONTROL 4.0
+// integration time constant of drift estimation in seconds:
+#define T_INTEGRAL 30.0
+// maximum deviation of resampling ratio from nominal ratio:
+#define MAXCORR 2e-3
+
+static size_t sample_size(uint8_t format)
+{
+  switch(format) {
+  case NETAUDIO_INT16:
+    return 2;
+  case NETAUDIO_INT24:
+    return 3;
+  case NETAUDIO_FLOAT:
+    return 4;
+  }
+  return 0;
+}
+
+static void put_u16(char* p, uint16_t v)
+{
+  p[0] = (char)(v >> 8);
+  p[1] = (char)v;
+}
+
+static void put_u32(char* p, uint32_t v)
+{
+  p[0] = (char)(v >> 24);
+  p[1] = (char)(v >> 16);
+  p[2] = (char)(v >> 8);
+  p[3] = (char)v;
+}
+
+static uint16_t get_u16(const char* p)
+{
+  const uint8_t* u((const uint8_t*)p);
+  return (uint16_t)((u[0] << 8) | u[1]);
+}
+
+static uint32_t get_u32(const char* p)
+{
+  const uint8_t* u((const uint8_t*)p);
+  return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) |
+         ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+}
+
+static float clip(float v)
+{
+  if(v > 1.0f)
+    return 1.0f;
+  if(v < -1.0f)
+    return -1.0f;
+  return v;
+}
+
+// store one sample in network byte order:
+static void put_sample(char* p, float v, uint8_t format)
+{
+  switch(format) {
+  case NETAUDIO_INT16:
+    put_u16(p, (uint16_t)(int16_t)lrintf(32767.0f * clip(v)));
+    break;
+  case NETAUDIO_INT24: {
+    uint32_t i((uint32_t)(int32_t)lrintf(8388607.0f * clip(v)));
+    p[0] = (char)(i >> 16);
+    p[1] = (char)(i >> 8);
+    p[2] = (char)i;
+    break;
+  }
+  case NETAUDIO_FLOAT: {
+    uint32_t i;
+    memcpy(&i, &v, sizeof(i));
+    put_u32(p, i);
+    break;
+  }
+  }
+}
+
+// read one sample in network byte order:
+static float get_sample(const char* p, uint8_t format)
+{
+  switch(format) {
+  case NETAUDIO_INT16:
+    return (int16_t)get_u16(p) * (1.0f / 32767.0f);
+  case NETAUDIO_INT24: {
+    const uint8_t* u((const uint8_t*)p);
+    // sign extension of the 24 bit value:
+    int32_t i((int32_t)(((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) |
+                        ((uint32_t)u[2] << 8)) >>
+              8);
+    return i * (1.0f / 8388607.0f);
+  }
+  case NETAUDIO_FLOAT: {
+    uint32_t i(get_u32(p));
+    float v;
+    memcpy(&v, &i, sizeof(v));
+    return v;
+  }
+  }
+  return 0.0f;
+}
+
+netaudio_header_t::netaudio_header_t()
+    : version(NETAUDIO_VERSION), flags(0), channels(0), format(0), srate(0),
+      period(0), nframes(0), cycle(0), offset(0), tsec(0), tfrac(0)
+{
+}
+
+bool netaudio_header_t::read(const char* buf, size_t len)
+{
+  if((len < NETAUDIO_HEADERLEN) || (memcmp(buf, "zita", 4) != 0))
+    return false;
+  version = (uint8_t)buf[4];
+  flags = (uint8_t)buf[5];
+  channels = (uint8_t)buf[6];
+  format = (uint8_t)buf[7];
+  srate = get_u32(buf + 8);
+  period = get_u16(buf + 12);
+  nframes = get_u16(buf + 14);
+  cycle = get_u32(buf + 16);
+  offset = get_u16(buf + 20);
+  tsec = get_u32(buf + 24);
+  tfrac = get_u32(buf + 28);
+  return true;
+}
+
+void netaudio_header_t::write(char* buf) const
+{
+  memcpy(buf, "zita", 4);
+  buf[4] = (char)version;
+  buf[5] = (char)flags;
+  buf[6] = (char)channels;
+  buf[7] = (char)format;
+  put_u32(buf + 8, srate);
+  put_u16(buf + 12, period);
+  put_u16(buf + 14, nframes);
+  put_u32(buf + 16, cycle);
+  put_u16(buf + 20, offset);
+  put_u16(buf + 22, 0);
+  put_u32(buf + 24, tsec);
+  put_u32(buf + 28, tfrac);
+}
+
+netaudio_encoder_t::netaudio_encoder_t(uint8_t channels, uint32_t srate,
+                                       netaudio_format_t format,
+                                       size_t maxpacket)
+    : channels(channels), format(format), framesperpacket(0)
+{
+  size_t framesize(channels * sample_size(format));
+  if((framesize > 0) && (maxpacket > NETAUDIO_HEADERLEN))
+    framesperpacket = (maxpacket - NETAUDIO_HEADERLEN) / framesize;
+  if(framesperpacket > 0xffff)
+    framesperpacket = 0xffff;
+  if(framesperpacket == 0)
+    throw ErrMsg("Unable to send " + std::to_string(channels) +
+                 " audio channels in packets of " + std::to_string(maxpacket) +
+                 " bytes.");
+  header.channels = channels;
+  header.format = format;
+  header.srate = srate;
+  buffer.resize(NETAUDIO_HEADERLEN + framesperpacket * framesize);
+}
+
+void netaudio_encoder_t::start_cycle(uint32_t nframes)
+{
+  header.period = (uint16_t)nframes;
+  int64_t t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count());
+  header.tsec = (uint32_t)(t / 1000000000);
+  header.tfrac = (uint32_t)(((t % 1000000000) << 32) / 1000000000);
+}
+
+size_t netaudio_encoder_t::pack(const float* const* data, uint32_t offset,
+                                uint32_t n)
+{
+  header.nframes = (uint16_t)n;
+  header.offset = (uint16_t)offset;
+  header.write(buffer.data());
+  size_t ssize(sample_size(format));
+  char* p(buffer.data() + NETAUDIO_HEADERLEN);
+  for(uint32_t k = 0; k < n; ++k)
+    for(uint8_t ch = 0; ch < channels; ++ch) {
+      put_sample(p, data[ch][offset + k], format);
+      p += ssize;
+    }
+  return p - buffer.data();
+}
+
+netaudio_receiver_t::netaudio_receiver_t(uint8_t channels, uint32_t srate,
+                                         double buffer_ms,
+                                         const std::vector<double>& taps_ms)
+    : channels(channels), srate(srate),
+      bufframes((uint32_t)std::max(1.0, 0.001 * buffer_ms * srate)), mask(0),
+      history(0), started(false), nextframe(0), wpos(0), srcrate(0), rpos(0),
+      frac(0), filling(true), fill_lp(0), integral(0), blockpos(0),
+      blockfrac(0), blockratio(0), ratio(1.0), fill(0), n_received(0),
+      n_lost(0), n_late(0), n_overflow(0), n_underrun(0), n_resync(0),
+      n_invalid(0)
+{
+  if(channels == 0)
+    throw ErrMsg("Invalid number of audio channels.");
+  uint32_t maxtap(0);
+  for(auto t : taps_ms) {
+    tapframes.push_back((uint32_t)std::max(0.0, 0.001 * t * srate));
+    maxtap = std::max(maxtap, tapframes.back());
+  }
+  // process_tap() reads the last block, which is up to MAXBLOCK
+  // frames behind the read position after process():
+  if(!tapframes.empty())
+    history = maxtap + MAXBLOCK;
+  uint64_t capacity(1);
+  while(capacity < 4 * ((uint64_t)bufframes + MAXBLOCK) + history)
+    capacity <<= 1;
+  mask = capacity - 1;
+  ring.resize(capacity * channels, 0.0f);
+}
+
+void netaudio_receiver_t::put_packet(const char* buf, size_t len)
+{
+  netaudio_header_t h;
+  if(!h.read(buf, len)) {
+    n_invalid.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  size_t ssize(sample_size(h.format));
+  // like zita-n2j, use the first channels of the sender:
+  if((ssize == 0) || (h.channels < channels) || (h.srate == 0) ||
+     (len != NETAUDIO_HEADERLEN + (size_t)h.nframes * h.channels * ssize)) {
+    n_invalid.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::lock_guard<std::mutex> lk(producer);
+  n_received.fetch_add(1, std::memory_order_relaxed);
+  srcrate.store(h.srate, std::memory_order_relaxed);
+  uint64_t capacity(mask + 1);
+  uint64_t w(wpos.load(std::memory_order_relaxed));
+  // keep a few frames free, they might be used by the interpolation,
+  // and keep the history which is needed by the taps:
+  uint64_t space(capacity - 4 - history -
+                 (w - rpos.load(std::memory_order_acquire)));
+  if(started) {
+    int32_t gap((int32_t)(h.get_frame() - nextframe));
+    if(gap < 0) {
+      n_late.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if(gap > 0) {
+      if(((uint64_t)gap <= capacity / 4) && ((uint64_t)gap <= space)) {
+        // replace lost packets by silence to keep the timing:
+        for(uint64_t k = 0; k < (uint64_t)gap * channels; ++k)
+          ring[((w + k / channels) & mask) * channels + k % channels] = 0.0f;
+        w += gap;
+        space -= gap;
+        n_lost.fetch_add(gap, std::memory_order_relaxed);
+      } else
+        n_resync.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  started = true;
+  nextframe = h.get_frame() + h.nframes;
+  if(h.nframes > space) {
+    n_overflow.fetch_add(1, std::memory_order_relaxed);
+    wpos.store(w, std::memory_order_release);
+    return;
+  }
+  const char* p(buf + NETAUDIO_HEADERLEN);
+  for(uint32_t k = 0; k < h.nframes; ++k) {
+    float* dest(&ring[((w + k) & mask) * channels]);
+    const char* src(p + k * h.channels * ssize);
+    for(uint8_t ch = 0; ch < channels; ++ch)
+      dest[ch] = get_sample(src + ch * ssize, h.format);
+  }
+  wpos.store(w + h.nframes, std::memory_order_release);
+}
+
+void netaudio_receiver_t::process(float* const* out, uint32_t nframes)
+{
+  uint32_t sr(srcrate.load(std::memory_order_relaxed));
+  uint64_t w(wpos.load(std::memory_order_acquire));
+  uint64_t r(rpos.load(std::memory_order_relaxed));
+  double avail((double)(w - r) - frac);
+  double target(bufframes + nframes);
+  double q(ratio.load(std::memory_order_relaxed));
+  if(filling) {
+    if((sr > 0) && (avail >= target)) {
+      filling = false;
+      fill_lp = avail;
+      q = (double)sr / (double)srate;
+    }
+  } else if((avail > 4.0 * target) && (avail > 2 * MAXBLOCK)) {
+    // drop audio after a burst of packets instead of draining it
+    // slowly:
+    r = w - (uint64_t)target;
+    frac = 0;
+    avail = target;
+    fill_lp = target;
+    n_resync.fetch_add(1, std::memory_order_relaxed);
+  }
+  if(!filling) {
+    // adapt resampling ratio to keep the buffer at the target fill:
+    double dt((double)nframes / (double)srate);
+    fill_lp += std::min(1.0, dt / TAU_FILL) * (avail - fill_lp);
+    double err((fill_lp - target) / (double)srate);
+    double corr(err / T_CONTROL +
+                (integral + err * dt) / (T_CONTROL * T_INTEGRAL));
+    // no integration while the correction is limited:
+    if(fabs(corr) < MAXCORR)
+      integral += err * dt;
+    corr = std::max(-MAXCORR, std::min(MAXCORR, corr));
+    q = (double)sr / (double)srate * (1.0 + corr);
+    // the interpolation needs one frame before and two after:
+    if(avail < (nframes - 1) * q + 3.0) {
+      filling = true;
+      n_underrun.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  if(filling) {
+    for(uint8_t ch = 0; ch < channels; ++ch)
+      memset(out[ch], 0, nframes * sizeof(float));
+    fill.store(avail, std::memory_order_relaxed);
+    blockratio = 0;
+    return;
+  }
+  double p(interpolate(r, frac, q, out, nframes));
+  blockpos = r;
+  blockfrac = frac;
+  blockratio = q;
+  uint64_t adv((uint64_t)floor(p));
+  frac = p - (double)adv;
+  rpos.store(r + adv, std::memory_order_release);
+  ratio.store(q, std::memory_order_relaxed);
+  fill.store(fill_lp, std::memory_order_relaxed);
+}
+
+void netaudio_receiver_t::process_tap(size_t tap, float* const* out,
+                                      uint32_t nframes)
+{
+  uint64_t delay(tapframes[tap]);
+  // silence while the main output is silent, and before the start of
+  // the stream:
+  if((blockratio == 0) || (blockpos < delay + 1)) {
+    for(uint8_t ch = 0; ch < channels; ++ch)
+      memset(out[ch], 0, nframes * sizeof(float));
+    return;
+  }
+  interpolate(blockpos - delay, blockfrac, blockratio, out, nframes);
+}
+
+double netaudio_receiver_t::interpolate(uint64_t r, double p, double q,
+                                        float* const* out,
+                                        uint32_t nframes) const
+{
+  for(uint32_t k = 0; k < nframes; ++k) {
+    double fl(floor(p));
+    uint64_t i(r + (uint64_t)fl);
+    float mu((float)(p - fl));
+    for(uint8_t ch = 0; ch < channels; ++ch) {
+      // cubic Hermite interpolation:
+      float y0(sample(i - 1, ch));
+      float y1(sample(i, ch));
+      float y2(sample(i + 1, ch));
+      float y3(sample(i + 2, ch));
+      float c1(0.5f * (y2 - y0));
+      float c2(y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3);
+      float c3(0.5f * (y3 - y0) + 1.5f * (y1 - y2));
+      out[ch][k] = ((c3 * mu + c2) * mu + c1) * mu + y1;
+    }
+    p += q;
+  }
+  return p;
+}
+
+netaudio_stats_t netaudio_receiver_t::get_stats() const
+{
+  netaudio_stats_t s;
+  s.received = n_received.load(std::memory_order_relaxed);
+  s.lost = n_lost.load(std::memory_order_relaxed);
+  s.late = n_late.load(std::memory_order_relaxed);
+  s.overflow = n_overflow.load(std::memory_order_relaxed);
+  s.underrun = n_underrun.load(std::memory_order_relaxed);
+  s.resync = n_resync.load(std::memory_order_relaxed);
+  s.invalid = n_invalid.load(std::memory_order_relaxed);
+  s.ratio = ratio.load(std::memory_order_relaxed);
+  s.fill = fill.load(std::memory_order_relaxed);
+  return s;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,304 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETAUDIO_H
+#define NETAUDIO_H
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+/**
+ * \defgroup netaudio In-process network audio
+ *
+ * Audio packets which are exchanged between the audio thread and
+ * ovboxclient_t without external zita-n2j/zita-j2n processes.
+ *
+ * This is experimental and enabled with "inprocessaudio" in the
+ * "network" section of the device configuration. The packets follow
+ * the format of zita-njbridge, but mixing devices with in-process
+ * clients and devices with zita-n2j/zita-j2n within a stage is
+ * untested. Each packet starts with a header of
+ * NETAUDIO_HEADERLEN bytes, see netaudio_header_t, followed by
+ * nframes x channels interleaved samples. All values are in network
+ * byte order. The frame position is transmitted as cycle counter and
+ * offset within the cycle, thus the receiver can detect lost and
+ * reordered packets.
+ */
+
+#define NETAUDIO_MAXPACKET 1400
+#define NETAUDIO_HEADERLEN 32
+#define NETAUDIO_VERSION 1
+
+/**
+ * Sample format of audio packets.
+ * \ingroup netaudio
+ */
+enum netaudio_format_t {
+  NETAUDIO_INT16 = 1,
+  NETAUDIO_INT24 = 2,
+  NETAUDIO_FLOAT = 3
+};
+
+/**
+ * Header of an audio packet.
+ * \ingroup netaudio
+ *
+ * Byte offsets of the fields in a packet:
+ * - 0: characters "zita"
+ * - 4: protocol version
+ * - 5: flags
+ * - 6: number of channels
+ * - 7: sample format, see netaudio_format_t
+ * - 8: sampling rate in Hz (32 bit)
+ * - 12: frames per cycle of the sender (16 bit)
+ * - 14: frames in this packet (16 bit)
+ * - 16: cycle counter (32 bit)
+ * - 20: offset of first frame within the cycle (16 bit)
+ * - 22: reserved
+ * - 24: time of the cycle, seconds and fraction (2 x 32 bit)
+ */
+class netaudio_header_t {
+public:
+  netaudio_header_t();
+  /**
+   * Decode the header of a packet.
+   * @param buf Packet data
+   * @param len Packet length in bytes
+   * @return False if the packet is too short or not a zita-njbridge
+   * packet
+   */
+  bool read(const char* buf, size_t len);
+  /**
+   * Encode the header into the first NETAUDIO_HEADERLEN bytes of a
+   * packet.
+   * @param buf Packet data
+   */
+  void write(char* buf) const;
+  /**
+   * Index of first frame in the stream of the sender.
+   */
+  uint32_t get_frame() const { return cycle * period + offset; };
+  uint8_t version;
+  uint8_t flags;
+  uint8_t channels;
+  /// sample format, see netaudio_format_t:
+  uint8_t format;
+  /// sampling rate of sender in Hz:
+  uint32_t srate;
+  /// frames per cycle of the sender:
+  uint16_t period;
+  uint16_t nframes;
+  uint32_t cycle;
+  /// offset of first frame within the cycle:
+  uint16_t offset;
+  /// time of the cycle in seconds:
+  uint32_t tsec;
+  /// fraction of the time in units of 2^-32 seconds:
+  uint32_t tfrac;
+};
+
+/**
+ * Split blocks of audio into packets.
+ * \ingroup netaudio
+ */
+class netaudio_encoder_t {
+public:
+  /**
+   * @param channels Number of channels
+   * @param srate Sampling rate in Hz
+   * @param format Sample format
+   * @param maxpacket Maximum packet size in bytes
+   */
+  netaudio_encoder_t(uint8_t channels, uint32_t srate,
+                     netaudio_format_t format = NETAUDIO_INT16,
+                     size_t maxpacket = NETAUDIO_MAXPACKET);
+  /**
+   * Encode one block of audio, without allocating memory.
+   *
+   * Each block is one cycle of the sender.
+   * @param data Channel buffers, each with nframes samples
+   * @param nframes Number of frames
+   * @param send Function called with buffer and length of each packet
+   */
+  template <class F>
+  void encode(const float* const* data, uint32_t nframes, F send)
+  {
+    start_cycle(nframes);
+    uint32_t offset(0);
+    while(offset < nframes) {
+      uint32_t n(nframes - offset);
+      if(n > framesperpacket)
+        n = framesperpacket;
+      send(buffer.data(), pack(data, offset, n));
+      offset += n;
+    }
+    ++header.cycle;
+  };
+  /**
+   * Maximum number of frames in one packet.
+   */
+  uint32_t get_frames_per_packet() const { return framesperpacket; };
+
+private:
+  // set period and time of the header for the next cycle:
+  void start_cycle(uint32_t nframes);
+  // pack n frames starting at offset into the packet buffer, return
+  // packet size:
+  size_t pack(const float* const* data, uint32_t offset, uint32_t n);
+  const uint8_t channels;
+  const netaudio_format_t format;
+  uint32_t framesperpacket;
+  netaudio_header_t header;
+  std::vector<char> buffer;
+};
+
+/**
+ * Statistics of a network audio receiver.
+ * \ingroup netaudio
+ */
+class netaudio_stats_t {
+public:
+  /// received valid packets:
+  uint64_t received = 0;
+  /// frames which were replaced by silence due to lost packets:
+  uint64_t lost = 0;
+  /// packets which arrived too late or twice:
+  uint64_t late = 0;
+  /// packets dropped because the buffer was full:
+  uint64_t overflow = 0;
+  /// number of buffer underruns in the audio thread:
+  uint64_t underrun = 0;
+  /// number of restarts of the stream after large gaps:
+  uint64_t resync = 0;
+  /// packets with invalid header or size:
+  uint64_t invalid = 0;
+  /// current resampling ratio, input frames per output frame:
+  double ratio = 1.0;
+  /// current average buffer fill in frames:
+  double fill = 0.0;
+};
+
+/**
+ * Jitter buffer and adaptive resampler for received audio packets.
+ * \ingroup netaudio
+ *
+ * Packets are added by network threads with put_packet(), one block
+ * of audio is read in the audio thread with process(). The buffer
+ * fill is kept at the target latency by a slowly adapting resampling
+ * ratio, which compensates the clock drift between sender and
+ * receiver. Interpolation is cubic (Hermite), which is cheap enough
+ * for many channels on small devices. Delayed copies of the output,
+ * e.g., for a recording bus, are read from taps with process_tap().
+ */
+class netaudio_receiver_t {
+public:
+  /**
+   * @param channels Number of channels
+   * @param srate Sampling rate of the audio thread in Hz
+   * @param buffer_ms Jitter buffer length in milliseconds
+   * @param taps_ms Additional delay of each tap in milliseconds
+   */
+  netaudio_receiver_t(uint8_t channels, uint32_t srate, double buffer_ms,
+                      const std::vector<double>& taps_ms = {});
+  /**
+   * Add a packet (network threads).
+   * @param buf Packet data
+   * @param len Packet length in bytes
+   */
+  void put_packet(const char* buf, size_t len);
+  /**
+   * Read one block of audio (audio thread only).
+   * @param out Channel buffers, each with nframes samples
+   * @param nframes Number of frames
+   *
+   * Silence is returned while the buffer is filled.
+   */
+  void process(float* const* out, uint32_t nframes);
+  /**
+   * Read the block of the last process() call from a delayed tap
+   * (audio thread only).
+   * @param tap Index of tap
+   * @param out Channel buffers, each with nframes samples
+   * @param nframes Number of frames, as in the last process() call
+   *
+   * The taps share the buffer and the resampling ratio with the main
+   * output, thus each packet is decoded only once.
+   */
+  void process_tap(size_t tap, float* const* out, uint32_t nframes);
+  netaudio_stats_t get_stats() const;
+  uint8_t get_channels() const { return channels; };
+  size_t get_taps() const { return tapframes.size(); };
+
+private:
+  // interpolate nframes at position r+p with ratio q, return end
+  // position relative to r:
+  double interpolate(uint64_t r, double p, double q, float* const* out,
+                     uint32_t nframes) const;
+  // return sample of channel ch at absolute frame position pos:
+  float sample(uint64_t pos, uint8_t ch) const
+  {
+    return ring[(pos & mask) * channels + ch];
+  };
+  const uint8_t channels;
+  const uint32_t srate;
+  const uint32_t bufframes;
+  uint64_t mask;
+  std::vector<uint32_t> tapframes;
+  // frames behind the read position which are kept for the taps:
+  uint32_t history;
+  std::vector<float> ring;
+  // producer state:
+  std::mutex producer;
+  bool started;
+  uint32_t nextframe;
+  std::atomic<uint64_t> wpos;
+  std::atomic<uint32_t> srcrate;
+  // consumer state:
+  std::atomic<uint64_t> rpos;
+  double frac;
+  bool filling;
+  double fill_lp;
+  double integral;
+  // position and ratio of the last block, or zero ratio if silent:
+  uint64_t blockpos;
+  double blockfrac;
+  double blockratio;
+  std::atomic<double> ratio;
+  std::atomic<double> fill;
+  // statistics:
+  std::atomic<uint64_t> n_received;
+  std::atomic<uint64_t> n_lost;
+  std::atomic<uint64_t> n_late;
+  std::atomic<uint64_t> n_overflow;
+  std::atomic<uint64_t> n_underrun;
+  std::atomic<uint64_t> n_resync;
+  std::atomic<uint64_t> n_invalid;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
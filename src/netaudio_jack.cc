@@ -0,0 +1,177 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netaudio_jack.h"
+#include "errmsg.h"
+#include <string.h>
+
+static jack_client_t* open_client(const std::string& name)
+{
+  jack_status_t jstat;
+  jack_client_t* jc(jack_client_open(
+      name.c_str(), (jack_options_t)(JackNoStartServer | JackUseExactName),
+      &jstat));
+  if(!jc)
+    throw ErrMsg("Unable to create JACK client \"" + name + "\".");
+  return jc;
+}
+
+// register ports, throw an error on failure:
+static std::vector<jack_port_t*> register_ports(jack_client_t* jc,
+                                                const std::string& prefix,
+                                                uint8_t channels,
+                                                unsigned long flags)
+{
+  std::vector<jack_port_t*> ports;
+  for(uint8_t ch = 0; ch < channels; ++ch) {
+    std::string pname(prefix + std::to_string(ch + 1));
+    jack_port_t* port(jack_port_register(jc, pname.c_str(),
+                                         JACK_DEFAULT_AUDIO_TYPE, flags, 0));
+    if(!port)
+      throw ErrMsg("Unable to register JACK port \"" + pname + "\".");
+    ports.push_back(port);
+  }
+  return ports;
+}
+
+netaudio_jack_receiver_t::netaudio_jack_receiver_t(
+    const std::string& name, uint8_t channels, double buffer_ms,
+    const std::vector<double>& taps_ms)
+    : jc(open_client(name)), receiver(NULL), bufs(channels, NULL)
+{
+  try {
+    receiver = new netaudio_receiver_t(channels, jack_get_sample_rate(jc),
+                                       buffer_ms, taps_ms);
+    ports = register_ports(jc, "out_", channels, JackPortIsOutput);
+    for(size_t tap = 0; tap < taps_ms.size(); ++tap)
+      tapports.push_back(register_ports(
+          jc, "tap" + std::to_string(tap + 1) + "_", channels,
+          JackPortIsOutput));
+    jack_set_process_callback(jc, &netaudio_jack_receiver_t::process, this);
+    if(jack_activate(jc) != 0)
+      throw ErrMsg("Unable to activate JACK client \"" + name + "\".");
+  }
+  catch(...) {
+    jack_client_close(jc);
+    if(receiver)
+      delete receiver;
+    throw;
+  }
+}
+
+netaudio_jack_receiver_t::~netaudio_jack_receiver_t()
+{
+  jack_deactivate(jc);
+  jack_client_close(jc);
+  delete receiver;
+}
+
+int netaudio_jack_receiver_t::process(jack_nframes_t nframes, void* h)
+{
+  netaudio_jack_receiver_t* self((netaudio_jack_receiver_t*)h);
+  for(size_t ch = 0; ch < self->ports.size(); ++ch)
+    self->bufs[ch] = (float*)jack_port_get_buffer(self->ports[ch], nframes);
+  self->receiver->process(self->bufs.data(), nframes);
+  for(size_t tap = 0; tap < self->tapports.size(); ++tap) {
+    for(size_t ch = 0; ch < self->tapports[tap].size(); ++ch)
+      self->bufs[ch] =
+          (float*)jack_port_get_buffer(self->tapports[tap][ch], nframes);
+    self->receiver->process_tap(tap, self->bufs.data(), nframes);
+  }
+  return 0;
+}
+
+netaudio_jack_sender_t::netaudio_jack_sender_t(const std::string& name,
+                                               uint8_t channels,
+                                               port_t destport)
+    : jc(open_client(name)), encoder(NULL), destport(destport),
+      bufs(channels, NULL), stopped(false)
+{
+  try {
+    encoder = new netaudio_encoder_t(channels, jack_get_sample_rate(jc));
+    socket.set_destination("localhost");
+    ports = register_ports(jc, "in_", channels, JackPortIsInput);
+    sender = std::thread(&netaudio_jack_sender_t::sendsrv, this);
+    jack_set_process_callback(jc, &netaudio_jack_sender_t::process, this);
+    if(jack_activate(jc) != 0)
+      throw ErrMsg("Unable to activate JACK client \"" + name + "\".");
+  }
+  catch(...) {
+    jack_client_close(jc);
+    stopped = true;
+    queued.post();
+    if(sender.joinable())
+      sender.join();
+    if(encoder)
+      delete encoder;
+    throw;
+  }
+}
+
+netaudio_jack_sender_t::~netaudio_jack_sender_t()
+{
+  jack_deactivate(jc);
+  jack_client_close(jc);
+  stopped = true;
+  queued.post();
+  if(sender.joinable())
+    sender.join();
+  delete encoder;
+}
+
+int netaudio_jack_sender_t::process(jack_nframes_t nframes, void* h)
+{
+  netaudio_jack_sender_t* self((netaudio_jack_sender_t*)h);
+  for(size_t ch = 0; ch < self->ports.size(); ++ch)
+    self->bufs[ch] =
+        (const float*)jack_port_get_buffer(self->ports[ch], nframes);
+  // no socket calls in the audio thread, packets are sent by sendsrv():
+  bool pushed(false);
+  self->encoder->encode(self->bufs.data(), nframes,
+                        [self, &pushed](const char* buf, size_t len) {
+                          packet_t& p(self->rtpacket);
+                          if(len > sizeof(p.buf))
+                            return;
+                          memcpy(p.buf, buf, len);
+                          p.len = len;
+                          if(self->packets.push(p))
+                            pushed = true;
+                        });
+  if(pushed)
+    self->queued.post();
+  return 0;
+}
+
+void netaudio_jack_sender_t::sendsrv()
+{
+  packet_t p;
+  while(!stopped) {
+    // the timeout is only a safeguard, the audio thread posts after
+    // each block:
+    queued.wait_for(100000);
+    while(packets.pop(p))
+      socket.send(p.buf, p.len, destport);
+  }
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
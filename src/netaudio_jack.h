@@ -0,0 +1,118 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETAUDIO_JACK_H
+#define NETAUDIO_JACK_H
+
+#include "netaudio.h"
+#include "spscqueue.h"
+#include "udpsocket.h"
+#include <atomic>
+#include <jack/jack.h>
+#include <string>
+#include <thread>
+
+/**
+ * JACK client which plays audio received by ovboxclient_t.
+ * \ingroup netaudio
+ *
+ * The output ports are named "out_1", "out_2" etc., like those of
+ * zita-n2j. The ports of delayed taps are named "tap1_1", "tap1_2"
+ * etc. Packets are added with put_packet() from the network threads,
+ * e.g., via ovboxclient_t::set_local_sink().
+ */
+class netaudio_jack_receiver_t {
+public:
+  /**
+   * @param name JACK client name
+   * @param channels Number of channels
+   * @param buffer_ms Jitter buffer length in milliseconds
+   * @param taps_ms Additional delay of each tap in milliseconds
+   */
+  netaudio_jack_receiver_t(const std::string& name, uint8_t channels,
+                           double buffer_ms,
+                           const std::vector<double>& taps_ms = {});
+  ~netaudio_jack_receiver_t();
+  void put_packet(const char* buf, size_t len)
+  {
+    receiver->put_packet(buf, len);
+  };
+  netaudio_stats_t get_stats() const { return receiver->get_stats(); };
+
+private:
+  static int process(jack_nframes_t nframes, void* h);
+  jack_client_t* jc;
+  netaudio_receiver_t* receiver;
+  std::vector<jack_port_t*> ports;
+  // ports of the taps, one vector per tap:
+  std::vector<std::vector<jack_port_t*>> tapports;
+  std::vector<float*> bufs;
+};
+
+/**
+ * JACK client which sends audio to the local port of ovboxclient_t.
+ * \ingroup netaudio
+ *
+ * The input ports are named "in_1", "in_2" etc., like those of
+ * zita-j2n. Samples are sent as 16 bit integers. The audio thread
+ * only encodes the packets into a lock-free queue and wakes up a
+ * sender thread, which passes them to the socket.
+ */
+class netaudio_jack_sender_t {
+public:
+  /**
+   * @param name JACK client name
+   * @param channels Number of channels
+   * @param destport Local UDP port of ovboxclient_t
+   */
+  netaudio_jack_sender_t(const std::string& name, uint8_t channels,
+                         port_t destport);
+  ~netaudio_jack_sender_t();
+
+private:
+  class packet_t {
+  public:
+    size_t len;
+    char buf[NETAUDIO_MAXPACKET];
+  };
+  static int process(jack_nframes_t nframes, void* h);
+  void sendsrv();
+  jack_client_t* jc;
+  netaudio_encoder_t* encoder;
+  udpsocket_t socket;
+  port_t destport;
+  std::vector<jack_port_t*> ports;
+  std::vector<const float*> bufs;
+  // packet which is filled in the audio thread:
+  packet_t rtpacket;
+  spsc_queue_t<packet_t, 64> packets;
+  // posted by the audio thread when packets were queued:
+  semaphore_t queued;
+  std::atomic_bool stopped;
+  std::thread sender;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -19,10 +19,14 @@
 
 #include "ov_render_tascar.h"
 #include "soundcardtools.h"
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <jack/jack.h>
 
+// typical delay of one UDP hop through the loopback interface, in ms:
+#define LOOPBACK_HOP_MS 0.02
+
 bool ov_render_tascar_t::metronome_t::operator!=(const metronome_t& a)
 {
   return (a.bpb != bpb) || (a.bpm != bpm) || (a.bypass != bypass) ||
@@ -120,15 +124,148 @@ void sendpinglog(stage_device_id_t cid, double tms, const endpoint_t& ep,
   }
 }
 
+// names of all JACK ports, or an empty set if no server is running:
+static std::set<std::string> list_jack_ports()
+{
+  std::set<std::string> ports;
+  jack_status_t jstat;
+  jack_client_t* jc(
+      jack_client_open("listports", (jack_options_t)JackNoStartServer, &jstat));
+  if(jc) {
+    const char** pp_ports(jack_get_ports(jc, NULL, NULL, 0));
+    if(pp_ports) {
+      for(const char** p = pp_ports; *p; ++p)
+        ports.insert(*p);
+      jack_free(pp_ports);
+    }
+    jack_client_close(jc);
+  }
+  return ports;
+}
+
+// wait until a JACK server accepts clients, or until the server
+// process has terminated:
+static bool wait_for_jack_server(const spawn_process_t* proc, double timeout)
+{
+  auto t_end(std::chrono::steady_clock::now() +
+             std::chrono::milliseconds((int64_t)(1000.0 * timeout)));
+  while(true) {
+    jack_status_t jstat;
+    jack_client_t* jc(jack_client_open(
+        "waitforserver", (jack_options_t)JackNoStartServer, &jstat));
+    if(jc) {
+      jack_client_close(jc);
+      return true;
+    }
+    if((proc && !proc->is_running()) ||
+       (std::chrono::steady_clock::now() >= t_end))
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+/**
+ * JACK client which is notified when ports are unregistered.
+ *
+ * It is used to wait until the clients of a session, including
+ * external processes, have released their ports, before a new
+ * session is started.
+ */
+class jack_port_watch_t {
+public:
+  jack_port_watch_t() : jc(NULL), changed(false), server_gone(false)
+  {
+    jack_status_t jstat;
+    jc = jack_client_open("portwatch", (jack_options_t)JackNoStartServer,
+                          &jstat);
+    if(jc) {
+      jack_set_port_registration_callback(jc, &jack_port_watch_t::port_reg,
+                                          this);
+      jack_on_shutdown(jc, &jack_port_watch_t::shutdown, this);
+      if(jack_activate(jc) != 0) {
+        jack_client_close(jc);
+        jc = NULL;
+      }
+    }
+  };
+  ~jack_port_watch_t()
+  {
+    if(jc) {
+      if(!server_gone)
+        jack_deactivate(jc);
+      jack_client_close(jc);
+    }
+  };
+  /**
+   * Wait until none of the ports exists.
+   * @param ports Port names
+   * @param timeout Maximum waiting time in seconds
+   * @return True if all ports were removed within the timeout
+   */
+  bool wait_unregistered(const std::set<std::string>& ports, double timeout)
+  {
+    if(!jc)
+      return false;
+    auto t_end(std::chrono::steady_clock::now() +
+               std::chrono::milliseconds((int64_t)(1000.0 * timeout)));
+    while(true) {
+      {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(server_gone)
+          return true;
+        changed = false;
+      }
+      bool found(false);
+      for(const auto& port : ports)
+        if(jack_port_by_name(jc, port.c_str())) {
+          found = true;
+          break;
+        }
+      if(!found)
+        return true;
+      std::unique_lock<std::mutex> lk(mtx);
+      if(!cv.wait_until(lk, t_end, [this] { return changed; }))
+        return false;
+    }
+  };
+
+private:
+  static void port_reg(jack_port_id_t, int reg, void* h)
+  {
+    if(!reg)
+      ((jack_port_watch_t*)h)->notify(false);
+  };
+  static void shutdown(void* h) { ((jack_port_watch_t*)h)->notify(true); };
+  void notify(bool gone)
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    changed = true;
+    if(gone)
+      server_gone = true;
+    cv.notify_all();
+  };
+  jack_client_t* jc;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool changed;
+  bool server_gone;
+};
+
 ov_render_tascar_t::ov_render_tascar_t(const std::string& deviceid,
                                        port_t pinglogport_)
     : ov_render_base_t(deviceid), h_jack(NULL), h_webmixer(NULL), tascar(NULL),
       ovboxclient(NULL), pinglogport(pinglogport_), pinglogaddr(nullptr),
       inputports({"system:capture_1", "system:capture_2"}),
       headtrack_tauref(33.315), selfmonitor_delay(0.0), zitapath(ZITAPATH),
-      is_proxy(false), use_proxy(false), cb_seqerr(nullptr),
-      cb_seqerr_data(nullptr), sorter_deadline(5.0),
-      expedited_forwarding_PHB(false), render_soundscape(true)
+      is_proxy(false), use_proxy(false), proxy_multicast(false),
+      proxy_multicast_port(4460), cb_seqerr(nullptr),
+      cb_seqerr_data(nullptr), inprocess_audio(false),
+      netaudio_sender_channels(0), netaudio_sender(NULL), sorter_deadline(5.0),
+      expedited_forwarding_PHB(false), adaptive_ping(false),
+      multi_server_ping(false), path_selection(false), upload_budget(0),
+      server_relay(false), packet_trace(false), metrics_server(NULL),
+      metrics_port(0), render_soundscape(true), session_tracing(false),
+      session_trace_count(0), session_xml_hash(0), debug_session(true)
 {
 #ifdef SHOWDEBUG
   std::cout << "ov_render_tascar_t::ov_render_tascar_t" << std::endl;
@@ -144,33 +281,45 @@ ov_render_tascar_t::ov_render_tascar_t(const std::string& deviceid,
 
 ov_render_tascar_t::~ov_render_tascar_t()
 {
+  if(metrics_server)
+    delete metrics_server;
   if(is_session_active())
     end_session();
   if(is_audio_active())
     stop_audiobackend();
   if(pinglogaddr)
     lo_address_free(pinglogaddr);
+  if(debug_session_writer.joinable())
+    debug_session_writer.join();
 }
 
 void ov_render_tascar_t::add_secondary_bus(const stage_device_t& stagemember,
                                            tsccfg::node_t& e_mods,
                                            tsccfg::node_t& e_session,
                                            std::vector<std::string>& waitports,
-                                           const std::string& zitapath,
-                                           const std::string& chanlist)
+                                           const std::string& n2jclientname,
+                                           uint8_t channels)
 {
   stage_device_t& thisdev(stage.stage[stage.thisstagedeviceid]);
   std::string clientname(get_stagedev_name(stagemember.id) + "_sec");
-  std::string netclientname("n2j_" + std::to_string(stagemember.id) + "_sec");
-  tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
-  double buff(thisdev.receiverjitter + stagemember.senderjitter);
-  tsccfg::node_set_attribute(
-      e_sys, "command",
-      zitapath + "zita-n2j --chan " + chanlist + " --jname " + netclientname +
-          "." + stage.thisdeviceid + " --buf " +
-          TASCAR::to_string(stage.rendersettings.secrec + buff) + " 0.0.0.0 " +
-          TASCAR::to_string(4464 + 2 * stagemember.id + 100));
-  tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-n2j");
+  std::string netclientname("n2j_" + std::to_string(stagemember.id) +
+                            "_sec." + stage.thisdeviceid);
+  std::string srcprefix(netclientname + ":out_");
+  if(inprocess_audio) {
+    // read the secondary bus from a delayed tap of the main receiver,
+    // thus each packet is received and decoded only once:
+    for(auto& cfg : netaudio_receiver_cfg)
+      if(cfg.jackname == n2jclientname) {
+        cfg.taps.push_back(stage.rendersettings.secrec);
+        srcprefix =
+            n2jclientname + ":tap" + std::to_string(cfg.taps.size()) + "_";
+      }
+  } else {
+    double buff(thisdev.receiverjitter + stagemember.senderjitter);
+    add_network_receiver_client(e_mods, netclientname, channels,
+                                stage.rendersettings.secrec + buff,
+                                4464 + 2 * stagemember.id + 100);
+  }
   // create also a route with correct gain settings:
   tsccfg::node_t e_route(tsccfg::node_add_child(e_mods, "route"));
   tsccfg::node_set_attribute(e_route, "name", clientname);
@@ -182,8 +331,7 @@ void ov_render_tascar_t::add_secondary_bus(const stage_device_t& stagemember,
   // ":out_[0-9]*");
   for(size_t c = 0; c < stagemember.channels.size(); ++c) {
     if(stage.thisstagedeviceid != stagemember.id) {
-      std::string srcport(netclientname + "." + stage.thisdeviceid + ":out_" +
-                          std::to_string(c + 1));
+      std::string srcport(srcprefix + std::to_string(c + 1));
       std::string destport(clientname + ":in." + std::to_string(c));
       waitports.push_back(srcport);
       session_add_connect(e_session, srcport, destport);
@@ -200,14 +348,9 @@ void ov_render_tascar_t::add_network_receiver(
     return;
   // only create a network receiver when the stage member is sending audio:
   stage_device_t& thisdev(stage.stage[stage.thisstagedeviceid]);
-  std::string chanlist;
-  for(uint32_t k = 0; k < stagemember.channels.size(); ++k) {
-    if(k)
-      chanlist += ",";
-    chanlist += std::to_string(k + 1);
-  }
+  uint8_t channels((uint8_t)stagemember.channels.size());
   if(stagemember.senddownmix)
-    chanlist = "1,2";
+    channels = 2;
   // do not create a network receiver for local device:
   if((stage.thisstagedeviceid != stagemember.id) &&
      (stagemember.senddownmix == thisdev.receivedownmix)) {
@@ -217,15 +360,9 @@ void ov_render_tascar_t::add_network_receiver(
     if(stage.rendersettings.rawmode || stage.thisdevice.receivedownmix) {
       n2jclientname = "n2j_" + n2jclientname;
     }
-    tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
     double buff(thisdev.receiverjitter + stagemember.senderjitter);
-    // provide access to path!
-    tsccfg::node_set_attribute(
-        e_sys, "command",
-        zitapath + "zita-n2j --chan " + chanlist + " --jname " + n2jclientname +
-            " --buf " + TASCAR::to_string(buff) + " 0.0.0.0 " +
-            TASCAR::to_string(4464 + 2 * stagemember.id));
-    tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-n2j");
+    add_network_receiver_client(e_mods, n2jclientname, channels, buff,
+                                4464 + 2 * stagemember.id);
     if(stage.rendersettings.rawmode || stage.thisdevice.receivedownmix) {
       // create additional route for gain control:
       tsccfg::node_t e_route = tsccfg::node_add_child(e_mods, "route");
@@ -272,13 +409,85 @@ void ov_render_tascar_t::add_network_receiver(
     if(stage.rendersettings.secrec > 0) {
       // create a secondary network receiver with additional jitter buffer:
       if(stage.thisstagedeviceid != stagemember.id) {
-        add_secondary_bus(stagemember, e_mods, e_session, waitports, zitapath,
-                          chanlist);
+        add_secondary_bus(stagemember, e_mods, e_session, waitports,
+                          n2jclientname, channels);
       }
     }
   }
 }
 
+void ov_render_tascar_t::add_network_receiver_client(
+    tsccfg::node_t& e_mods, const std::string& jackname, uint8_t channels,
+    double buffer, port_t port)
+{
+  if(inprocess_audio) {
+    netaudio_receiver_cfg.push_back({jackname, channels, buffer, port, {}});
+    return;
+  }
+  std::string chanlist;
+  for(uint32_t k = 0; k < channels; ++k) {
+    if(k)
+      chanlist += ",";
+    chanlist += std::to_string(k + 1);
+  }
+  tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
+  tsccfg::node_set_attribute(
+      e_sys, "command",
+      zitapath + "zita-n2j --chan " + chanlist + " --jname " + jackname +
+          " --buf " + TASCAR::to_string(buffer) + " 0.0.0.0 " +
+          TASCAR::to_string(port));
+  tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-n2j");
+}
+
+void ov_render_tascar_t::add_network_sender_client(tsccfg::node_t& e_mods,
+                                                   uint8_t channels)
+{
+  if(inprocess_audio) {
+    netaudio_sender_channels = channels;
+    return;
+  }
+  tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
+  tsccfg::node_set_attribute(
+      e_sys, "command",
+      zitapath + "zita-j2n --chan " + std::to_string(channels) + " --jname " +
+          stage.thisdeviceid + "_sender --16bit 127.0.0.1 " +
+          std::to_string(4464 + 2 * stage.thisstagedeviceid));
+  tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-j2n");
+}
+
+void ov_render_tascar_t::start_network_audio()
+{
+  for(const auto& cfg : netaudio_receiver_cfg) {
+    netaudio_jack_receiver_t* rec(new netaudio_jack_receiver_t(
+        cfg.jackname, cfg.channels, cfg.buffer, cfg.taps));
+    netaudio_receivers.push_back(rec);
+    if(ovboxclient)
+      ovboxclient->set_local_sink(cfg.port,
+                                  [rec](const char* msg, size_t len) {
+                                    rec->put_packet(msg, len);
+                                  });
+  }
+  if(netaudio_sender_channels > 0)
+    netaudio_sender = new netaudio_jack_sender_t(
+        stage.thisdeviceid + "_sender", netaudio_sender_channels,
+        4464 + 2 * stage.thisstagedeviceid);
+}
+
+void ov_render_tascar_t::stop_network_audio()
+{
+  if(netaudio_sender)
+    delete netaudio_sender;
+  netaudio_sender = NULL;
+  // the network threads do not call the receivers after removal of
+  // the sinks:
+  if(ovboxclient)
+    for(const auto& cfg : netaudio_receiver_cfg)
+      ovboxclient->set_local_sink(cfg.port, nullptr);
+  for(auto rec : netaudio_receivers)
+    delete rec;
+  netaudio_receivers.clear();
+}
+
 void ov_render_tascar_t::create_virtual_acoustics(tsccfg::node_t e_session,
                                                   tsccfg::node_t e_rec,
                                                   tsccfg::node_t e_scene)
@@ -405,6 +614,7 @@ void ov_render_tascar_t::create_virtual_acoustics(tsccfg::node_t e_session,
       // create reverb engine:
       tsccfg::node_t e_rvb(tsccfg::node_add_child(e_scene, "reverb"));
       tsccfg::node_set_attribute(e_rvb, "type", "simplefdn");
+      tsccfg::node_set_attribute(e_rvb, "name", "reverb");
       tsccfg::node_set_attribute(
           e_rvb, "volumetric",
           TASCAR::to_string(to_tascar(stage.rendersettings.roomsize)));
@@ -450,9 +660,7 @@ void ov_render_tascar_t::create_virtual_acoustics(tsccfg::node_t e_session,
   tsccfg::node_t e_jackrec(tsccfg::node_add_child(e_mods, "jackrec"));
   tsccfg::node_set_attribute(e_jackrec, "url", "osc.udp://localhost:9000/");
   tsccfg::node_add_child(e_mods, "touchosc");
-  // create zita-n2j receivers:
-  // this variable holds the path to zita
-  // binaries, or empty (default) for system installed:
+  // create network receivers:
   uint32_t chcnt(0);
   for(auto stagemember : stage.stage) {
     if(stagemember.second.channels.size()) {
@@ -494,14 +702,7 @@ void ov_render_tascar_t::create_virtual_acoustics(tsccfg::node_t e_session,
     metronome.set_xmlattr(tsccfg::node_add_child(e_mplug, "metronome"),
                           tsccfg::node_add_child(e_mplug, "delay"));
     // create network sender:
-    tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
-    tsccfg::node_set_attribute(
-        e_sys, "command",
-        zitapath + "zita-j2n --chan " +
-            std::to_string(thisdev.channels.size()) + " --jname " +
-            stage.thisdeviceid + "_sender --16bit 127.0.0.1 " +
-            std::to_string(4464 + 2 * stage.thisstagedeviceid));
-    tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-j2n");
+    add_network_sender_client(e_mods, (uint8_t)thisdev.channels.size());
     int chn(0);
     for(auto ch : thisdev.channels) {
       ++chn;
@@ -521,13 +722,7 @@ void ov_render_tascar_t::create_virtual_acoustics(tsccfg::node_t e_session,
   }
   if(stage.thisdevice.senddownmix && stage.rendersettings.receive) {
     // create network sender:
-    tsccfg::node_t e_sys(tsccfg::node_add_child(e_mods, "system"));
-    tsccfg::node_set_attribute(
-        e_sys, "command",
-        zitapath + "zita-j2n --chan " + std::to_string(2) + " --jname " +
-            stage.thisdeviceid + "_sender --16bit 127.0.0.1 " +
-            std::to_string(4464 + 2 * stage.thisstagedeviceid));
-    tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-j2n");
+    add_network_sender_client(e_mods, 2);
     session_add_connect(e_session, "render." + stage.thisdeviceid + ":master_l",
                         stage.thisdeviceid + "_sender:in_1");
     session_add_connect(e_session, "render." + stage.thisdeviceid + ":master_r",
@@ -634,14 +829,7 @@ void ov_render_tascar_t::create_raw_dev(tsccfg::node_t e_session)
     }
   }
   if(thisdev.channels.size() > 0) {
-    tsccfg::node_t e_sys = tsccfg::node_add_child(e_mods, "system");
-    tsccfg::node_set_attribute(
-        e_sys, "command",
-        zitapath + "zita-j2n --chan " +
-            std::to_string(thisdev.channels.size()) + " --jname " +
-            stage.thisdeviceid + "_sender --16bit 127.0.0.1 " +
-            std::to_string(4464 + 2 * stage.thisstagedeviceid));
-    tsccfg::node_set_attribute(e_sys, "onunload", "killall zita-j2n");
+    add_network_sender_client(e_mods, (uint8_t)thisdev.channels.size());
     int chn(0);
     for(auto ch : thisdev.channels) {
       ++chn;
@@ -675,13 +863,11 @@ void ov_render_tascar_t::clear_stage()
   }
 }
 
-void ov_render_tascar_t::start_session()
+std::string ov_render_tascar_t::create_session_xml()
 {
-  //#ifdef SHOWDEBUG
-  std::cout << "ov_render_tascar_t::start_session" << std::endl;
-  //#endif
-  // do whatever needs to be done in base class:
-  ov_render_base_t::start_session();
+  // in-process network clients are collected while creating the XML:
+  netaudio_receiver_cfg.clear();
+  netaudio_sender_channels = 0;
   // create a short link to this device:
   // xml code for TASCAR configuration:
   TASCAR::xml_doc_t tsc;
@@ -785,7 +971,85 @@ void ov_render_tascar_t::start_session()
   }
   for(auto xport : stage.rendersettings.xports)
     session_add_connect(e_session, xport.first, xport.second);
+  if(tscinclude.size()) {
+    tsccfg::node_t e_inc(tsccfg::node_add_child(e_session, "include"));
+    tsccfg::node_set_attribute(e_inc, "name", stage.thisdeviceid + ".itsc");
+  }
+  return tsc.save_to_string();
+}
+
+uint64_t ov_render_tascar_t::get_session_hash() const
+{
+  hash_t h;
+  h.add(get_stage_hash(stage));
+  h.add(render_soundscape);
+  h.add(tscinclude);
+  h.add(zitapath);
+  h.add(inprocess_audio);
+  h.add(selfmonitor_delay);
+  h.add(headtrack_tauref);
+  h.add(metronome.bpb);
+  h.add(metronome.bpm);
+  h.add(metronome.bypass);
+  h.add(metronome.delay);
+  h.add(metronome.level);
+  h.add(folder);
+  // the ambient sound is used only after it was downloaded:
+  if(!stage.rendersettings.ambientsound.empty())
+    h.add(file_exists(url2localfilename(stage.rendersettings.ambientsound)));
+  return h.get();
+}
+
+void ov_render_tascar_t::write_debug_session()
+{
+  if(debug_session_writer.joinable())
+    debug_session_writer.join();
+  std::string fname(folder + "ovbox_debugsession.tsc");
+  std::string xml(session_xml);
+  debug_session_writer = std::thread([fname, xml]() {
+    std::ofstream ofh(fname);
+    ofh << xml;
+  });
+}
+
+void ov_render_tascar_t::start_session()
+{
+  //#ifdef SHOWDEBUG
+  std::cout << "ov_render_tascar_t::start_session" << std::endl;
+  //#endif
+  session_trace_t::span_t sp_start(session_trace, "start_session");
+  try {
+    start_session_steps();
+  }
+  catch(...) {
+    // failed starts are traced as well:
+    sp_start.end();
+    write_session_trace();
+    throw;
+  }
+  sp_start.end();
+  write_session_trace();
+}
+
+void ov_render_tascar_t::start_session_steps()
+{
+  // do whatever needs to be done in base class:
+  ov_render_base_t::start_session();
+  // stage devices which are rendered by this session:
+  session_stage = stage.stage;
+  // reuse the session document of the last successful start if
+  // nothing has changed:
+  if(session_xml.empty() || (get_session_hash() != session_xml_hash)) {
+    session_trace_t::span_t sp(session_trace, "create session xml");
+    session_xml = create_session_xml();
+    // generation may add default entries to the stage:
+    session_xml_hash = get_session_hash();
+    if(debug_session)
+      write_debug_session();
+  }
   if(!stage.host.empty()) {
+    session_trace_t::span_t sp(session_trace, "start ovboxclient");
+    std::lock_guard<std::mutex> lk(session_mtx);
     ovboxclient = new ovboxclient_t(
         stage.host, stage.port, 4464 + 2 * stage.thisstagedeviceid, 0, 30,
         stage.pin, stage.thisstagedeviceid, stage.rendersettings.peer2peer,
@@ -795,36 +1059,99 @@ void ov_render_tascar_t::start_session()
         stage.thisdevice.senddownmix, use_proxy);
     if(cb_seqerr)
       ovboxclient->set_seqerr_callback(cb_seqerr, cb_seqerr_data);
-    if(stage.rendersettings.secrec > 0)
+    // in-process receivers read the secondary bus from a tap:
+    if((stage.rendersettings.secrec > 0) && (!inprocess_audio))
       ovboxclient->add_extraport(100);
-    for(auto p : stage.rendersettings.xrecport)
-      ovboxclient->add_receiverport(p, p);
-    ovboxclient->add_receiverport(9870, 9871);
+    ovboxclient->set_receiverports(get_client_receiverports());
     if(pinglogaddr)
       ovboxclient->set_ping_callback(sendpinglog, pinglogaddr);
-    for(auto proxyclient : proxyclients) {
-      ovboxclient->add_proxy_client(proxyclient.first, proxyclient.second);
+    ovboxclient->set_adaptive_ping(adaptive_ping);
+    ovboxclient->set_multi_server_ping(multi_server_ping);
+    ovboxclient->set_path_selection(path_selection);
+    ovboxclient->set_upload_budget(upload_budget);
+    ovboxclient->set_server_relay(server_relay);
+    if(packet_trace) {
+      // a failing trace should not prevent the session:
+      try {
+        ovboxclient->start_trace(folder + "ovbox_packettrace.bin");
+      }
+      catch(const std::exception& e) {
+        std::cerr << "Warning: " << e.what() << std::endl;
+      }
+    }
+    ovboxclient->set_proxy_clients(proxyclients);
+    ovboxclient->set_relay_clients(relayclients);
+    if(proxy_multicast) {
+      std::string group(proxy_multicast_group);
+      if(group.empty())
+        group = get_session_multicast_group(stage.pin);
+      if(is_proxy)
+        ovboxclient->set_proxy_multicast(group, proxy_multicast_port);
+      if(use_proxy)
+        ovboxclient->join_proxy_multicast(group, proxy_multicast_port);
     }
   }
   if(tscinclude.size()) {
-    tsccfg::node_t e_inc(tsccfg::node_add_child(e_session, "include"));
-    tsccfg::node_set_attribute(e_inc, "name", stage.thisdeviceid + ".itsc");
     std::ofstream ofh(stage.thisdeviceid + ".itsc");
     ofh << tscinclude;
   }
-  tsc.save(folder + "ovbox_debugsession.tsc");
-  tascar = new TASCAR::session_t(tsc.save_to_string(),
-                                 TASCAR::session_t::LOAD_STRING, "");
+  if(inprocess_audio) {
+    // the network clients are created before the session, thus the
+    // session can connect to their ports right away:
+    session_trace_t::span_t sp(session_trace, "start network audio");
+    try {
+      start_network_audio();
+    }
+    catch(...) {
+      std::lock_guard<std::mutex> lk(session_mtx);
+      stop_network_audio();
+      if(ovboxclient)
+        delete ovboxclient;
+      ovboxclient = NULL;
+      throw;
+    }
+  }
+  std::set<std::string> prev_ports(list_jack_ports());
+  // loading parses the XML, starts the modules including the zita
+  // processes and waits for their JACK ports:
+  session_trace_t::span_t sp_load(session_trace, "load tascar session");
+  TASCAR::session_t* newtascar(NULL);
   try {
+    newtascar = new TASCAR::session_t(session_xml,
+                                      TASCAR::session_t::LOAD_STRING, "");
+  }
+  catch(...) {
+    session_xml.clear();
+    throw;
+  }
+  sp_load.end();
+  {
+    std::lock_guard<std::mutex> lk(session_mtx);
+    tascar = newtascar;
+  }
+  try {
+    session_trace_t::span_t sp(session_trace, "start tascar session");
     tascar->start();
+    // ports created by the session and its external processes:
+    session_ports.clear();
+    for(const auto& port : list_jack_ports())
+      if(prev_ports.find(port) == prev_ports.end())
+        session_ports.insert(port);
   }
   catch(const std::exception& e) {
     DEBUG(e.what());
     std::string err(e.what());
-    delete tascar;
-    tascar = NULL;
-    if(ovboxclient)
-      delete ovboxclient;
+    // do not reuse a session document which failed:
+    session_xml.clear();
+    {
+      std::lock_guard<std::mutex> lk(session_mtx);
+      delete tascar;
+      tascar = NULL;
+      if(ovboxclient)
+        delete ovboxclient;
+      ovboxclient = NULL;
+      stop_network_audio();
+    }
     // end_session();
     throw ErrMsg(err);
   }
@@ -840,31 +1167,74 @@ void ov_render_tascar_t::start_session()
   if(file_exists("webmixer.js")) {
     command = "node webmixer.js " + ipaddr;
   }
-  if(!command.empty())
+  if(!command.empty()) {
+    session_trace_t::span_t sp(session_trace, "start webmixer");
     h_webmixer = new spawn_process_t(command);
+  }
 #endif
 }
 
+void ov_render_tascar_t::write_session_trace()
+{
+  if(session_tracing) {
+    ++session_trace_count;
+    // a failing trace should not prevent the session:
+    try {
+      session_trace.write(folder + "ovbox_sessiontrace_" +
+                          std::to_string(session_trace_count) + ".json");
+    }
+    catch(const std::exception& e) {
+      std::cerr << "Warning: " << e.what() << std::endl;
+    }
+  }
+  session_trace.clear();
+}
+
 void ov_render_tascar_t::end_session()
 {
 #ifdef SHOWDEBUG
   std::cout << "ov_render_tascar_t::end_session" << std::endl;
 #endif
+  session_trace_t::span_t sp_end(session_trace, "end_session");
   ov_render_base_t::end_session();
-  if(h_webmixer)
+  if(h_webmixer) {
+    session_trace_t::span_t sp(session_trace, "stop webmixer");
     delete h_webmixer;
+  }
   h_webmixer = NULL;
   if(tascar) {
+    // register for port notifications before the ports are removed:
+    jack_port_watch_t portwatch;
+    // stopping deactivates the JACK clients, which returns after their
+    // last process callback:
+    session_trace_t::span_t sp_stop(session_trace, "stop tascar session");
     tascar->stop();
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    delete tascar;
-    tascar = NULL;
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    sp_stop.end();
+    {
+      session_trace_t::span_t sp(session_trace, "unload tascar session");
+      std::lock_guard<std::mutex> lk(session_mtx);
+      delete tascar;
+      tascar = NULL;
+    }
+    // external processes like zita-n2j terminate asynchronously; wait
+    // until they have released their ports:
+    session_trace_t::span_t sp(session_trace, "wait for port removal",
+                               "wait");
+    if(!portwatch.wait_unregistered(session_ports, 1.0))
+      std::cerr << "Warning: Not all ports of the session were removed."
+                << std::endl;
+    session_ports.clear();
   }
   if(ovboxclient) {
+    session_trace_t::span_t sp(session_trace, "stop ovboxclient");
+    std::lock_guard<std::mutex> lk(session_mtx);
     delete ovboxclient;
     ovboxclient = NULL;
   }
+  if(netaudio_sender || (!netaudio_receivers.empty())) {
+    session_trace_t::span_t sp(session_trace, "stop network audio");
+    stop_network_audio();
+  }
 }
 
 void ov_render_tascar_t::start_audiobackend()
@@ -872,11 +1242,15 @@ void ov_render_tascar_t::start_audiobackend()
 #ifdef SHOWDEBUG
   std::cout << "ov_render_tascar_t::start_audiobackend" << std::endl;
 #endif
+  session_trace_t::span_t sp_start(session_trace, "start_audiobackend");
   ov_render_base_t::start_audiobackend();
   if((audiodevice.drivername == "jack") &&
      (audiodevice.devicename != "manual")) {
-    if(h_jack)
+    if(h_jack) {
+      session_trace_t::span_t sp(session_trace, "stop jackd");
+      h_jack->terminate(5.0);
       delete h_jack;
+    }
     char cmd[1024];
     if((audiodevice.devicename != "dummy") &&
        (audiodevice.devicename != "plugdummy")) {
@@ -908,11 +1282,16 @@ void ov_render_tascar_t::start_audiobackend()
               "-r %g -p %d",
               audiodevice.srate, audiodevice.periodsize);
     }
-    h_jack = new spawn_process_t(cmd);
-    // replace sleep by testing for jack presence with timeout:
-    sleep(7);
+    {
+      session_trace_t::span_t sp(session_trace, "start jackd");
+      h_jack = new spawn_process_t(cmd);
+    }
+    session_trace_t::span_t sp(session_trace, "wait for jackd", "wait");
+    if(!wait_for_jack_server(h_jack, 7.0))
+      std::cerr << "Warning: jackd did not start." << std::endl;
   }
   // get list of input ports:
+  session_trace_t::span_t sp_ports(session_trace, "list jack ports");
   jack_client_t* jc;
   jack_options_t opt((jack_options_t)(JackNoStartServer));
   jack_status_t jstat;
@@ -941,12 +1320,15 @@ void ov_render_tascar_t::stop_audiobackend()
 #ifdef SHOWDEBUG
   std::cout << "ov_render_tascar_t::stop_audiobackend" << std::endl;
 #endif
+  session_trace_t::span_t sp_stop(session_trace, "stop_audiobackend");
   ov_render_base_t::stop_audiobackend();
   if(h_jack) {
+    // jackd releases the sound device and cleans up its shared memory
+    // before it terminates:
+    session_trace_t::span_t sp(session_trace, "stop jackd");
+    h_jack->terminate(5.0);
     delete h_jack;
     h_jack = NULL;
-    // wait for jack to clean up properly:
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
   }
 }
 
@@ -959,9 +1341,9 @@ void ov_render_tascar_t::add_stage_device(const stage_device_t& stagedevice)
   // compare with current stage:
   auto p_stage(stage.stage);
   ov_render_base_t::add_stage_device(stagedevice);
-  if((p_stage != stage.stage) && is_session_active()) {
+  if(is_session_active() &&
+     !apply_stage_diff(stage_diff_t(p_stage, stage.stage)))
     require_session_restart();
-  }
 }
 
 void ov_render_tascar_t::rm_stage_device(stage_device_id_t stagedeviceid)
@@ -973,9 +1355,9 @@ void ov_render_tascar_t::rm_stage_device(stage_device_id_t stagedeviceid)
   // compare with current stage:
   auto p_stage(stage.stage);
   ov_render_base_t::rm_stage_device(stagedeviceid);
-  if((p_stage != stage.stage) && is_session_active()) {
+  if(is_session_active() &&
+     !apply_stage_diff(stage_diff_t(p_stage, stage.stage)))
     require_session_restart();
-  }
 }
 
 void ov_render_tascar_t::set_stage(
@@ -984,10 +1366,9 @@ void ov_render_tascar_t::set_stage(
   // compare with current stage:
   auto p_stage(stage.stage);
   ov_render_base_t::set_stage(s);
-  if((p_stage != stage.stage) && is_session_active()) {
+  if(is_session_active() &&
+     !apply_stage_diff(stage_diff_t(p_stage, stage.stage)))
     require_session_restart();
-  }
-  // compare gains:
 }
 
 void ov_render_tascar_t::set_stage_device_gain(stage_device_id_t stagedeviceid,
@@ -995,28 +1376,8 @@ void ov_render_tascar_t::set_stage_device_gain(stage_device_id_t stagedeviceid,
 {
   DEBUG(gain);
   ov_render_base_t::set_stage_device_gain(stagedeviceid, gain);
-  if(is_session_active() && tascar) {
-    uint32_t k = 0;
-    for(auto ch : stage.stage[stagedeviceid].channels) {
-      gain = ch.gain * stage.stage[stagedeviceid].gain;
-      if(stagedeviceid == stage.thisstagedeviceid) {
-        gain *= stage.rendersettings.egogain;
-      } else {
-        // if not self-monitor then decrease gain:
-        gain *= 0.6;
-      }
-      std::string pattern("/" + stage.thisdeviceid + "/" +
-                          get_stagedev_name(stagedeviceid) + "/" +
-                          TASCAR::to_string(k));
-      std::vector<TASCAR::Scene::audio_port_t*> port(
-          tascar->find_audio_ports(std::vector<std::string>(1, pattern)));
-      DEBUG(pattern);
-      DEBUG(port.size());
-      if(port.size())
-        port[0]->set_gain_lin(gain);
-      ++k;
-    }
-  }
+  if(is_session_active() && tascar)
+    update_stage_device_gain(stagedeviceid);
 }
 
 void ov_render_tascar_t::set_stage_device_channel_gain(
@@ -1026,7 +1387,7 @@ void ov_render_tascar_t::set_stage_device_channel_gain(
   ov_render_base_t::set_stage_device_channel_gain(stagedeviceid,
                                                   channeldeviceid, gain);
   if(is_session_active() && tascar)
-    tascar->sound_by_id(channeldeviceid).set_gain_lin(gain);
+    update_stage_device_gain(stagedeviceid);
 }
 
 void ov_render_tascar_t::set_stage_device_channel_position(
@@ -1053,11 +1414,209 @@ void ov_render_tascar_t::set_render_settings(
 #endif
   if((rendersettings != stage.rendersettings) ||
      (thisstagedeviceid != stage.thisstagedeviceid)) {
+    stage_diff_t diff;
+    diff.add_render_settings(stage.rendersettings, rendersettings,
+                             thisstagedeviceid);
+    bool samedevice(thisstagedeviceid == stage.thisstagedeviceid);
     ov_render_base_t::set_render_settings(rendersettings, thisstagedeviceid);
-    require_session_restart();
+    if(!(is_session_active() && samedevice && apply_stage_diff(diff)))
+      require_session_restart();
   }
 }
 
+static void dispatch_osc(TASCAR::osc_server_t* srv, const std::string& path,
+                         const std::vector<float>& values)
+{
+  lo_message msg(lo_message_new());
+  for(auto v : values)
+    lo_message_add_float(msg, v);
+  srv->dispatch_data_message(path.c_str(), msg);
+  lo_message_free(msg);
+}
+
+bool ov_render_tascar_t::apply_stage_diff(const stage_diff_t& diff)
+{
+  if(diff.empty())
+    return true;
+  if(!tascar)
+    return false;
+  if(!diff.only(STAGE_CHANGE_GAIN | STAGE_CHANGE_CHANNELGAIN |
+                STAGE_CHANGE_POSITION | STAGE_CHANGE_CHANNELPOSITION |
+                STAGE_CHANGE_ROOM | STAGE_CHANGE_NETWORK | STAGE_CHANGE_ADDED |
+                STAGE_CHANGE_REMOVED))
+    return false;
+  if((diff.changes & STAGE_CHANGE_NETWORK) && (!ovboxclient))
+    return false;
+  for(auto dev : diff.devices) {
+    // this device defines the receiver and the stage layout:
+    if((dev.first == stage.thisstagedeviceid) &&
+       (dev.second & (STAGE_CHANGE_ADDED | STAGE_CHANGE_REMOVED)))
+      return false;
+    // new devices need their own network receiver and sound source,
+    // thus only devices which are still rendered in the running
+    // session, e.g., after a short disconnect, can be added:
+    if(dev.second & STAGE_CHANGE_ADDED) {
+      auto sdev(session_stage.find(dev.first));
+      if((sdev == session_stage.end()) ||
+         (get_stage_device_changes(sdev->second, stage.stage[dev.first]) &
+          STAGE_CHANGE_STRUCTURE))
+        return false;
+    }
+  }
+  for(auto dev : diff.devices) {
+    if(dev.second & (STAGE_CHANGE_GAIN | STAGE_CHANGE_CHANNELGAIN |
+                     STAGE_CHANGE_ADDED | STAGE_CHANGE_REMOVED))
+      update_stage_device_gain(dev.first);
+    if(dev.second & (STAGE_CHANGE_POSITION | STAGE_CHANGE_ADDED))
+      update_stage_device_position(dev.first);
+    if(dev.second & (STAGE_CHANGE_CHANNELPOSITION | STAGE_CHANGE_ADDED))
+      update_stage_device_channel_position(dev.first);
+  }
+  if(diff.changes & STAGE_CHANGE_ROOM)
+    update_room_acoustics();
+  if(diff.changes & STAGE_CHANGE_NETWORK) {
+    // peer-to-peer mode and extra receiver ports are only used by the
+    // network client:
+    ovboxclient->set_mode(get_client_mode());
+    ovboxclient->set_receiverports(get_client_receiverports());
+  }
+  return true;
+}
+
+void ov_render_tascar_t::update_stage_device_gain(stage_device_id_t id)
+{
+  // ports are named as in the running session, which may still
+  // contain devices which left the stage; these are silenced:
+  auto sdev(session_stage.find(id));
+  if(sdev == session_stage.end())
+    return;
+  auto dev(stage.stage.find(id));
+  std::string devname(sdev->second.label + "_" + TASCAR::to_string(id));
+  // route modules get the device gain, in dB:
+  double routegain(0.0);
+  if(dev != stage.stage.end())
+    routegain = dev->second.gain;
+  float routegain_db((float)(20.0 * log10(std::max(routegain, 1e-10))));
+  // in raw mode and when receiving a downmix the network receiver is
+  // mixed by a route module, see add_network_receiver():
+  if((stage.rendersettings.rawmode || stage.thisdevice.receivedownmix) &&
+     (id != stage.thisstagedeviceid))
+    dispatch_osc(tascar, "/" + devname + "." + stage.thisdeviceid + "/gain",
+                 {routegain_db});
+  // the secondary bus is a route module, see add_secondary_bus():
+  if(stage.rendersettings.secrec > 0)
+    dispatch_osc(tascar, "/" + devname + "_sec/gain", {routegain_db});
+  std::string name(devname);
+  if(id == stage.thisstagedeviceid)
+    name = "ego";
+  for(uint32_t k = 0; k < sdev->second.channels.size(); ++k) {
+    double gain(0.0);
+    if((dev != stage.stage.end()) && (k < dev->second.channels.size())) {
+      gain = dev->second.channels[k].gain * dev->second.gain;
+      if(id == stage.thisstagedeviceid)
+        gain *= stage.rendersettings.egogain;
+      else if(!stage.rendersettings.distancelaw)
+        // if not self-monitor then decrease gain:
+        gain *= 0.6;
+    }
+    std::string pattern("/" + stage.thisdeviceid + "/" + name + "/" +
+                        TASCAR::to_string(k));
+    std::vector<TASCAR::Scene::audio_port_t*> port(
+        tascar->find_audio_ports(std::vector<std::string>(1, pattern)));
+    if(port.size())
+      port[0]->set_gain_lin(gain);
+  }
+}
+
+void ov_render_tascar_t::update_stage_device_position(stage_device_id_t id)
+{
+  auto thisdev(stage.stage.find(stage.thisstagedeviceid));
+  auto dev(stage.stage.find(id));
+  if((thisdev == stage.stage.end()) || (dev == stage.stage.end()))
+    return;
+  // devices which are not sending use a fixed stage layout, see
+  // create_virtual_acoustics():
+  if(thisdev->second.channels.empty() || thisdev->second.senddownmix)
+    return;
+  std::vector<float> pos(
+      {(float)dev->second.position.x, (float)dev->second.position.y,
+       (float)dev->second.position.z});
+  std::vector<float> rot({(float)(RAD2DEG * dev->second.orientation.z),
+                          (float)(RAD2DEG * dev->second.orientation.y),
+                          (float)(RAD2DEG * dev->second.orientation.x)});
+  std::string prefix("/" + stage.thisdeviceid + "/");
+  std::string name(get_stagedev_name(id));
+  if(id == stage.thisstagedeviceid)
+    name = "ego";
+  dispatch_osc(tascar, prefix + name + "/pos", pos);
+  dispatch_osc(tascar, prefix + name + "/zyxeuler", rot);
+  if(id == stage.rendersettings.id) {
+    dispatch_osc(tascar, prefix + "master/pos", pos);
+    dispatch_osc(tascar, prefix + "master/zyxeuler", rot);
+  }
+}
+
+void ov_render_tascar_t::update_stage_device_channel_position(
+    stage_device_id_t id)
+{
+  auto dev(stage.stage.find(id));
+  if(dev == stage.stage.end())
+    return;
+  for(const auto& ch : dev->second.channels) {
+    try {
+      tascar->sound_by_id(ch.id).local_position = to_tascar(ch.position);
+    }
+    catch(const std::exception&) {
+      // no sound source was created for this channel
+    }
+  }
+}
+
+void ov_render_tascar_t::update_room_acoustics()
+{
+  std::string prefix("/" + stage.thisdeviceid + "/");
+  if(stage.rendersettings.renderism) {
+    dispatch_osc(tascar, prefix + "room/reflectivity",
+                 {(float)sqrt(1.0 - stage.rendersettings.absorption)});
+    dispatch_osc(tascar, prefix + "room/damping",
+                 {(float)stage.rendersettings.damping});
+  }
+  if(stage.rendersettings.renderreverb) {
+    dispatch_osc(tascar, prefix + "reverb/absorption",
+                 {(float)stage.rendersettings.absorption});
+    dispatch_osc(tascar, prefix + "reverb/damping",
+                 {(float)stage.rendersettings.damping});
+    dispatch_osc(tascar, prefix + "reverb/gain",
+                 {(float)(20.0 * log10(stage.rendersettings.reverbgain))});
+  }
+}
+
+epmode_t ov_render_tascar_t::get_client_mode() const
+{
+  epmode_t mode(0);
+  if(stage.rendersettings.peer2peer)
+    mode |= B_PEER2PEER;
+  if(stage.thisdevice.receivedownmix)
+    mode |= B_RECEIVEDOWNMIX;
+  if(use_proxy || (!stage.rendersettings.receive))
+    mode |= B_DONOTSEND;
+  if(stage.thisdevice.senddownmix)
+    mode |= B_SENDDOWNMIX;
+  if(use_proxy)
+    mode |= B_USINGPROXY;
+  return mode;
+}
+
+std::vector<std::pair<port_t, port_t>>
+ov_render_tascar_t::get_client_receiverports() const
+{
+  std::vector<std::pair<port_t, port_t>> ports;
+  for(auto p : stage.rendersettings.xrecport)
+    ports.push_back(std::make_pair(p, p));
+  ports.push_back(std::make_pair(9870, 9871));
+  return ports;
+}
+
 std::string ov_render_tascar_t::get_stagedev_name(stage_device_id_t id) const
 {
   auto stagedev(stage.stage.find(id));
@@ -1106,7 +1665,18 @@ void ov_render_tascar_t::set_extra_config(const std::string& js)
       tscinclude = my_js_value(xcfg, "tscinclude", tscinclude);
       if(prev_tscinclude != tscinclude)
         restart_session = true;
+      session_tracing = my_js_value(xcfg, "sessiontrace", session_tracing);
+      bool new_debug_session(my_js_value(xcfg, "debugsession", debug_session));
+      if(new_debug_session && (!debug_session) && (!session_xml.empty()))
+        write_debug_session();
+      debug_session = new_debug_session;
       if(xcfg["network"].is_object()) {
+        bool new_inprocess_audio(
+            my_js_value(xcfg["network"], "inprocessaudio", inprocess_audio));
+        if(new_inprocess_audio != inprocess_audio) {
+          inprocess_audio = new_inprocess_audio;
+          restart_session = true;
+        }
         double new_deadline =
             my_js_value(xcfg["network"], "deadline", sorter_deadline);
         if(new_deadline != sorter_deadline) {
@@ -1121,6 +1691,55 @@ void ov_render_tascar_t::set_extra_config(const std::string& js)
           if(expedited_forwarding_PHB && ovboxclient)
             ovboxclient->set_expedited_forwarding_PHB();
         }
+        adaptive_ping =
+            my_js_value(xcfg["network"], "adaptiveping", adaptive_ping);
+        multi_server_ping =
+            my_js_value(xcfg["network"], "multiserverping", multi_server_ping);
+        path_selection =
+            my_js_value(xcfg["network"], "pathselection", path_selection);
+        upload_budget =
+            my_js_value(xcfg["network"], "uploadbudget", upload_budget);
+        server_relay =
+            my_js_value(xcfg["network"], "serverrelay", server_relay);
+        bool new_packet_trace(
+            my_js_value(xcfg["network"], "packettrace", packet_trace));
+        if(ovboxclient && (new_packet_trace != packet_trace)) {
+          if(new_packet_trace) {
+            // a failing trace should not prevent the configuration:
+            try {
+              ovboxclient->start_trace(folder + "ovbox_packettrace.bin");
+            }
+            catch(const std::exception& e) {
+              std::cerr << "Warning: " << e.what() << std::endl;
+            }
+          } else
+            ovboxclient->stop_trace();
+        }
+        packet_trace = new_packet_trace;
+        int new_metrics_port(
+            my_js_value(xcfg["network"], "metricsport", metrics_port));
+        if(new_metrics_port != metrics_port) {
+          metrics_port = new_metrics_port;
+          if(metrics_server)
+            delete metrics_server;
+          metrics_server = NULL;
+          if(metrics_port > 0) {
+            try {
+              metrics_server = new metrics_server_t(
+                  metrics_port, [this]() { return get_metrics(); });
+            }
+            catch(const std::exception& e) {
+              std::cerr << "Warning: " << e.what() << std::endl;
+            }
+          }
+        }
+        if(ovboxclient) {
+          ovboxclient->set_upload_budget(upload_budget);
+          ovboxclient->set_server_relay(server_relay);
+          ovboxclient->set_adaptive_ping(adaptive_ping);
+          ovboxclient->set_multi_server_ping(multi_server_ping);
+          ovboxclient->set_path_selection(path_selection);
+        }
       }
       if(xcfg["headtrack"].is_object())
         headtrack_tauref = my_js_value(xcfg["headtrack"], "tauref", 33.315);
@@ -1161,13 +1780,44 @@ void ov_render_tascar_t::set_extra_config(const std::string& js)
               cfg_proxyclients[cfg_proxy_id] = cfg_proxy_ip;
           }
         }
+        // relay clients, for relay trees across networks:
+        nlohmann::json js_relayclients(xcfg["proxy"]["relayclients"]);
+        std::vector<stage_device_id_t> cfg_relayclients;
+        if(js_relayclients.is_array()) {
+          for(auto relayclient : js_relayclients) {
+            int32_t cfg_relay_id = my_js_value(relayclient, "id", -1);
+            if((cfg_relay_id >= 0) && (cfg_relay_id < MAX_STAGE_ID))
+              cfg_relayclients.push_back(cfg_relay_id);
+          }
+        }
+        bool cfg_multicast = my_js_value(xcfg["proxy"], "multicast", false);
+        std::string cfg_multicast_group =
+            my_js_value(xcfg["proxy"], "multicastgroup", std::string(""));
+        port_t cfg_multicast_port =
+            my_js_value(xcfg["proxy"], "multicastport", (port_t)4460);
         if((cfg_is_proxy != is_proxy) || (cfg_use_proxy != use_proxy) ||
-           (cfg_proxyclients != proxyclients) || (cfg_proxyip != proxyip))
+           (cfg_proxyip != proxyip) || (cfg_multicast != proxy_multicast) ||
+           (cfg_multicast_group != proxy_multicast_group) ||
+           (cfg_multicast_port != proxy_multicast_port))
+          restart_session = true;
+        if(!restart_session && ovboxclient) {
+          // proxy and relay clients can be changed while the session
+          // is running:
+          if(cfg_proxyclients != proxyclients)
+            ovboxclient->set_proxy_clients(cfg_proxyclients);
+          if(cfg_relayclients != relayclients)
+            ovboxclient->set_relay_clients(cfg_relayclients);
+        } else if((cfg_proxyclients != proxyclients) ||
+                  (cfg_relayclients != relayclients))
           restart_session = true;
         is_proxy = cfg_is_proxy;
         use_proxy = cfg_use_proxy;
         proxyclients = cfg_proxyclients;
         proxyip = cfg_proxyip;
+        proxy_multicast = cfg_multicast;
+        proxy_multicast_group = cfg_multicast_group;
+        proxy_multicast_port = cfg_multicast_port;
+        relayclients = cfg_relayclients;
       }
       if(is_session_active() && restart_session) {
         require_session_restart();
@@ -1189,6 +1839,15 @@ void ov_render_tascar_t::set_seqerr_callback(
   cb_seqerr_data = d;
 }
 
+nlohmann::json to_json(const ping_stat_t::window_t& win)
+{
+  nlohmann::json p;
+  p["median"] = win.t_med;
+  p["p99"] = win.t_p99;
+  p["n"] = win.n;
+  return p;
+}
+
 nlohmann::json to_json(const ping_stat_t& ps)
 {
   nlohmann::json p;
@@ -1198,6 +1857,27 @@ nlohmann::json to_json(const ping_stat_t& ps)
   p["mean"] = ps.t_mean;
   p["received"] = ps.received;
   p["lost"] = ps.lost;
+  p["up"] = ps.t_up;
+  p["down"] = ps.t_down;
+  p["1s"] = to_json(ps.win_1s);
+  p["10s"] = to_json(ps.win_10s);
+  return p;
+}
+
+nlohmann::json to_json(const stream_stat_t& ss)
+{
+  nlohmann::json p;
+  p["port"] = ss.port;
+  p["jitter"] = ss.jitter;
+  p["period"] = ss.period;
+  p["iatbinwidth"] = IAT_BINWIDTH;
+  p["iat"] = std::vector<size_t>(ss.iat, ss.iat + IAT_BINS);
+  p["lost"] = ss.lost;
+  p["bursts"] = ss.bursts;
+  p["burstlength"] = std::vector<size_t>(ss.burst, ss.burst + LOSS_BINS);
+  p["gaplength"] = std::vector<size_t>(ss.gap, ss.gap + GAP_BINS);
+  p["gep"] = ss.ge_p;
+  p["ger"] = ss.ge_r;
   return p;
 }
 
@@ -1208,6 +1888,41 @@ nlohmann::json to_json(const message_stat_t& ms)
   p["lost"] = ms.lost;
   p["seqerr"] = ms.seqerr_in;
   p["seqrecovered"] = ms.seqerr_in - ms.seqerr_out;
+  p["holdtime"] = ms.holdtime;
+  p["jitter"] = ms.get_jitter();
+  p["streams"] = nlohmann::json::array();
+  for(const auto& ss : ms.streams)
+    if(ss.port)
+      p["streams"].push_back(to_json(ss));
+  return p;
+}
+
+nlohmann::json to_json(const bandwidth_stat_t& bw)
+{
+  nlohmann::json p;
+  p["rx"] = bw.rx_kbps;
+  p["rxpps"] = bw.rx_pps;
+  p["rxsent"] = bw.rx_sent_kbps;
+  p["tx"] = bw.tx_kbps;
+  p["gradientup"] = bw.gradient_up;
+  p["gradientdown"] = bw.gradient_down;
+  p["gradientrtt"] = bw.gradient_rtt;
+  p["congestionup"] = (int)bw.congestion_up;
+  p["congestiondown"] = (int)bw.congestion_down;
+  return p;
+}
+
+nlohmann::json to_json(const latency_budget_t& lb)
+{
+  nlohmann::json p;
+  p["audio"] = lb.audio;
+  p["senderjitter"] = lb.senderjitter;
+  p["receiverjitter"] = lb.receiverjitter;
+  p["network"] = lb.network;
+  p["sorter"] = lb.sorter;
+  p["loopbackhops"] = lb.loopbackhops;
+  p["loopback"] = lb.loopback;
+  p["total"] = lb.get_total();
   return p;
 }
 
@@ -1218,9 +1933,27 @@ nlohmann::json to_json(const client_stats_t& ms)
   p["srv"] = to_json(ms.ping_srv);
   p["loc"] = to_json(ms.ping_loc);
   p["packages"] = to_json(ms.packages);
+  p["clockoffset"] = ms.clock_offset;
+  p["bandwidth"] = to_json(ms.bandwidth);
+  p["latency"] = to_json(ms.latency);
   return p;
 }
 
+std::string ov_render_tascar_t::get_metrics()
+{
+  std::lock_guard<std::mutex> lk(session_mtx);
+  std::string s;
+  if(ovboxclient)
+    s = ovboxclient->get_metrics();
+  s += metric_header("ov_session_active", "gauge",
+                     "1 if a session is running.");
+  s += metric_value("ov_session_active", "", (tascar != NULL));
+  s += metric_header("ov_tascar_load", "gauge",
+                     "CPU load of the audio processing, between 0 and 1.");
+  s += metric_value("ov_tascar_load", "", get_load());
+  return s;
+}
+
 std::string ov_render_tascar_t::get_client_stats()
 {
   if(ovboxclient)
@@ -1229,12 +1962,55 @@ std::string ov_render_tascar_t::get_client_stats()
   else
     client_stats.clear();
   nlohmann::json jsstat;
-  for(auto stat : client_stats)
-    if(stat.first != stage.thisstagedeviceid)
+  for(auto& stat : client_stats)
+    if(stat.first != stage.thisstagedeviceid) {
+      stat.second.latency = get_latency_budget(stat.first);
       jsstat[stat.first] = to_json(stat.second);
+    }
   return jsstat.dump();
 }
 
+latency_budget_t
+ov_render_tascar_t::get_latency_budget(stage_device_id_t cid) const
+{
+  latency_budget_t lb;
+  auto stat(client_stats.find(cid));
+  auto dev(stage.stage.find(cid));
+  auto thisdev(stage.stage.find(stage.thisstagedeviceid));
+  if((stat == client_stats.end()) || (dev == stage.stage.end()) ||
+     (thisdev == stage.stage.end()))
+    return lb;
+  const client_stats_t& cs(stat->second);
+  if(audiodevice.srate > 0)
+    lb.audio = 1000.0 * audiodevice.periodsize * audiodevice.numperiods /
+               audiodevice.srate;
+  // the receiver buffer of zita-n2j is the sum of both jitter settings:
+  lb.senderjitter = dev->second.senderjitter;
+  lb.receiverjitter = thisdev->second.receiverjitter;
+  // both peers use the same path, see ovboxclient_t::update_path():
+  path_t path(PATH_SERVER);
+  if(stage.rendersettings.peer2peer && ovboxclient)
+    path = ovboxclient->get_path(cid);
+  const ping_stat_t* ps(&cs.ping_srv);
+  if(path == PATH_P2P)
+    ps = &cs.ping_p2p;
+  else if(path == PATH_LOCAL)
+    ps = &cs.ping_loc;
+  // use the one-way delay if the clock offset is known, otherwise
+  // half of the round trip time:
+  if(ps->t_down >= 0)
+    lb.network = ps->t_down;
+  else if(ps->t_med > 0)
+    lb.network = 0.5 * ps->t_med;
+  if(cs.packages.received > 0)
+    lb.sorter = cs.packages.holdtime / (double)cs.packages.received;
+  // zita-j2n to client of peer, and local client to zita-n2j. The
+  // in-process receiver gets packets from the local client directly:
+  lb.loopbackhops = inprocess_audio ? 1 : 2;
+  lb.loopback = lb.loopbackhops * LOOPBACK_HOP_MS;
+  return lb;
+}
+
 /*
  * Local Variables:
  * compile-command: "make -C .."
@@ -21,10 +21,16 @@
 #define OV_RENDER_TASCAR
 
 #include "../tascar/libtascar/include/session.h"
+#include "metricsserver.h"
+#include "netaudio_jack.h"
 #include "ov_tools.h"
 #include "ovboxclient.h"
+#include "sessiontrace.h"
 #include "spawn_process.h"
 #include <lo/lo.h>
+#include <mutex>
+#include <set>
+#include <thread>
 
 #ifndef ZITAPATH
 #define ZITAPATH ""
@@ -62,6 +68,16 @@ public:
                                cb,
                            void* data);
   std::string get_client_stats();
+  /**
+   * Return the estimated mouth-to-ear latency of the audio from a
+   * peer, split into its components.
+   * @param cid Device ID of peer
+   *
+   * The estimate is based on the client statistics of the last call
+   * of get_client_stats(), which also reports the latency of all
+   * peers.
+   */
+  latency_budget_t get_latency_budget(stage_device_id_t cid) const;
   std::string get_zita_path();
   void set_zita_path(const std::string& path);
   class metronome_t {
@@ -80,18 +96,71 @@ public:
   };
 
 private:
+  /**
+   * Create the TASCAR session document of the current stage.
+   * @return Session XML code
+   */
+  std::string create_session_xml();
+  /**
+   * Hash of all settings which are used by create_session_xml().
+   */
+  uint64_t get_session_hash() const;
+  // write the session document to the runtime folder in a background
+  // thread:
+  void write_debug_session();
   void create_virtual_acoustics(tsccfg::node_t session, tsccfg::node_t e_rec,
                                 tsccfg::node_t e_scene);
   void create_raw_dev(tsccfg::node_t session);
   void add_secondary_bus(const stage_device_t& stagemember,
                          tsccfg::node_t& e_mods, tsccfg::node_t& e_session,
                          std::vector<std::string>& waitports,
-                         const std::string& zitapath,
-                         const std::string& chanlist);
+                         const std::string& n2jclientname, uint8_t channels);
   void add_network_receiver(const stage_device_t& stagemember,
                             tsccfg::node_t& e_mods, tsccfg::node_t& e_session,
                             std::vector<std::string>& waitports,
                             uint32_t& chcnt);
+  /**
+   * Add a network audio receiver for one stage member to the session.
+   * @param e_mods Modules section of the session
+   * @param jackname JACK client name of the receiver
+   * @param channels Number of channels
+   * @param buffer Jitter buffer length in milliseconds
+   * @param port Local UDP port to which ovboxclient_t sends the data
+   */
+  void add_network_receiver_client(tsccfg::node_t& e_mods,
+                                   const std::string& jackname,
+                                   uint8_t channels, double buffer,
+                                   port_t port);
+  /**
+   * Add the network audio sender of this device to the session.
+   * @param e_mods Modules section of the session
+   * @param channels Number of channels
+   */
+  void add_network_sender_client(tsccfg::node_t& e_mods, uint8_t channels);
+  // create the in-process network audio clients of the session:
+  void start_network_audio();
+  // close the in-process network audio clients and remove them from
+  // ovboxclient, if it exists:
+  void stop_network_audio();
+  /**
+   * Apply differences of the stage or render settings to the running
+   * session.
+   * @param diff Differences to the previous stage; the new stage is
+   * already stored
+   * @return False if the differences require a session restart
+   */
+  bool apply_stage_diff(const stage_diff_t& diff);
+  /**
+   * Set the gains of a stage device in the running session, i.e., of
+   * its sound sources and route modules.
+   * @param id Stage device ID
+   */
+  void update_stage_device_gain(stage_device_id_t id);
+  void update_stage_device_position(stage_device_id_t id);
+  void update_stage_device_channel_position(stage_device_id_t id);
+  void update_room_acoustics();
+  epmode_t get_client_mode() const;
+  std::vector<std::pair<port_t, port_t>> get_client_receiverports() const;
   // for the time being we (optionally if jack is chosen as an audio
   // backend) start the jack backend. This will be replaced by a more
   // generic audio backend interface:
@@ -130,6 +199,18 @@ private:
 
   */
   bool use_proxy;
+  /**
+     \brief use multicast for communication between proxy and clients
+     \ingroup proxymode
+   */
+  bool proxy_multicast;
+  std::string proxy_multicast_group;
+  port_t proxy_multicast_port;
+  /**
+     \brief relay clients of this device
+     \ingroup proxymode
+   */
+  std::vector<stage_device_id_t> relayclients;
   std::string proxyip;
   std::string localip;
   std::function<void(stage_device_id_t sender, sequence_t expected,
@@ -137,11 +218,67 @@ private:
       cb_seqerr;
   void* cb_seqerr_data;
   std::map<stage_device_id_t, client_stats_t> client_stats;
+  // stage devices at session start, i.e., devices which have a
+  // network receiver and sound source in the running session:
+  std::map<stage_device_id_t, stage_device_t> session_stage;
+  // JACK ports of the running session, which are removed when the
+  // session ends:
+  std::set<std::string> session_ports;
+  // use in-process JACK clients instead of zita-n2j and zita-j2n
+  // (experimental, "inprocessaudio" in the "network" configuration):
+  bool inprocess_audio;
+  // in-process network receiver of the session:
+  class netaudio_cfg_t {
+  public:
+    std::string jackname;
+    uint8_t channels;
+    double buffer;
+    port_t port;
+    // additional delay of each tap in milliseconds:
+    std::vector<double> taps;
+  };
+  std::vector<netaudio_cfg_t> netaudio_receiver_cfg;
+  // number of channels of the in-process sender, or zero:
+  uint8_t netaudio_sender_channels;
+  std::vector<netaudio_jack_receiver_t*> netaudio_receivers;
+  netaudio_jack_sender_t* netaudio_sender;
   double sorter_deadline;
   bool expedited_forwarding_PHB;
+  bool adaptive_ping;
+  bool multi_server_ping;
+  bool path_selection;
+  // upload budget in kbit/s, or zero for no limit:
+  double upload_budget;
+  // the server forwards messages between peer-to-peer devices:
+  bool server_relay;
+  // record packet headers to runtime folder:
+  bool packet_trace;
+  std::string get_metrics();
+  // local metrics endpoint, or NULL if not configured:
+  metrics_server_t* metrics_server;
+  int metrics_port;
+  // lock replacement of session objects which are read by the
+  // metrics server thread:
+  std::mutex session_mtx;
   bool render_soundscape;
   // user provided TASCAR include file content:
   std::string tscinclude;
+  // write the collected spans to the runtime folder, once per session
+  // start, and start a new trace:
+  void write_session_trace();
+  // steps of start_session(), which traces them also on failure:
+  void start_session_steps();
+  // spans of session and audio backend start and stop:
+  session_trace_t session_trace;
+  bool session_tracing;
+  uint32_t session_trace_count;
+  // session document of the last successful start, or empty:
+  std::string session_xml;
+  // hash of the settings from which session_xml was created:
+  uint64_t session_xml_hash;
+  // write each new session document to the runtime folder:
+  bool debug_session;
+  std::thread debug_session_writer;
 };
 
 #endif
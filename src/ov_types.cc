@@ -18,6 +18,7 @@
  */
 
 #include "ov_types.h"
+#include <algorithm>
 #include <iostream>
 #ifndef DEBUG
 #define DEBUG(x)                                                               \
@@ -159,6 +160,199 @@ bool operator!=(const render_settings_t& a, const render_settings_t& b)
          (a.decorr != b.decorr);
 }
 
+uint32_t get_stage_device_changes(const stage_device_t& a,
+                                  const stage_device_t& b)
+{
+  uint32_t changes(0);
+  if(a.gain != b.gain)
+    changes |= STAGE_CHANGE_GAIN;
+  if((a.position != b.position) || (a.orientation != b.orientation))
+    changes |= STAGE_CHANGE_POSITION;
+  if((a.id != b.id) || (a.label != b.label) ||
+     (a.channels.size() != b.channels.size()) ||
+     (a.senderjitter != b.senderjitter) ||
+     (a.receiverjitter != b.receiverjitter) || (a.sendlocal != b.sendlocal) ||
+     (a.receivedownmix != b.receivedownmix) ||
+     (a.senddownmix != b.senddownmix))
+    return changes | STAGE_CHANGE_STRUCTURE;
+  for(size_t k = 0; k < a.channels.size(); ++k) {
+    const device_channel_t& cha(a.channels[k]);
+    const device_channel_t& chb(b.channels[k]);
+    if((cha.id != chb.id) || (cha.sourceport != chb.sourceport) ||
+       (cha.directivity != chb.directivity))
+      changes |= STAGE_CHANGE_STRUCTURE;
+    if(cha.gain != chb.gain)
+      changes |= STAGE_CHANGE_CHANNELGAIN;
+    if(cha.position != chb.position)
+      changes |= STAGE_CHANGE_CHANNELPOSITION;
+  }
+  return changes;
+}
+
+uint32_t get_render_settings_changes(const render_settings_t& a,
+                                     const render_settings_t& b)
+{
+  uint32_t changes(0);
+  if(a.egogain != b.egogain)
+    changes |= STAGE_CHANGE_GAIN;
+  if((a.absorption != b.absorption) || (a.damping != b.damping) ||
+     (a.reverbgain != b.reverbgain))
+    changes |= STAGE_CHANGE_ROOM;
+  if((a.peer2peer != b.peer2peer) || (a.xrecport != b.xrecport))
+    changes |= STAGE_CHANGE_NETWORK;
+  // compare all remaining settings:
+  render_settings_t cmp(b);
+  cmp.egogain = a.egogain;
+  cmp.absorption = a.absorption;
+  cmp.damping = a.damping;
+  cmp.reverbgain = a.reverbgain;
+  cmp.peer2peer = a.peer2peer;
+  cmp.xrecport = a.xrecport;
+  if(a != cmp)
+    changes |= STAGE_CHANGE_STRUCTURE;
+  return changes;
+}
+
+stage_diff_t::stage_diff_t() : changes(0) {}
+
+stage_diff_t::stage_diff_t(
+    const std::map<stage_device_id_t, stage_device_t>& prev,
+    const std::map<stage_device_id_t, stage_device_t>& next)
+    : changes(0)
+{
+  for(const auto& dev : prev) {
+    auto it(next.find(dev.first));
+    uint32_t c(STAGE_CHANGE_REMOVED);
+    if(it != next.end())
+      c = get_stage_device_changes(dev.second, it->second);
+    if(c) {
+      devices[dev.first] = c;
+      changes |= c;
+    }
+  }
+  for(const auto& dev : next)
+    if(prev.find(dev.first) == prev.end()) {
+      devices[dev.first] = STAGE_CHANGE_ADDED;
+      changes |= STAGE_CHANGE_ADDED;
+    }
+}
+
+void stage_diff_t::add_render_settings(const render_settings_t& prev,
+                                       const render_settings_t& next,
+                                       stage_device_id_t thisstagedeviceid)
+{
+  uint32_t c(get_render_settings_changes(prev, next));
+  if(c & STAGE_CHANGE_GAIN)
+    devices[thisstagedeviceid] |= STAGE_CHANGE_GAIN;
+  changes |= c;
+}
+
+void hash_t::add_bytes(const void* data, size_t len)
+{
+  const uint8_t* p((const uint8_t*)data);
+  for(size_t k = 0; k < len; ++k) {
+    h ^= p[k];
+    h *= 0x100000001b3ull;
+  }
+}
+
+void hash_t::add(const std::string& s)
+{
+  add(s.size());
+  add_bytes(s.data(), s.size());
+}
+
+void hash_t::add(const pos_t& p)
+{
+  add(p.x);
+  add(p.y);
+  add(p.z);
+}
+
+void hash_t::add(const zyx_euler_t& r)
+{
+  add(r.z);
+  add(r.y);
+  add(r.x);
+}
+
+static void hash_stage_device(hash_t& h, const stage_device_t& d)
+{
+  h.add(d.id);
+  h.add(d.label);
+  h.add(d.channels.size());
+  for(const auto& ch : d.channels) {
+    h.add(ch.id);
+    h.add(ch.sourceport);
+    h.add(ch.gain);
+    h.add(ch.position);
+    h.add(ch.directivity);
+  }
+  h.add(d.position);
+  h.add(d.orientation);
+  h.add(d.gain);
+  h.add(d.mute);
+  h.add(d.senderjitter);
+  h.add(d.receiverjitter);
+  h.add(d.sendlocal);
+  h.add(d.receivedownmix);
+  h.add(d.senddownmix);
+}
+
+uint64_t get_stage_hash(const stage_t& stage)
+{
+  hash_t h;
+  h.add(stage.host);
+  h.add(stage.port);
+  h.add(stage.pin);
+  const render_settings_t& rs(stage.rendersettings);
+  h.add(rs.id);
+  h.add(rs.roomsize);
+  h.add(rs.absorption);
+  h.add(rs.damping);
+  h.add(rs.reverbgain);
+  h.add(rs.renderreverb);
+  h.add(rs.renderism);
+  h.add(rs.distancelaw);
+  h.add(rs.rawmode);
+  h.add(rs.receive);
+  h.add(rs.rectype);
+  h.add(rs.egogain);
+  h.add(rs.mastergain);
+  h.add(rs.peer2peer);
+  h.add(rs.outputport1);
+  h.add(rs.outputport2);
+  // the order of an unordered map depends on its history:
+  std::map<std::string, std::string> xports(rs.xports.begin(),
+                                            rs.xports.end());
+  h.add(xports.size());
+  for(const auto& xp : xports) {
+    h.add(xp.first);
+    h.add(xp.second);
+  }
+  h.add(rs.xrecport.size());
+  for(auto p : rs.xrecport)
+    h.add(p);
+  h.add(rs.secrec);
+  h.add(rs.headtracking);
+  h.add(rs.headtrackingrotrec);
+  h.add(rs.headtrackingrotsrc);
+  h.add(rs.headtrackingport);
+  h.add(rs.ambientsound);
+  h.add(rs.ambientlevel);
+  h.add(rs.lmetertc);
+  h.add(rs.lmeterfw);
+  h.add(rs.delaycomp);
+  h.add(rs.decorr);
+  h.add(stage.thisdeviceid);
+  h.add(stage.thisstagedeviceid);
+  h.add(stage.stage.size());
+  for(const auto& dev : stage.stage)
+    hash_stage_device(h, dev.second);
+  hash_stage_device(h, stage.thisdevice);
+  return h.get();
+}
+
 render_settings_t::render_settings_t()
     : id(0),                              // stage_device_id_t id;
       roomsize(default_roomsize),         // pos_t roomsize;
@@ -401,11 +595,46 @@ void ov_render_base_t::set_stage_device_channel_position(
 
 ping_stat_t::ping_stat_t()
     : t_min(0), t_med(0), t_p99(0), t_mean(0), received(0), lost(0),
-      state_sent(0), state_received(0)
+      t_up(-1), t_down(-1), state_sent(0), state_received(0)
+{
+}
+
+bandwidth_stat_t::bandwidth_stat_t()
+    : rx_kbps(0), rx_pps(0), rx_sent_kbps(0), tx_kbps(0), gradient_up(0),
+      gradient_down(0), gradient_rtt(0), congestion_up(CONGESTION_NORMAL),
+      congestion_down(CONGESTION_NORMAL), state_rx_bytes(0),
+      state_rx_packets(0), state_tx_bytes(0), state_t(-1)
 {
 }
+
+ping_stat_t::window_t::window_t() : t_med(-1), t_p99(-1), n(0) {}
+
+latency_budget_t::latency_budget_t()
+    : audio(0), senderjitter(0), receiverjitter(0), network(0), sorter(0),
+      loopbackhops(0), loopback(0)
+{
+}
+
+double latency_budget_t::get_total() const
+{
+  return audio + senderjitter + receiverjitter + network + sorter + loopback;
+}
+
+client_stats_t::client_stats_t() : clock_offset(0) {}
+stream_stat_t::stream_stat_t()
+    : port(0), jitter(0), period(0), good(0u), lost(0u), bursts(0u), ge_p(0),
+      ge_r(1)
+{
+  for(auto& c : iat)
+    c = 0u;
+  for(auto& c : burst)
+    c = 0u;
+  for(auto& c : gap)
+    c = 0u;
+}
+
 message_stat_t::message_stat_t()
-    : received(0u), lost(0u), seqerr_in(0u), seqerr_out(0u)
+    : received(0u), lost(0u), seqerr_in(0u), seqerr_out(0u), holdtime(0)
 {
 }
 
@@ -415,6 +644,29 @@ void message_stat_t::operator+=(const message_stat_t& src)
   lost += src.lost;
   seqerr_in += src.seqerr_in;
   seqerr_out += src.seqerr_out;
+  holdtime += src.holdtime;
+  // histograms are accumulated, jitter and period are taken from the
+  // newer statistics:
+  for(size_t k = 0; k < MESSAGE_STAT_STREAMS; ++k) {
+    stream_stat_t& s(streams[k]);
+    if(s.port != src.streams[k].port) {
+      s = src.streams[k];
+      continue;
+    }
+    s.jitter = src.streams[k].jitter;
+    s.period = src.streams[k].period;
+    s.ge_p = src.streams[k].ge_p;
+    s.ge_r = src.streams[k].ge_r;
+    for(size_t b = 0; b < IAT_BINS; ++b)
+      s.iat[b] += src.streams[k].iat[b];
+    s.good += src.streams[k].good;
+    s.lost += src.streams[k].lost;
+    s.bursts += src.streams[k].bursts;
+    for(size_t b = 0; b < LOSS_BINS; ++b)
+      s.burst[b] += src.streams[k].burst[b];
+    for(size_t b = 0; b < GAP_BINS; ++b)
+      s.gap[b] += src.streams[k].gap[b];
+  }
 }
 
 void message_stat_t::operator-=(const message_stat_t& src)
@@ -423,6 +675,45 @@ void message_stat_t::operator-=(const message_stat_t& src)
   lost -= src.lost;
   seqerr_in -= src.seqerr_in;
   seqerr_out -= src.seqerr_out;
+  holdtime -= src.holdtime;
+  // jitter, period and loss model are current estimates, only the
+  // counters and histograms are subtracted:
+  for(size_t k = 0; k < MESSAGE_STAT_STREAMS; ++k) {
+    stream_stat_t& s(streams[k]);
+    if(s.port != src.streams[k].port)
+      continue;
+    for(size_t b = 0; b < IAT_BINS; ++b)
+      s.iat[b] -= src.streams[k].iat[b];
+    s.good -= src.streams[k].good;
+    s.lost -= src.streams[k].lost;
+    s.bursts -= src.streams[k].bursts;
+    for(size_t b = 0; b < LOSS_BINS; ++b)
+      s.burst[b] -= src.streams[k].burst[b];
+    for(size_t b = 0; b < GAP_BINS; ++b)
+      s.gap[b] -= src.streams[k].gap[b];
+  }
+}
+
+double message_stat_t::get_jitter() const
+{
+  double j(0);
+  for(const auto& s : streams)
+    if(s.port)
+      j = std::max(j, s.jitter);
+  return j;
+}
+
+double message_stat_t::get_loss_rate() const
+{
+  size_t good(0);
+  size_t lost(0);
+  for(const auto& s : streams) {
+    good += s.good;
+    lost += s.lost;
+  }
+  if(good + lost == 0)
+    return 0;
+  return (double)lost / (double)(good + lost);
 }
 
 /*
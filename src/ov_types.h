@@ -24,6 +24,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -237,15 +238,180 @@ struct stage_t {
 bool operator!=(const std::map<stage_device_id_t, stage_device_t>& a,
                 const std::map<stage_device_id_t, stage_device_t>& b);
 
+/**
+ * Kind of a difference between two versions of a stage. The values
+ * are bit flags, see stage_diff_t.
+ */
+enum stage_change_t {
+  /// gain of a stage device, or self monitor gain:
+  STAGE_CHANGE_GAIN = 0x01,
+  /// gain of a channel:
+  STAGE_CHANGE_CHANNELGAIN = 0x02,
+  /// position or orientation of a stage device:
+  STAGE_CHANGE_POSITION = 0x04,
+  /// position of a channel relative to the stage device:
+  STAGE_CHANGE_CHANNELPOSITION = 0x08,
+  /// absorption, damping or reverb gain:
+  STAGE_CHANGE_ROOM = 0x10,
+  /// peer-to-peer mode or extra receiver ports:
+  STAGE_CHANGE_NETWORK = 0x20,
+  /// device was added to the stage:
+  STAGE_CHANGE_ADDED = 0x40,
+  /// device was removed from the stage:
+  STAGE_CHANGE_REMOVED = 0x80,
+  /// any other change which affects rendering, e.g., receiver type,
+  /// device label, number of channels or jitter buffer sizes:
+  STAGE_CHANGE_STRUCTURE = 0x100
+};
+
+/**
+ * Classify the differences between two versions of a stage device.
+ * Changes of the mute flag are ignored, since it is not used for
+ * rendering.
+ * @return Bit mask of stage_change_t values
+ */
+uint32_t get_stage_device_changes(const stage_device_t& a,
+                                  const stage_device_t& b);
+
+/**
+ * Classify the differences between two versions of render settings.
+ * @return Bit mask of stage_change_t values; a change of the self
+ * monitor gain is reported as STAGE_CHANGE_GAIN
+ */
+uint32_t get_render_settings_changes(const render_settings_t& a,
+                                     const render_settings_t& b);
+
+/**
+ * Differences between two versions of a stage, classified per
+ * device. Renderers use it to decide which changes can be applied to
+ * a running session, and which require a restart.
+ */
+class stage_diff_t {
+public:
+  stage_diff_t();
+  /**
+   * Compare two versions of the stage device list.
+   * @param prev Previous stage
+   * @param next New stage
+   */
+  stage_diff_t(const std::map<stage_device_id_t, stage_device_t>& prev,
+               const std::map<stage_device_id_t, stage_device_t>& next);
+  /**
+   * Add the differences of render settings.
+   * @param prev Previous render settings
+   * @param next New render settings
+   * @param thisstagedeviceid Device to which a change of the self
+   * monitor gain is assigned
+   */
+  void add_render_settings(const render_settings_t& prev,
+                           const render_settings_t& next,
+                           stage_device_id_t thisstagedeviceid);
+  /// true if there are no differences:
+  bool empty() const { return changes == 0; };
+  /// true if all differences are of the kinds in mask:
+  bool only(uint32_t mask) const { return (changes & ~mask) == 0; };
+  /// bit mask of all differences, see stage_change_t:
+  uint32_t changes;
+  /// differences of each changed device:
+  std::map<stage_device_id_t, uint32_t> devices;
+};
+
+/**
+ * Incremental 64 bit FNV-1a hash, e.g., to detect changes of a
+ * configuration.
+ */
+class hash_t {
+public:
+  hash_t() : h(0xcbf29ce484222325ull){};
+  void add_bytes(const void* data, size_t len);
+  /// add a number or flag:
+  template <class T> void add(const T& v)
+  {
+    static_assert(std::is_arithmetic<T>::value, "numbers only");
+    add_bytes(&v, sizeof(v));
+  };
+  void add(const std::string& s);
+  void add(const pos_t& p);
+  void add(const zyx_euler_t& r);
+  uint64_t get() const { return h; };
+
+private:
+  uint64_t h;
+};
+
+/**
+ * Hash of all settings of a stage, including the fields which are
+ * ignored by operator!=, like the channel IDs.
+ */
+uint64_t get_stage_hash(const stage_t& stage);
+
+/// number of streams per sender with timing statistics:
+#define MESSAGE_STAT_STREAMS 4
+/// number of bins of packet inter-arrival histogram:
+#define IAT_BINS 40
+/// bin width of packet inter-arrival histogram in milliseconds:
+#define IAT_BINWIDTH 0.5
+/// number of bins of loss burst length histogram:
+#define LOSS_BINS 16
+/// number of bins of loss gap histogram:
+#define GAP_BINS 16
+
+/**
+ * Arrival timing of the messages of one sender to one destination
+ * port.
+ */
+class stream_stat_t {
+public:
+  stream_stat_t();
+  /// destination port, or 0 if unused:
+  port_t port;
+  /// interarrival jitter (RFC 3550) in ms:
+  double jitter;
+  /// estimated packet period of sender in ms:
+  double period;
+  /// inter-arrival histogram of consecutive packets, the last bin
+  /// collects all larger intervals:
+  size_t iat[IAT_BINS];
+  /// number of packets received in sequence:
+  size_t good;
+  /// number of lost packets:
+  size_t lost;
+  /// number of loss bursts:
+  size_t bursts;
+  /// histogram of loss burst lengths, bin k counts bursts of k+1
+  /// packets, the last bin collects all longer bursts:
+  size_t burst[LOSS_BINS];
+  /// histogram of number of packets received between two loss
+  /// bursts, bin k counts gaps of 2^k to 2^(k+1)-1 packets:
+  size_t gap[GAP_BINS];
+  /// Gilbert-Elliott model, probability of a transition from good to
+  /// bad (loss) state:
+  double ge_p;
+  /// Gilbert-Elliott model, probability of a transition from bad to
+  /// good state:
+  double ge_r;
+};
+
 class message_stat_t {
 public:
   message_stat_t();
   void operator+=(const message_stat_t&);
   void operator-=(const message_stat_t&);
+  /**
+   * Return largest jitter of all streams in ms.
+   */
+  double get_jitter() const;
+  /**
+   * Return lost packets of all streams divided by all packets.
+   */
+  double get_loss_rate() const;
   size_t received;
   size_t lost;
   size_t seqerr_in;
   size_t seqerr_out;
+  /// total time in ms for which messages were held back for reordering:
+  double holdtime;
+  stream_stat_t streams[MESSAGE_STAT_STREAMS];
 };
 
 class ping_stat_t {
@@ -257,17 +423,106 @@ public:
   double t_mean;
   size_t received;
   size_t lost;
+  /// statistics of a short time window:
+  class window_t {
+  public:
+    window_t();
+    double t_med;
+    double t_p99;
+    size_t n;
+  };
+  /// statistics of the last second:
+  window_t win_1s;
+  /// statistics of the last ten seconds:
+  window_t win_10s;
+  /// median one-way delay to peer in ms, or -1 if unknown:
+  double t_up;
+  /// median one-way delay from peer in ms, or -1 if unknown:
+  double t_down;
   size_t state_sent;
   size_t state_received;
 };
 
+/**
+ * Congestion state of a network path, derived from the delay gradient.
+ */
+enum congestion_t {
+  /// queues are draining
+  CONGESTION_UNDERUSE = -1,
+  /// no trend
+  CONGESTION_NORMAL = 0,
+  /// queues are growing
+  CONGESTION_OVERUSE = 1
+};
+
+/**
+ * Per-peer bandwidth and congestion estimate.
+ */
+class bandwidth_stat_t {
+public:
+  bandwidth_stat_t();
+  /// receive rate from peer in kbit/s:
+  double rx_kbps;
+  /// receive rate from peer in packets per second:
+  double rx_pps;
+  /// estimated send rate of peer in kbit/s, including lost packets:
+  double rx_sent_kbps;
+  /// rate of direct transmission to peer in kbit/s:
+  double tx_kbps;
+  /// gradient of one-way delay to peer in ms/s:
+  double gradient_up;
+  /// gradient of one-way delay from peer in ms/s:
+  double gradient_down;
+  /// gradient of round trip time in ms/s:
+  double gradient_rtt;
+  congestion_t congestion_up;
+  congestion_t congestion_down;
+  size_t state_rx_bytes;
+  size_t state_rx_packets;
+  size_t state_tx_bytes;
+  double state_t;
+};
+
+/**
+ * Estimated mouth-to-ear latency of the audio from a peer, split into
+ * its components. All times are in ms.
+ */
+class latency_budget_t {
+public:
+  latency_budget_t();
+  /**
+   * Return the sum of all components.
+   */
+  double get_total() const;
+  /// buffers of capture device of peer and playback device, assuming
+  /// that the peer uses the same audio settings:
+  double audio;
+  /// jitter buffer configured by the sender:
+  double senderjitter;
+  /// jitter buffer configured by the receiver:
+  double receiverjitter;
+  /// one-way delay of the network path from the peer:
+  double network;
+  /// mean time messages were held back by the message sorter:
+  double sorter;
+  /// number of UDP hops between network client and audio bridges:
+  uint32_t loopbackhops;
+  /// delay of all loopback hops:
+  double loopback;
+};
+
 class client_stats_t {
 public:
+  client_stats_t();
   ping_stat_t ping_p2p;
   ping_stat_t ping_srv;
   ping_stat_t ping_loc;
+  /// estimated offset of peer clock in ms, or 0 if unknown:
+  double clock_offset;
+  bandwidth_stat_t bandwidth;
   message_stat_t packages;
   message_stat_t state_packages;
+  latency_budget_t latency;
 };
 
 class ov_render_base_t {
@@ -38,6 +38,8 @@
 #endif
 
 #include "errmsg.h"
+#include "metricsserver.h"
+#include "tracereplay.h"
 #include <cmath>
 #include <errno.h>
 
@@ -63,6 +65,18 @@
  * locally as unencoded messages, and forwarded as unencoded messages
  * to the proxy clients if the message arrived from outside the local
  * network, see ovboxclient_t::process_msg().
+ *
+ * Optionally, the proxy device can send these messages once to a
+ * multicast group of the session instead of sending a copy to each
+ * proxy client (ovboxclient_t::set_proxy_multicast()). The proxy
+ * clients then join that group (ovboxclient_t::join_proxy_multicast())
+ * and forward the received messages locally.
+ *
+ * Proxies can be combined to a relay tree: A device with relay
+ * clients (ovboxclient_t::add_relay_client()) forwards all packed
+ * messages to its relay clients, which may be in other networks and
+ * may have relay clients themselves. Messages which arrive on more
+ * than one path are dropped by ovboxclient_t::duplicates.
  */
 
 ovboxclient_t::ovboxclient_t(const std::string& desthost, port_t destport,
@@ -72,22 +86,37 @@ ovboxclient_t::ovboxclient_t(const std::string& desthost, port_t destport,
                              bool receivedownmix_, bool sendlocal_,
                              double deadline, bool senddownmix, bool usingproxy)
     : prio(prio), secret(secret), remote_server(secret, callerid),
-      toport(destport), recport(recport), portoffset(portoffset),
-      callerid(callerid), runsession(true), mode(0), cb_ping(nullptr),
-      cb_ping_data(nullptr), sendlocal(sendlocal_), last_tx(0), last_rx(0),
-      t_bitrate(std::chrono::high_resolution_clock::now()), cb_seqerr(nullptr),
-      cb_seqerr_data(nullptr), msgbuffers(new msgbuf_t[MAX_STAGE_ID])
+      proxy_mcast(false), toport(destport), recport(recport),
+      portoffset(portoffset), callerid(callerid), cb_ping(nullptr),
+      cb_ping_data(nullptr), sendlocal(sendlocal_), cb_seqerr(nullptr),
+      cb_seqerr_data(nullptr), msgbuffers(new msgbuf_t[MAX_STAGE_ID]),
+      adaptive_ping(false), multi_server_ping(false), path_selection(false),
+      upload_budget(0), server_relay(false), streamrate(0), streambytes(0),
+      last_streambytes(0)
 {
+  epmode_t cmode(0);
   if(peer2peer_)
-    mode |= B_PEER2PEER;
+    cmode |= B_PEER2PEER;
   if(receivedownmix_)
-    mode |= B_RECEIVEDOWNMIX;
+    cmode |= B_RECEIVEDOWNMIX;
   if(donotsend_)
-    mode |= B_DONOTSEND;
+    cmode |= B_DONOTSEND;
   if(senddownmix)
-    mode |= B_SENDDOWNMIX;
+    cmode |= B_SENDDOWNMIX;
   if(usingproxy)
-    mode |= B_USINGPROXY;
+    cmode |= B_USINGPROXY;
+  mode = cmode;
+  for(stage_device_id_t cid = 0; cid < MAX_STAGE_ID; ++cid) {
+    fanout_relayed[cid] = false;
+    mcast_ack[cid] = 0;
+  }
+  // traffic is counted per thread, see traffic_counter_t:
+  local_server.set_byte_counting(false);
+  remote_server.set_byte_counting(false);
+  traffic.get_snapshot(bitrate_state);
+  // threads wait on these sockets, and return immediately on stop:
+  local_server.set_stop_signal(&stopsig);
+  remote_server.set_stop_signal(&stopsig);
   local_server.set_timeout_usec(10000);
   local_server.set_destination("localhost");
   local_server.bind(recport, true);
@@ -95,21 +124,25 @@ ovboxclient_t::ovboxclient_t(const std::string& desthost, port_t destport,
   if(deadline > 0)
     remote_server.set_timeout_usec(1000 * deadline);
   remote_server.bind(0, false);
+  memset(&proxy_mcast_ep, 0, sizeof(proxy_mcast_ep));
   localep = getipaddr();
   localep.sin_port = remote_server.getsockep().sin_port;
   sendthread = std::thread(&ovboxclient_t::sendsrv, this);
   recthread = std::thread(&ovboxclient_t::recsrv, this);
   pingthread = std::thread(&ovboxclient_t::pingservice, this);
+  cbthread = std::thread(&ovboxclient_t::cbservice, this);
 }
 
 ovboxclient_t::~ovboxclient_t()
 {
-  runsession = false;
+  stopsig.stop();
   sendthread.join();
   recthread.join();
   pingthread.join();
-  for(auto th = xrecthread.begin(); th != xrecthread.end(); ++th)
-    th->join();
+  cbthread.join();
+  set_receiverports({});
+  if(mcrecthread.joinable())
+    mcrecthread.join();
   delete[] msgbuffers;
 }
 
@@ -126,19 +159,30 @@ void ovboxclient_t::set_reorder_deadline(double t_ms)
   }
 }
 
+void ovboxclient_t::replay(trace_replay_t& replay, bool realtime,
+                           double deadline)
+{
+  packet_trace_t::writer_t tracew(trace);
+  traffic_counter_t::writer_t trafficw(traffic);
+  message_sorter_t replay_sorter;
+  // the receive thread uses the member filter concurrently:
+  duplicate_filter_t replay_duplicates;
+  replay.run(
+      replay_sorter,
+      [this, &replay_duplicates, &tracew, &trafficw](msgbuf_t& msg) {
+        process_msg(msg, replay_duplicates, tracew, trafficw);
+      },
+      realtime, deadline);
+}
+
 void ovboxclient_t::getbitrate(double& txrate, double& rxrate)
 {
-  std::chrono::high_resolution_clock::time_point t2(
-      std::chrono::high_resolution_clock::now());
-  std::chrono::duration<double> time_span(
-      std::chrono::duration_cast<std::chrono::duration<double>>(t2 -
-                                                                t_bitrate));
-  double sc(8.0 / std::max(1e-6, time_span.count()));
-  txrate = sc * (remote_server.tx_bytes - last_tx);
-  rxrate = sc * (remote_server.rx_bytes - last_rx);
-  t_bitrate = t2;
-  last_tx = remote_server.tx_bytes;
-  last_rx = remote_server.rx_bytes;
+  traffic_snapshot_t s;
+  traffic.get_snapshot(s);
+  traffic_rate_t rate(s.get_rate(bitrate_state));
+  txrate = 1000.0 * rate.tx_kbps;
+  rxrate = 1000.0 * rate.rx_kbps;
+  bitrate_state = s;
 }
 
 void ovboxclient_t::set_ping_callback(
@@ -161,19 +205,100 @@ void ovboxclient_t::set_seqerr_callback(
 
 void ovboxclient_t::add_receiverport(port_t srcxport, port_t destxport)
 {
-  xrecthread.emplace_back(
-      std::thread(&ovboxclient_t::xrecsrv, this, srcxport, destxport));
+  std::lock_guard<std::mutex> lk(xrecthreadlock);
+  if(xrecthreads.find(srcxport) != xrecthreads.end())
+    return;
+  xrecthread_t* xrec(new xrecthread_t());
+  xrec->destport = destxport;
+  xrec->thread = std::thread(&ovboxclient_t::xrecsrv, this, srcxport,
+                             destxport, &xrec->stop);
+  xrecthreads[srcxport] = xrec;
+}
+
+void ovboxclient_t::set_receiverports(
+    const std::vector<std::pair<port_t, port_t>>& ports)
+{
+  std::vector<xrecthread_t*> stopped;
+  {
+    std::lock_guard<std::mutex> lk(xrecthreadlock);
+    auto xrec(xrecthreads.begin());
+    while(xrec != xrecthreads.end()) {
+      bool keep(false);
+      for(auto p : ports)
+        if((p.first == xrec->first) && (p.second == xrec->second->destport))
+          keep = true;
+      if(keep) {
+        ++xrec;
+      } else {
+        xrec->second->stop.stop();
+        stopped.push_back(xrec->second);
+        xrec = xrecthreads.erase(xrec);
+      }
+    }
+  }
+  // stop all threads first, then join:
+  for(auto xrec : stopped) {
+    xrec->thread.join();
+    delete xrec;
+  }
+  for(auto p : ports)
+    add_receiverport(p.first, p.second);
 }
 
 void ovboxclient_t::add_extraport(port_t dest)
 {
-  xdest.push_back(dest);
+  std::vector<port_t> dests(xdest.copy());
+  dests.push_back(dest);
+  xdest.set(dests);
 }
 
-void ovboxclient_t::add_proxy_client(stage_device_id_t cid,
-                                     const std::string& host)
+void ovboxclient_t::set_extraports(const std::vector<port_t>& dest)
+{
+  xdest.set(dest);
+}
+
+void ovboxclient_t::set_local_sink(
+    port_t port, std::function<void(const char*, size_t)> sink)
+{
+  std::map<port_t, std::function<void(const char*, size_t)>> sinks(
+      localsinks.copy());
+  if(sink)
+    sinks[port] = sink;
+  else
+    sinks.erase(port);
+  localsinks.set(sinks);
+}
+
+void ovboxclient_t::send_local(udpsocket_t& sock, const char* msg, size_t len,
+                               port_t port)
+{
+  decltype(localsinks)::reader_t sinks(localsinks);
+  if(!sinks->empty()) {
+    auto sink(sinks->find(port));
+    if(sink != sinks->end()) {
+      sink->second(msg, len);
+      return;
+    }
+  }
+  sock.send(msg, len, port);
+}
+
+void ovboxclient_t::set_mode(epmode_t newmode)
+{
+  if(newmode != mode)
+    log(recport, "changing mode from " + std::to_string(mode) + " to " +
+                     std::to_string(newmode));
+  mode = newmode;
+}
+
+void ovboxclient_t::set_sendlocal(bool sendlocal_)
+{
+  sendlocal = sendlocal_;
+}
+
+// resolve host name or IP address:
+static endpoint_t host2ep(const std::string& host)
 {
-  // resolve host:
   struct hostent* server;
   server = gethostbyname(host.c_str());
   if(server == NULL)
@@ -193,7 +318,101 @@ void ovboxclient_t::add_proxy_client(stage_device_id_t cid,
   serv_addr.sin_family = AF_INET;
   memcpy((char*)&serv_addr.sin_addr.s_addr, (char*)server->h_addr,
          server->h_length);
-  proxyclients[cid] = serv_addr;
+  return serv_addr;
+}
+
+void ovboxclient_t::add_proxy_client(stage_device_id_t cid,
+                                     const std::string& host)
+{
+  std::map<stage_device_id_t, endpoint_t> clients(proxyclients.copy());
+  clients[cid] = host2ep(host);
+  proxyclients.set(clients);
+}
+
+void ovboxclient_t::set_proxy_clients(
+    const std::map<stage_device_id_t, std::string>& hosts)
+{
+  std::map<stage_device_id_t, endpoint_t> clients;
+  for(auto host : hosts)
+    clients[host.first] = host2ep(host.second);
+  proxyclients.set(clients);
+}
+
+void ovboxclient_t::add_relay_client(stage_device_id_t cid)
+{
+  if((cid < MAX_STAGE_ID) && (cid != callerid) && (!is_relay_client(cid))) {
+    std::vector<stage_device_id_t> clients(relayclients.copy());
+    clients.push_back(cid);
+    relayclients.set(clients);
+  }
+}
+
+void ovboxclient_t::set_relay_clients(
+    const std::vector<stage_device_id_t>& cids)
+{
+  std::vector<stage_device_id_t> clients;
+  for(auto cid : cids)
+    if((cid < MAX_STAGE_ID) && (cid != callerid))
+      clients.push_back(cid);
+  relayclients.set(clients);
+}
+
+bool ovboxclient_t::is_relay_client(stage_device_id_t cid) const
+{
+  decltype(relayclients)::reader_t clients(relayclients);
+  for(auto client : *clients)
+    if(client == cid)
+      return true;
+  return false;
+}
+
+void ovboxclient_t::send_to_relay_clients(const char* msg, size_t len,
+                                          stage_device_id_t origin,
+                                          const endpoint_t& sender,
+                                          packet_trace_t::writer_t& tracew,
+                                          traffic_counter_t::writer_t& trafficw)
+{
+  decltype(relayclients)::reader_t clients(relayclients);
+  for(auto client : *clients) {
+    const ep_desc_t& ep(endpoints[client]);
+    // serve only active relay clients which use a proxy:
+    if((client != origin) && ep.timeout && (ep.mode & B_USINGPROXY)) {
+      bool target_in_same_network(
+          (endpoints[callerid].ep.sin_addr.s_addr == ep.ep.sin_addr.s_addr) &&
+          (ep.localep.sin_addr.s_addr != 0));
+      const endpoint_t& dest(
+          (sendlocal && target_in_same_network) ? ep.localep : ep.ep);
+      // do not send back to where the message came from:
+      if((dest.sin_addr.s_addr != sender.sin_addr.s_addr) ||
+         (dest.sin_port != sender.sin_port))
+        send_packed(msg, len, dest, client, tracew, trafficw);
+    }
+  }
+}
+
+void ovboxclient_t::set_proxy_multicast(const std::string& group, port_t port)
+{
+  endpoint_t ep(host2ep(group));
+  ep.sin_port = htons(port);
+  // send to local network only, and do not receive our own messages:
+  if(!remote_server.set_multicast_options(1, false)) {
+    log(recport, "unable to send to multicast group " + ep2str(ep) +
+                     ", using unicast for proxy clients");
+    return;
+  }
+  proxy_mcast_ep = ep;
+  proxy_mcast = true;
+  log(recport, "serving proxy clients via multicast group " + ep2str(ep));
+}
+
+void ovboxclient_t::join_proxy_multicast(const std::string& group,
+                                         port_t port)
+{
+  if(mcrecthread.joinable())
+    return;
+  endpoint_t ep(host2ep(group));
+  ep.sin_port = htons(port);
+  mcrecthread = std::thread(&ovboxclient_t::mcrecsrv, this, ep);
 }
 
 void ovboxclient_t::announce_new_connection(stage_device_id_t cid,
@@ -218,7 +437,7 @@ void ovboxclient_t::announce_connection_lost(stage_device_id_t cid)
 void ovboxclient_t::announce_latency(stage_device_id_t cid, double, double,
                                      double, uint32_t, uint32_t)
 {
-  if(cid == callerid)
+  if((cid == callerid) || (cid >= MAX_STAGE_ID))
     return;
   update_client_stats(cid, client_stats_announce[cid]);
   log(recport, "packages " + std::to_string(cid) + " " +
@@ -246,12 +465,43 @@ void ovboxclient_t::announce_latency(stage_device_id_t cid, double, double,
 void ovboxclient_t::update_client_stats(stage_device_id_t cid,
                                         client_stats_t& stats)
 {
+  if(cid >= MAX_STAGE_ID)
+    return;
   stats.packages = sorter.get_stat(cid);
   message_stat_t ostat(stats.state_packages);
   stats.state_packages = stats.packages;
   stats.packages -= ostat;
   if(stats.packages.lost > (1 << 30))
     stats.packages.lost = 0;
+  if(clock_offsets[cid].is_valid())
+    stats.clock_offset = 1e-6 * (double)clock_offsets[cid].get_offset();
+  // bandwidth since last update:
+  bandwidth_stat_t& bw(stats.bandwidth);
+  double t(1e-9 * get_timestamp_ns());
+  traffic_stat_t tr(traffic.get_peer(cid));
+  size_t rxb(tr.rx_bytes);
+  size_t rxp(tr.rx_packets);
+  size_t txb(tr.tx_bytes);
+  if(bw.state_t > 0) {
+    double dt(std::max(1e-3, t - bw.state_t));
+    bw.rx_kbps = 0.008 * (rxb - bw.state_rx_bytes) / dt;
+    bw.rx_pps = (rxp - bw.state_rx_packets) / dt;
+    bw.tx_kbps = 0.008 * (txb - bw.state_tx_bytes) / dt;
+    // the peer has sent also the lost packages:
+    bw.rx_sent_kbps = bw.rx_kbps;
+    if(stats.packages.received > 0)
+      bw.rx_sent_kbps *= (double)(stats.packages.received +
+                                  stats.packages.lost) /
+                         (double)stats.packages.received;
+  }
+  bw.state_t = t;
+  bw.state_rx_bytes = rxb;
+  bw.state_rx_packets = rxp;
+  bw.state_tx_bytes = txb;
+  bw.gradient_up = gradient_up[cid].get_gradient();
+  bw.gradient_down = gradient_down[cid].get_gradient();
+  bw.gradient_rtt = gradient_rtt[cid].get_gradient();
+  get_congestion(cid, bw.congestion_up, bw.congestion_down);
   ping_stat_collecors_p2p[cid].update_ping_stat(stats.ping_p2p);
   ping_stat_collecors_srv[cid].update_ping_stat(stats.ping_srv);
   ping_stat_collecors_local[cid].update_ping_stat(stats.ping_loc);
@@ -267,28 +517,401 @@ void ovboxclient_t::handle_endpoint_list_update(stage_device_id_t cid,
 // ping service
 void ovboxclient_t::pingservice()
 {
-  while(runsession) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(PINGPERIODMS));
+  uint32_t pathselcnt(PATHSELPERIOD);
+  traffic_counter_t::writer_t trafficw(traffic);
+  while(!stopsig.wait_for(1000 * PINGPERIODMS)) {
     // send registration to server:
-    remote_server.send_registration(mode, toport, localep);
+    trafficw.add_tx(
+        TRAFFIC_SERVER, PORT_REGISTER,
+        remote_server.send_registration(mode | B_EXTCONTROL, toport, localep),
+        2);
     // send ping to other peers:
+    bool adaptive(adaptive_ping);
+    // older servers do not know PORT_PING_SRV_MULTI:
+    bool multi(multi_server_ping &&
+               (endpoints[callerid].mode & B_SRVMULTIPING));
+    stage_device_id_t srvdest[MAX_STAGE_ID];
+    size_t nsrvdest(0);
     size_t ocid(0);
     for(auto ep : endpoints) {
       if(ep.timeout && (ocid != callerid)) {
-        remote_server.send_ping(ep.ep, ocid);
-        ++ping_stat_collecors_p2p[ocid].sent;
-        remote_server.send_ping(remote_server.get_destination(), ocid,
-                                PORT_PING_SRV);
-        ++ping_stat_collecors_srv[ocid].sent;
+        if(ping_rates_p2p[ocid].tick() || !adaptive) {
+          trafficw.add_tx(ocid, PORT_PING,
+                          remote_server.send_ping(ep.ep, ocid));
+          ++ping_stat_collecors_p2p[ocid].sent;
+          path_selectors[ocid].add_sent(PATH_P2P);
+        }
+        if(ping_rates_srv[ocid].tick() || !adaptive) {
+          if(multi)
+            srvdest[nsrvdest++] = ocid;
+          else
+            trafficw.add_tx(TRAFFIC_SERVER, PORT_PING_SRV,
+                            remote_server.send_ping(
+                                remote_server.get_destination(), ocid,
+                                PORT_PING_SRV));
+          ++ping_stat_collecors_srv[ocid].sent;
+        }
         // test if peer is in same network:
         if((endpoints[callerid].ep.sin_addr.s_addr == ep.ep.sin_addr.s_addr) &&
            (ep.localep.sin_addr.s_addr != 0)) {
-          remote_server.send_ping(ep.localep, ocid, PORT_PING_LOCAL);
-          ++ping_stat_collecors_local[ocid].sent;
+          if(ping_rates_local[ocid].tick() || !adaptive) {
+            trafficw.add_tx(
+                ocid, PORT_PING_LOCAL,
+                remote_server.send_ping(ep.localep, ocid, PORT_PING_LOCAL));
+            ++ping_stat_collecors_local[ocid].sent;
+            path_selectors[ocid].add_sent(PATH_LOCAL);
+          }
         }
+        if(path_selection && (pathselcnt == 0))
+          update_path(ocid, ep, trafficw);
       }
       ++ocid;
     }
+    if(pathselcnt == 0) {
+      update_fanout(0.001 * PINGPERIODMS * PATHSELPERIOD);
+      pathselcnt = PATHSELPERIOD;
+    }
+    --pathselcnt;
+    if(nsrvdest)
+      trafficw.add_tx(TRAFFIC_SERVER, PORT_PING_SRV_MULTI,
+                      remote_server.send_multi_ping(
+                          remote_server.get_destination(), srvdest, nsrvdest));
+  }
+}
+
+// select the path to a peer, and announce it to the peer:
+void ovboxclient_t::update_path(stage_device_id_t cid, const ep_desc_t& ep,
+                                traffic_counter_t::writer_t& trafficw)
+{
+  // the device with the lower ID decides, the other one follows:
+  if(callerid > cid)
+    return;
+  // older devices would treat PORT_PATHSEL as audio data:
+  if(!(ep.mode & B_EXTCONTROL))
+    return;
+  path_selector_t& sel(path_selectors[cid]);
+  bool changed(sel.update());
+  path_t path;
+  if(!sel.get_path(path))
+    return;
+  if(changed) {
+    const char* pathname[3] = {"p2p", "local", "server"};
+    log(recport, "selected path " + std::string(pathname[path]) + " for " +
+                     std::to_string(cid));
+  }
+  // announce selection to peer, on all direct paths:
+  uint8_t p(path);
+  char buffer[HEADERLEN + sizeof(p)];
+  size_t n(remote_server.packmsg(buffer, HEADERLEN + sizeof(p), PORT_PATHSEL,
+                                 (const char*)(&p), sizeof(p)));
+  if(remote_server.send(buffer, n, ep.ep) > 0)
+    trafficw.add_tx(cid, PORT_PATHSEL, n);
+  if((ep.localep.sin_addr.s_addr != 0) &&
+     (remote_server.send(buffer, n, ep.localep) > 0))
+    trafficw.add_tx(cid, PORT_PATHSEL, n);
+}
+
+void ovboxclient_t::update_fanout(double dt)
+{
+  size_t bytes(streambytes);
+  streamrate = 0.008 * (bytes - last_streambytes) / dt;
+  last_streambytes = bytes;
+  // peers which receive our stream directly:
+  std::vector<std::pair<double, stage_device_id_t>> peers;
+  stage_device_id_t ocid(0);
+  for(auto ep : endpoints) {
+    if(ep.timeout && (ocid != callerid) && (ep.mode & B_PEER2PEER) &&
+       (!(ep.mode & B_DONOTSEND)) && (!is_relay_client(ocid))) {
+      double rtt(ping_rates_p2p[ocid].get_srtt());
+      if(rtt < 0)
+        rtt = HUGE_VAL;
+      peers.push_back(std::make_pair(rtt, ocid));
+    }
+    ++ocid;
+  }
+  bool relayed[MAX_STAGE_ID];
+  for(auto& r : relayed)
+    r = false;
+  // peer-to-peer peers can be served via server only if the server
+  // forwards to them:
+  if((mode & B_PEER2PEER) && server_relay)
+    for(auto cid : get_relayed_peers(peers, streamrate, upload_budget))
+      relayed[cid] = true;
+  for(stage_device_id_t cid = 0; cid < MAX_STAGE_ID; ++cid) {
+    if(relayed[cid] != fanout_relayed[cid])
+      log(recport, "upload budget: sending to " + std::to_string(cid) +
+                       (relayed[cid] ? " via server" : " directly"));
+    fanout_relayed[cid] = relayed[cid];
+  }
+}
+
+delay_gradient_t::delay_gradient_t(size_t N)
+    : size(std::max((size_t)1, std::min(N, maxsize))), idx(0), filled(0),
+      gradient(0)
+{
+}
+
+void delay_gradient_t::add_value(double t, double delay)
+{
+  data[idx] = std::make_pair(t, delay);
+  ++idx;
+  if(idx >= size)
+    idx = 0;
+  if(filled < size)
+    ++filled;
+  if(filled < 3)
+    return;
+  // least squares fit, relative to the first sample in the window:
+  const auto& first(data[(filled < size) ? 0 : idx]);
+  double sum_t(0), sum_d(0), sum_tt(0), sum_td(0);
+  for(size_t k = 0; k < filled; ++k) {
+    double tk(data[k].first - first.first);
+    double dk(data[k].second - first.second);
+    sum_t += tk;
+    sum_d += dk;
+    sum_tt += tk * tk;
+    sum_td += tk * dk;
+  }
+  double den(filled * sum_tt - sum_t * sum_t);
+  if(den > 0)
+    gradient = (filled * sum_td - sum_t * sum_d) / den;
+}
+
+congestion_t delay_gradient_t::get_state() const
+{
+  double g(gradient);
+  if(g > threshold)
+    return CONGESTION_OVERUSE;
+  if(g < -threshold)
+    return CONGESTION_UNDERUSE;
+  return CONGESTION_NORMAL;
+}
+
+std::vector<stage_device_id_t>
+get_relayed_peers(std::vector<std::pair<double, stage_device_id_t>> peers,
+                  double streamrate, double budget)
+{
+  std::vector<stage_device_id_t> relayed;
+  if((budget <= 0) || (streamrate <= 0) ||
+     (peers.size() * streamrate <= budget))
+    return relayed;
+  // one copy is needed for the relay:
+  size_t maxdirect(std::max(0.0, floor(budget / streamrate) - 1.0));
+  std::sort(peers.begin(), peers.end());
+  for(size_t k = maxdirect; k < peers.size(); ++k)
+    relayed.push_back(peers[k].second);
+  return relayed;
+}
+
+bool ovboxclient_t::is_data_path(port_t pongport) const
+{
+  if(mode & B_PEER2PEER)
+    return pongport == PORT_PONG;
+  return pongport == PORT_PONG_SRV;
+}
+
+void ovboxclient_t::get_congestion(stage_device_id_t cid, congestion_t& up,
+                                   congestion_t& down) const
+{
+  up = CONGESTION_NORMAL;
+  down = CONGESTION_NORMAL;
+  if(cid >= MAX_STAGE_ID)
+    return;
+  if(clock_offsets[cid].is_valid()) {
+    up = gradient_up[cid].get_state();
+    down = gradient_down[cid].get_state();
+  } else {
+    // without peer time stamps the direction is unknown:
+    up = down = gradient_rtt[cid].get_state();
+  }
+}
+
+void ovboxclient_t::get_ping_snapshot(stage_device_id_t cid, path_t path,
+                                      ping_snapshot_t& s) const
+{
+  if(cid >= MAX_STAGE_ID)
+    return;
+  double t(1e-9 * get_timestamp_ns());
+  switch(path) {
+  case PATH_P2P:
+    ping_stat_collecors_p2p[cid].get_snapshot(s, t);
+    break;
+  case PATH_LOCAL:
+    ping_stat_collecors_local[cid].get_snapshot(s, t);
+    break;
+  case PATH_SERVER:
+    ping_stat_collecors_srv[cid].get_snapshot(s, t);
+    break;
+  }
+}
+
+std::string ovboxclient_t::get_metrics() const
+{
+  const char* pathname[3] = {"p2p", "local", "server"};
+  // collect snapshots of all peers:
+  std::vector<message_stat_t> ms(MAX_STAGE_ID);
+  std::vector<ping_snapshot_t> ps(3 * MAX_STAGE_ID);
+  std::vector<stage_device_id_t> peers;
+  for(stage_device_id_t cid = 0; cid < MAX_STAGE_ID; ++cid) {
+    ms[cid] = sorter.get_stat(cid);
+    bool active(ms[cid].received > 0);
+    for(uint32_t p = PATH_P2P; p <= PATH_SERVER; ++p) {
+      get_ping_snapshot(cid, (path_t)p, ps[3 * cid + p]);
+      active |= (ps[3 * cid + p].sent > 0);
+    }
+    if(active)
+      peers.push_back(cid);
+  }
+  std::string s;
+  s += metric_header("ov_stream_rate_kbps", "gauge",
+                     "Rate of own audio stream in kbit/s.");
+  s += metric_value("ov_stream_rate_kbps", "", streamrate);
+  s += metric_header("ov_trace_dropped_total", "counter",
+                     "Packet trace records lost due to full buffers.");
+  s += metric_value("ov_trace_dropped_total", "",
+                    trace.get_dropped());
+  // traffic by peer and by destination port:
+  traffic_snapshot_t ts;
+  traffic.get_snapshot(ts);
+  struct {
+    const char* name;
+    const char* help;
+    std::function<double(const traffic_stat_t&)> v;
+  } trafficstat[4] = {
+      {"rx_bytes_total", "Bytes received",
+       [](const traffic_stat_t& m) { return m.rx_bytes; }},
+      {"rx_packets_total", "Packets received",
+       [](const traffic_stat_t& m) { return m.rx_packets; }},
+      {"tx_bytes_total", "Bytes sent",
+       [](const traffic_stat_t& m) { return m.tx_bytes; }},
+      {"tx_packets_total", "Packets sent",
+       [](const traffic_stat_t& m) { return m.tx_packets; }}};
+  for(const auto& m : trafficstat) {
+    std::string name("ov_peer_" + std::string(m.name));
+    s += metric_header(name, "counter", std::string(m.help) + " by peer.");
+    for(size_t k = 0; k < MAX_STAGE_ID; ++k)
+      if(ts.peer[k].rx_packets || ts.peer[k].tx_packets)
+        s += metric_value(name, "cid=\"" + std::to_string(k) + "\"",
+                          m.v(ts.peer[k]));
+    s += metric_value(name, "cid=\"server\"", m.v(ts.peer[TRAFFIC_SERVER]));
+    s += metric_value(name, "cid=\"other\"", m.v(ts.peer[TRAFFIC_OTHER]));
+    name = "ov_port_" + std::string(m.name);
+    s += metric_header(name, "counter",
+                       std::string(m.help) + " by destination port.");
+    for(const auto& p : ts.port)
+      s += metric_value(name, "port=\"" + std::to_string(p.first) + "\"",
+                        m.v(p.second));
+    s += metric_value(name, "port=\"other\"", m.v(ts.other_ports));
+  }
+  // message sorter:
+  struct {
+    const char* name;
+    const char* help;
+    std::function<double(const message_stat_t&)> v;
+  } msgstat[4] = {
+      {"ov_messages_received_total", "Messages received from peer.",
+       [](const message_stat_t& m) { return m.received; }},
+      {"ov_messages_lost_total", "Messages lost, from sequence numbers.",
+       [](const message_stat_t& m) { return m.lost; }},
+      {"ov_messages_seqerr_total", "Messages received out of order.",
+       [](const message_stat_t& m) { return m.seqerr_in; }},
+      {"ov_messages_seqrecovered_total",
+       "Messages out of order which were re-ordered.",
+       [](const message_stat_t& m) { return m.seqerr_in - m.seqerr_out; }}};
+  for(const auto& m : msgstat) {
+    s += metric_header(m.name, "counter", m.help);
+    for(auto cid : peers)
+      s += metric_value(m.name, "cid=\"" + std::to_string(cid) + "\"",
+                        m.v(ms[cid]));
+  }
+  struct {
+    const char* name;
+    const char* help;
+    std::function<double(const stream_stat_t&)> v;
+  } streamstat[4] = {
+      {"ov_stream_jitter_ms", "Interarrival jitter (RFC 3550) in ms.",
+       [](const stream_stat_t& m) { return m.jitter; }},
+      {"ov_stream_period_ms", "Mean packet period in ms.",
+       [](const stream_stat_t& m) { return m.period; }},
+      {"ov_stream_loss_p", "Gilbert-Elliott transition probability to loss.",
+       [](const stream_stat_t& m) { return m.ge_p; }},
+      {"ov_stream_loss_r",
+       "Gilbert-Elliott transition probability from loss.",
+       [](const stream_stat_t& m) { return m.ge_r; }}};
+  for(const auto& m : streamstat) {
+    s += metric_header(m.name, "gauge", m.help);
+    for(auto cid : peers)
+      for(const auto& st : ms[cid].streams)
+        if(st.port)
+          s += metric_value(m.name,
+                            "cid=\"" + std::to_string(cid) + "\",port=\"" +
+                                std::to_string(st.port) + "\"",
+                            m.v(st));
+  }
+  // ping statistics:
+  s += metric_header("ov_ping_sent_total", "counter", "Pings sent to peer.");
+  for(auto cid : peers)
+    for(uint32_t p = PATH_P2P; p <= PATH_SERVER; ++p)
+      s += metric_value("ov_ping_sent_total",
+                        "cid=\"" + std::to_string(cid) + "\",path=\"" +
+                            pathname[p] + "\"",
+                        ps[3 * cid + p].sent);
+  s += metric_header("ov_ping_received_total", "counter",
+                     "Pongs received from peer.");
+  for(auto cid : peers)
+    for(uint32_t p = PATH_P2P; p <= PATH_SERVER; ++p)
+      s += metric_value("ov_ping_received_total",
+                        "cid=\"" + std::to_string(cid) + "\",path=\"" +
+                            pathname[p] + "\"",
+                        ps[3 * cid + p].received);
+  s += metric_header("ov_ping_rtt_ms", "gauge",
+                     "Round trip time quantiles in ms.");
+  for(auto cid : peers)
+    for(uint32_t p = PATH_P2P; p <= PATH_SERVER; ++p) {
+      const ping_snapshot_t& snap(ps[3 * cid + p]);
+      const ping_histogram_t* win[2] = {&snap.win_1s, &snap.win_10s};
+      const char* winname[2] = {"1s", "10s"};
+      for(size_t w = 0; w < 2; ++w) {
+        if(!win[w]->get_count())
+          continue;
+        for(const char* q : {"0.5", "0.99"})
+          s += metric_value("ov_ping_rtt_ms",
+                            "cid=\"" + std::to_string(cid) + "\",path=\"" +
+                                pathname[p] + "\",window=\"" + winname[w] +
+                                "\",quantile=\"" + q + "\"",
+                            win[w]->get_quantile(atof(q)));
+      }
+    }
+  return s;
+}
+
+path_t ovboxclient_t::get_path(stage_device_id_t cid) const
+{
+  path_t path(PATH_P2P);
+  if(cid < MAX_STAGE_ID)
+    path_selectors[cid].get_path(path);
+  return path;
+}
+
+// callback service, calls ping and sequence error callbacks outside
+// of the real-time threads:
+void ovboxclient_t::cbservice()
+{
+  callback_event_t ev;
+  while(!stopsig.wait_for(10000)) {
+    while(cb_events.pop(ev)) {
+      switch(ev.type) {
+      case callback_event_t::PING:
+        if(cb_ping)
+          cb_ping(ev.cid, ev.tms, ev.ep, cb_ping_data);
+        break;
+      case callback_event_t::SEQERR:
+        if(cb_seqerr)
+          cb_seqerr(ev.cid, ev.expected, ev.received, ev.destport,
+                    cb_seqerr_data);
+        break;
+      }
+    }
   }
 }
 
@@ -297,21 +920,49 @@ void ovboxclient_t::sendsrv()
 {
   try {
     set_thread_prio(prio);
+    packet_trace_t::writer_t tracew(trace);
+    traffic_counter_t::writer_t trafficw(traffic);
     msgbuf_t msg;
-    while(runsession) {
-      remote_server.recv_sec_msg(msg);
+    callback_event_t ev;
+    ev.type = callback_event_t::SEQERR;
+    while(!stopsig.is_stopped()) {
+      bool received(remote_server.recv_sec_msg(msg));
+      if(received)
+        trafficw.add_rx((msg.cid == STAGE_ID_SERVER) ? TRAFFIC_SERVER
+                                                     : msg.cid,
+                        msg.destport, msg.size + HEADERLEN);
       msgbuf_t* pmsg(&msg);
-      while(sorter.process(&pmsg))
-        process_msg(*pmsg);
+      bool first(received);
+      while(sorter.process(&pmsg)) {
+        if(first) {
+          tracew.add(TRACE_RX,
+                     (pmsg == &msg) ? TRACE_DELIVERED : TRACE_REORDERED,
+                     msg.cid, msg.destport, msg.seq, msg.size, msg.sender);
+          first = false;
+        }
+        if(pmsg != &msg)
+          tracew.add(TRACE_RX, TRACE_RELEASED, pmsg->cid, pmsg->destport,
+                     pmsg->seq, pmsg->size, pmsg->sender);
+        process_msg(*pmsg, duplicates, tracew, trafficw);
+      }
+      if(first)
+        // the sorter holds the message back:
+        tracew.add(TRACE_RX, TRACE_BUFFERED, msg.cid, msg.destport, msg.seq,
+                   msg.size, msg.sender);
+      if(sorter.get_seqerr(ev.cid, ev.expected, ev.received, ev.destport) &&
+         cb_seqerr)
+        cb_events.push(ev);
     }
   }
   catch(const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
-    runsession = false;
+    stopsig.stop();
   }
 }
 
-void ovboxclient_t::process_ping_msg(msgbuf_t& msg)
+void ovboxclient_t::process_ping_msg(msgbuf_t& msg,
+                                     packet_trace_t::writer_t& tracew,
+                                     traffic_counter_t::writer_t& trafficw)
 {
   stage_device_id_t cid(msg.cid);
   msg_callerid(msg.rawbuffer) = callerid;
@@ -333,7 +984,16 @@ void ovboxclient_t::process_ping_msg(msgbuf_t& msg)
     msg_port(msg.rawbuffer) = PORT_PONG_LOCAL;
     break;
   }
-  remote_server.send(msg.rawbuffer, msg.size + HEADERLEN, msg.sender);
+  // append own time stamp for estimation of clock offset; older
+  // versions ignore it:
+  timestamp_ns_t t2(get_timestamp_ns());
+  size_t len(addmsg(msg.rawbuffer, BUFSIZE, msg.size + HEADERLEN,
+                    (const char*)(&t2), sizeof(t2)));
+  if(!len)
+    len = msg.size + HEADERLEN;
+  send_packed(msg.rawbuffer, len, msg.sender,
+              (msg.destport == PORT_PING_SRV) ? TRAFFIC_SERVER : cid, tracew,
+              trafficw);
 }
 
 void ovboxclient_t::process_pong_msg(msgbuf_t& msg)
@@ -345,28 +1005,72 @@ void ovboxclient_t::process_pong_msg(msgbuf_t& msg)
     tbuf += sizeof(stage_device_id_t);
     tsize -= sizeof(stage_device_id_t);
   }
+  timestamp_ns_t t1(0);
+  if(tsize >= sizeof(t1))
+    memcpy(&t1, tbuf, sizeof(t1));
   double tms(get_pingtime(tbuf, tsize));
   // DEBUG(tms);
   if(tms > 0) {
-    if(cb_ping)
-      cb_ping(msg.cid, tms, msg.sender, cb_ping_data);
+    if(msg.cid >= MAX_STAGE_ID)
+      return;
+    // newer peers append their time stamp to the sender address:
+    if(tsize == sizeof(endpoint_t) + sizeof(timestamp_ns_t)) {
+      timestamp_ns_t t4(t1 + (timestamp_ns_t)(1e6 * tms));
+      timestamp_ns_t t2(0);
+      memcpy(&t2, tbuf + sizeof(endpoint_t), sizeof(t2));
+      clock_offsets[msg.cid].add_sample(t1, t2, t4);
+      double up(0);
+      double down(0);
+      clock_offsets[msg.cid].get_oneway(t1, t2, t4, up, down);
+      if(is_data_path(msg.destport)) {
+        gradient_up[msg.cid].add_value(1e-9 * t4, up);
+        gradient_down[msg.cid].add_value(1e-9 * t4, down);
+      }
+      switch(msg.destport) {
+      case PORT_PONG:
+        ping_stat_collecors_p2p[msg.cid].add_oneway(up, down);
+        break;
+      case PORT_PONG_SRV:
+        ping_stat_collecors_srv[msg.cid].add_oneway(up, down);
+        break;
+      case PORT_PONG_LOCAL:
+        ping_stat_collecors_local[msg.cid].add_oneway(up, down);
+        break;
+      }
+    }
+    if(is_data_path(msg.destport))
+      gradient_rtt[msg.cid].add_value(1e-9 * t1 + 0.001 * tms, tms);
+    if(cb_ping) {
+      // ping callback is called from callback thread:
+      callback_event_t ev;
+      ev.type = callback_event_t::PING;
+      ev.cid = msg.cid;
+      ev.tms = tms;
+      ev.ep = msg.sender;
+      cb_events.push(ev);
+    }
     switch(msg.destport) {
     case PORT_PONG:
       ping_stat_collecors_p2p[msg.cid].add_value(tms);
+      ping_rates_p2p[msg.cid].add_value(tms);
+      path_selectors[msg.cid].add_value(PATH_P2P, tms);
       break;
     case PORT_PONG_SRV:
-      tbuf += sizeof(stage_device_id_t);
-      tsize -= sizeof(stage_device_id_t);
       ping_stat_collecors_srv[msg.cid].add_value(tms);
+      ping_rates_srv[msg.cid].add_value(tms);
       break;
     case PORT_PONG_LOCAL:
       ping_stat_collecors_local[msg.cid].add_value(tms);
+      ping_rates_local[msg.cid].add_value(tms);
+      path_selectors[msg.cid].add_value(PATH_LOCAL, tms);
       break;
     }
   }
 }
 
-void ovboxclient_t::process_msg(msgbuf_t& msg)
+void ovboxclient_t::process_msg(msgbuf_t& msg, duplicate_filter_t& dupl,
+                                packet_trace_t::writer_t& tracew,
+                                traffic_counter_t::writer_t& trafficw)
 {
   msg.valid = false;
   // avoid handling of loopback messages:
@@ -375,18 +1079,50 @@ void ovboxclient_t::process_msg(msgbuf_t& msg)
   // not a special port, thus we forward data to localhost and proxy
   // clients:
   if(msg.destport > MAXSPECIALPORT) {
+    decltype(relayclients)::reader_t relays(relayclients);
+    // drop messages which arrived on more than one path, e.g., via
+    // a relay and directly; this happens only in relay trees and for
+    // proxy clients:
+    if(((!relays->empty()) || (mode & B_USINGPROXY)) &&
+       dupl.is_duplicate(msg))
+      return;
     if(msg.destport + portoffset != recport)
-      local_server.send(msg.msg, msg.size, msg.destport + portoffset);
-    for(auto xd : xdest)
-      if(msg.destport + xd != recport)
-        local_server.send(msg.msg, msg.size, msg.destport + xd);
+      send_local(local_server, msg.msg, msg.size, msg.destport + portoffset);
+    {
+      decltype(xdest)::reader_t xdests(xdest);
+      for(auto xd : *xdests)
+        if(msg.destport + xd != recport)
+          send_local(local_server, msg.msg, msg.size, msg.destport + xd);
+    }
+    // forward packed message to relay clients:
+    if(!relays->empty())
+      send_to_relay_clients(msg.rawbuffer, msg.size + HEADERLEN, msg.cid,
+                            msg.sender, tracew, trafficw);
     // is this message from same network?
     if(!is_same_network(msg.sender, localep)) {
-      // now send to proxy clients:
-      for(auto client : proxyclients) {
+      decltype(proxyclients)::reader_t clients(proxyclients);
+      bool mcast(proxy_mcast && (!clients->empty()));
+      timestamp_ns_t mcast_since(0);
+      if(mcast) {
+        // send packed message once to the multicast group of the
+        // proxy clients:
+        send_packed(msg.rawbuffer, msg.size + HEADERLEN, proxy_mcast_ep,
+                    TRAFFIC_OTHER, tracew, trafficw);
+        mcast_since = get_timestamp_ns() - 1000000ll * MCASTACKTIMEOUTMS;
+      }
+      // now send to proxy clients which did not confirm the multicast
+      // reception:
+      for(auto client : *clients) {
+        if(mcast && (client.first < MAX_STAGE_ID) &&
+           (mcast_ack[client.first].load(std::memory_order_relaxed) >
+            mcast_since))
+          continue;
         if(msg.cid != client.first) {
           client.second.sin_port = htons((unsigned short)msg.destport);
-          remote_server.send(msg.msg, msg.size, client.second);
+          if(remote_server.send(msg.msg, msg.size, client.second) > 0)
+            trafficw.add_tx(client.first, msg.destport, msg.size);
+          tracew.add(TRACE_TX, TRACE_SENT, msg.cid, msg.destport, msg.seq,
+                     msg.size, client.second);
         }
       }
     }
@@ -396,13 +1132,24 @@ void ovboxclient_t::process_msg(msgbuf_t& msg)
   case PORT_PING:
   case PORT_PING_SRV:
   case PORT_PING_LOCAL:
-    process_ping_msg(msg);
+    process_ping_msg(msg, tracew, trafficw);
     break;
   case PORT_PONG:
   case PORT_PONG_SRV:
   case PORT_PONG_LOCAL:
     process_pong_msg(msg);
     break;
+  case PORT_MCASTACK:
+    // a proxy client receives our multicast group:
+    if(msg.cid < MAX_STAGE_ID)
+      mcast_ack[msg.cid].store(get_timestamp_ns(), std::memory_order_relaxed);
+    break;
+  case PORT_PATHSEL:
+    // the peer selected a path, follow if the peer decides:
+    if((msg.size == sizeof(uint8_t)) && (msg.cid < callerid) &&
+       (*((uint8_t*)(msg.msg)) < path_selector_t::numpaths))
+      path_selectors[msg.cid].set_path((path_t)(*((uint8_t*)(msg.msg))));
+    break;
   case PORT_SETLOCALIP:
     // we received the local IP address of a peer:
     if(msg.size == sizeof(endpoint_t)) {
@@ -423,23 +1170,28 @@ void ovboxclient_t::recsrv()
 {
   try {
     set_thread_prio(prio);
+    packet_trace_t::writer_t tracew(trace);
+    traffic_counter_t::writer_t trafficw(traffic);
     char buffer[BUFSIZE];
     char msg[BUFSIZE];
     endpoint_t sender_endpoint;
     log(recport, "listening");
-    while(runsession) {
+    while(!stopsig.is_stopped()) {
       ssize_t n = local_server.recvfrom(buffer, BUFSIZE, sender_endpoint);
       if(n > 0) {
         size_t un = remote_server.packmsg(msg, BUFSIZE, recport, buffer, n);
-        bool sendtoserver(!(mode & B_PEER2PEER));
-        if(mode & B_PEER2PEER) {
+        streambytes += un;
+        epmode_t cmode(mode);
+        bool sendtoserver(!(cmode & B_PEER2PEER));
+        if(cmode & B_PEER2PEER) {
           // we are in peer-to-peer mode.
           size_t ocid(0);
           for(auto ep : endpoints) {
             if(ep.timeout) {
               // endpoint is active.
-              if(ocid != callerid) {
-                // not sending to ourself.
+              if((ocid != callerid) &&
+                 (!((ep.mode & B_USINGPROXY) && is_relay_client(ocid)))) {
+                // not sending to ourself, and not to relay clients.
                 if(ep.mode & B_PEER2PEER) {
                   // other end is in peer-to-peer mode.
                   bool target_in_same_network(
@@ -451,13 +1203,27 @@ void ovboxclient_t::recsrv()
                       target_in_same_network)) {
                     // sending is not deactivated.
                     if((bool)(ep.mode & B_RECEIVEDOWNMIX) ==
-                       (bool)(mode & B_SENDDOWNMIX)) {
+                       (bool)(cmode & B_SENDDOWNMIX)) {
                       // remote is receiving downmix and this is downmixer
-                      if(sendlocal && target_in_same_network)
+                      path_t path(PATH_P2P);
+                      if(fanout_relayed[ocid]) {
+                        // served via server to meet the upload budget:
+                        sendtoserver = true;
+                      } else if(path_selection &&
+                                path_selectors[ocid].get_path(path)) {
+                        // use automatically selected path:
+                        if((path == PATH_LOCAL) && target_in_same_network)
+                          send_packed(msg, un, ep.localep, ocid, tracew,
+                                      trafficw);
+                        else
+                          send_packed(msg, un, ep.ep, ocid, tracew,
+                                      trafficw);
+                      } else if(sendlocal && target_in_same_network)
                         // same network.
-                        remote_server.send(msg, un, ep.localep);
+                        send_packed(msg, un, ep.localep, ocid, tracew,
+                                    trafficw);
                       else
-                        remote_server.send(msg, un, ep.ep);
+                        send_packed(msg, un, ep.ep, ocid, tracew, trafficw);
                     }
                   }
                 } else {
@@ -475,42 +1241,52 @@ void ovboxclient_t::recsrv()
           //}
         }
         if(sendtoserver) {
-          remote_server.send(msg, un, toport);
+          send_packed(msg, un, toport, tracew, trafficw);
         }
+        if(!decltype(relayclients)::reader_t(relayclients)->empty())
+          send_to_relay_clients(msg, un, callerid, localep, tracew,
+                                trafficw);
       }
     }
   }
   catch(const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
-    runsession = false;
+    stopsig.stop();
   }
 }
 
 // this thread receives local UDP messages and handles them:
-void ovboxclient_t::xrecsrv(port_t srcport, port_t destport)
+void ovboxclient_t::xrecsrv(port_t srcport, port_t destport,
+                            stop_signal_t* stop)
 {
   try {
     udpsocket_t xlocal_server;
+    // the thread is stopped on removal of the port, or when the
+    // session ends, see set_receiverports():
+    xlocal_server.set_stop_signal(stop);
     xlocal_server.set_timeout_usec(100000);
     xlocal_server.set_destination("localhost");
     xlocal_server.bind(srcport, true);
     set_thread_prio(prio);
+    packet_trace_t::writer_t tracew(trace);
+    traffic_counter_t::writer_t trafficw(traffic);
     char buffer[BUFSIZE];
     char msg[BUFSIZE];
     endpoint_t sender_endpoint;
     log(recport, "listening");
-    while(runsession) {
+    while(!(stopsig.is_stopped() || stop->is_stopped())) {
       ssize_t n = xlocal_server.recvfrom(buffer, BUFSIZE, sender_endpoint);
       if(n > 0) {
         size_t un = remote_server.packmsg(msg, BUFSIZE, destport, buffer, n);
-        bool sendtoserver(!(mode & B_PEER2PEER));
-        if(mode & B_PEER2PEER) {
+        epmode_t cmode(mode);
+        bool sendtoserver(!(cmode & B_PEER2PEER));
+        if(cmode & B_PEER2PEER) {
           size_t ocid(0);
           for(auto ep : endpoints) {
             if(ep.timeout) {
               if((ocid != callerid) && (ep.mode & B_PEER2PEER) &&
                  (!(ep.mode & B_DONOTSEND))) {
-                remote_server.send(msg, un, ep.ep);
+                send_packed(msg, un, ep.ep, ocid, tracew, trafficw);
               } else {
                 sendtoserver = true;
               }
@@ -519,18 +1295,296 @@ void ovboxclient_t::xrecsrv(port_t srcport, port_t destport)
           }
         }
         if(sendtoserver) {
-          remote_server.send(msg, un, toport);
+          send_packed(msg, un, toport, tracew, trafficw);
         }
       }
     }
   }
   catch(const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
-    runsession = false;
+    stopsig.stop();
+  }
+}
+
+// this thread receives messages from the proxy multicast group:
+void ovboxclient_t::mcrecsrv(endpoint_t group)
+{
+  try {
+    udpsocket_t mcast_server;
+    udpsocket_t mcast_local;
+    mcast_server.set_stop_signal(&stopsig);
+    mcast_server.set_timeout_usec(100000);
+    mcast_server.bind(ntohs(group.sin_port), false);
+    if(!mcast_server.join_multicast_group(group)) {
+      log(recport, "unable to join multicast group " + ep2str(group) +
+                       ", receiving from proxy by unicast");
+      return;
+    }
+    mcast_local.set_destination("localhost");
+    set_thread_prio(prio);
+    traffic_counter_t::writer_t trafficw(traffic);
+    msgbuf_t msg;
+    char ack[HEADERLEN];
+    size_t nack(
+        packmsg(ack, HEADERLEN, secret, callerid, PORT_MCASTACK, 0, "", 0));
+    timestamp_ns_t t_ack(0);
+    log(recport, "listening to multicast group " + ep2str(group));
+    while(!stopsig.is_stopped()) {
+      ssize_t n = mcast_server.recvfrom(msg.rawbuffer, BUFSIZE, msg.sender);
+      if((n >= (ssize_t)HEADERLEN) && (msg_secret(msg.rawbuffer) == secret)) {
+        msg.unpack(n);
+        if(msg.valid)
+          trafficw.add_rx(msg.cid, msg.destport, n);
+        if(msg.valid && (msg.cid != callerid) &&
+           (msg.destport > MAXSPECIALPORT)) {
+          if(msg.destport + portoffset != recport)
+            send_local(mcast_local, msg.msg, msg.size,
+                       msg.destport + portoffset);
+          decltype(xdest)::reader_t xdests(xdest);
+          for(auto xd : *xdests)
+            if(msg.destport + xd != recport)
+              send_local(mcast_local, msg.msg, msg.size, msg.destport + xd);
+          // confirm reception, then the proxy stops sending by
+          // unicast. Only proxies which handle PORT_MCASTACK send to a
+          // multicast group, thus the sender is known to support it:
+          timestamp_ns_t t(get_timestamp_ns());
+          if(t - t_ack > 1000000ll * MCASTACKPERIODMS) {
+            t_ack = t;
+            if(remote_server.send(ack, nack, msg.sender) > 0)
+              trafficw.add_tx(TRAFFIC_OTHER, PORT_MCASTACK, nack);
+          }
+        }
+      }
+    }
+  }
+  catch(const std::exception& e) {
+    // without confirmations the proxy falls back to unicast, thus the
+    // session can continue:
+    log(recport, "multicast reception failed (" + std::string(e.what()) +
+                     "), receiving from proxy by unicast");
+  }
+}
+
+bool duplicate_filter_t::is_duplicate(const msgbuf_t& msg)
+{
+  window_t* slots(windows[std::min((size_t)msg.cid, (size_t)MAX_STAGE_ID)]);
+  size_t k(0);
+  while((k < MESSAGE_SORTER_PORTS) && (slots[k].port != msg.destport) &&
+        (slots[k].port != 0))
+    ++k;
+  if(k == MESSAGE_SORTER_PORTS)
+    // all slots in use, do not drop messages of unknown streams:
+    return false;
+  window_t& win(slots[k]);
+  win.port = msg.destport;
+  if(!win.mask) {
+    // first message of this sender and port:
+    win.seq = msg.seq;
+    win.mask = 1;
+    return false;
+  }
+  sequence_t dseq(msg.seq - win.seq);
+  if(dseq > 0) {
+    // new message:
+    if(dseq < 64)
+      win.mask = (win.mask << dseq) | 1;
+    else
+      win.mask = 1;
+    win.seq = msg.seq;
+    return false;
+  }
+  if(-dseq >= 64) {
+    // much older than window, assume that the sequence was restarted:
+    win.seq = msg.seq;
+    win.mask = 1;
+    return false;
+  }
+  uint64_t bit((uint64_t)1 << (-dseq));
+  if(win.mask & bit)
+    return true;
+  win.mask |= bit;
+  return false;
+}
+
+message_sorter_t::message_sorter_t()
+    : t_buf1(0), has_seqerr(false), seqerr_cid(0), seqerr_expected(0),
+      seqerr_received(0), seqerr_port(0)
+{
+}
+
+bool message_sorter_t::get_seqerr(stage_device_id_t& cid,
+                                  sequence_t& expected, sequence_t& received,
+                                  port_t& destport)
+{
+  if(!has_seqerr)
+    return false;
+  has_seqerr = false;
+  cid = seqerr_cid;
+  expected = seqerr_expected;
+  received = seqerr_received;
+  destport = seqerr_port;
+  return true;
+}
+
+message_sorter_t::stat_t::stat_t()
+    : received(0), lost(0), seqerr_in(0), seqerr_out(0), holdtime(0)
+{
+}
+
+message_sorter_t::stream_t::stream_t()
+    : port(0), jitter(0), period(0), good(0u), lost(0u), bursts(0u), run(0u),
+      burstlen(0u), has_last(false), seq_last(0), t_last(0), seq_commit(0),
+      missing(0u)
+{
+  for(auto& c : iat)
+    c = 0u;
+  for(auto& c : burst)
+    c = 0u;
+  for(auto& c : gap)
+    c = 0u;
+}
+
+void message_sorter_t::stream_t::add_loss(size_t n)
+{
+  relaxed_add(lost, n);
+  relaxed_add(bursts, (size_t)1);
+  relaxed_add(burst[std::min(n, (size_t)LOSS_BINS) - 1], (size_t)1);
+  if(run > 0) {
+    size_t bin(0);
+    while((run >> (bin + 1)) && (bin < GAP_BINS - 1))
+      ++bin;
+    relaxed_add(gap[bin], (size_t)1);
+  }
+  run = 0;
+}
+
+void message_sorter_t::stream_t::commit(sequence_t seq)
+{
+  // messages up to seq leave the reorder window, count them in order
+  // of their sequence numbers:
+  while((sequence_t)(seq - seq_commit) >= 0) {
+    sequence_t k(seq_last - seq_commit);
+    bool lostmsg((k >= 0) ? ((missing >> k) & 1u) : true);
+    if(lostmsg) {
+      ++burstlen;
+    } else {
+      if(burstlen)
+        add_loss(burstlen);
+      burstlen = 0;
+      ++run;
+    }
+    ++seq_commit;
+  }
+}
+
+void message_sorter_t::stream_t::add_arrival(sequence_t seq, double t)
+{
+  if(!has_last) {
+    has_last = true;
+    seq_last = seq;
+    t_last = t;
+    seq_commit = seq;
+    missing = 0;
+    relaxed_add(good, (size_t)1);
+    return;
+  }
+  sequence_t dseq(seq - seq_last);
+  if(dseq <= 0) {
+    // late message within the reorder window is not lost:
+    if((-dseq < MESSAGE_REORDER_WINDOW) && ((missing >> (-dseq)) & 1u)) {
+      missing &= ~((uint64_t)1 << (-dseq));
+      relaxed_add(good, (size_t)1);
+    }
+    // keep reference of newest message:
+    return;
+  }
+  double dt(t - t_last);
+  if(dseq > 64) {
+    // sequence jump, e.g., sender was restarted:
+    seq_last = seq;
+    t_last = t;
+    seq_commit = seq;
+    missing = 0;
+    run = 0;
+    burstlen = 0;
+    relaxed_add(good, (size_t)1);
+    return;
+  }
+  // messages which leave the reorder window with this message, the
+  // skipped ones are still marked as missing:
+  commit(seq - MESSAGE_REORDER_WINDOW);
+  missing = (dseq < 64) ? (missing << dseq) : 0u;
+  if(dseq > 1)
+    missing |= ((dseq < 64) ? (((uint64_t)1 << dseq) - 1u) : ~(uint64_t)0) &
+               ~(uint64_t)1;
+  missing &= ((uint64_t)1 << MESSAGE_REORDER_WINDOW) - 1u;
+  seq_last = seq;
+  t_last = t;
+  relaxed_add(good, (size_t)1);
+  if(dt > 1000.0)
+    // long interruption:
+    return;
+  double p(period.load(std::memory_order_relaxed));
+  if(dseq == 1) {
+    size_t bin(std::min((size_t)(std::max(0.0, dt) / IAT_BINWIDTH),
+                        (size_t)(IAT_BINS - 1)));
+    relaxed_add(iat[bin], (size_t)1);
+    if(p > 0)
+      p += (dt - p) / 64.0;
+    else
+      p = dt;
+    period.store(p, std::memory_order_relaxed);
+  }
+  if(p > 0) {
+    // RFC 3550, section 6.4.1:
+    double d(fabs(dt - dseq * p));
+    double j(jitter.load(std::memory_order_relaxed));
+    jitter.store(j + (d - j) / 16.0, std::memory_order_relaxed);
+  }
+}
+
+message_sorter_t::stream_t& message_sorter_t::stat_t::get_stream(port_t p)
+{
+  for(auto& s : streams) {
+    port_t sp(s.port.load(std::memory_order_relaxed));
+    if(sp == p)
+      return s;
+    if(sp == 0) {
+      s.port.store(p, std::memory_order_relaxed);
+      return s;
+    }
   }
+  // all slots in use, share the last one:
+  return streams[MESSAGE_STAT_STREAMS - 1];
+}
+
+message_sorter_t::seqslot_t& message_sorter_t::get_seq(const msgbuf_t& msg)
+{
+  seqslot_t* slots(seqs[std::min((size_t)msg.cid, (size_t)MAX_STAGE_ID)]);
+  for(size_t k = 0; k < MESSAGE_SORTER_PORTS; ++k) {
+    if(slots[k].port == msg.destport)
+      return slots[k];
+    if(slots[k].port == 0) {
+      slots[k].port = msg.destport;
+      return slots[k];
+    }
+  }
+  // all slots in use, share the last one:
+  return slots[MESSAGE_SORTER_PORTS - 1];
 }
 
 bool message_sorter_t::process(msgbuf_t** ppmsg)
+{
+  return process(ppmsg, 1e-6 * get_timestamp_ns());
+}
+
+bool message_sorter_t::process(msgbuf_t** ppmsg, double t)
+{
+  seqlock_t::write_guard_t guard(statlock);
+  return process_(ppmsg, t);
+}
+
+bool message_sorter_t::process_(msgbuf_t** ppmsg, double t)
 {
   if((*ppmsg)->valid) {
     msgbuf_t* pmsg(*ppmsg);
@@ -540,108 +1594,480 @@ bool message_sorter_t::process(msgbuf_t** ppmsg)
       return true;
     }
     // we received a message, check for sequence order
-    ++stat[pmsg->cid].received;
-    bool notfirst(seq_in[pmsg->cid].find(pmsg->destport) !=
-                  seq_in[pmsg->cid].end());
+    ++get_stat_slot(pmsg->cid).received;
+    get_stat_slot(pmsg->cid)
+        .get_stream(pmsg->destport)
+        .add_arrival(pmsg->seq, t);
+    seqslot_t& sq(get_seq(*pmsg));
+    bool notfirst(sq.has_in);
     // get input sequence difference:
-    sequence_t dseq_in(deltaseq(seq_in, *pmsg));
-    sequence_t dseq_io(deltaseq_const(seq_out, *pmsg));
+    sequence_t dseq_in(pmsg->seq - sq.in);
+    sq.in = pmsg->seq;
+    sq.has_in = true;
+    sequence_t dseq_io(pmsg->seq - sq.out);
     if((dseq_in != 0) && notfirst)
-      stat[pmsg->cid].lost += dseq_in - 1;
+      get_stat_slot(pmsg->cid).lost += dseq_in - 1;
+    if((dseq_in != 0) && (dseq_in != 1) && notfirst) {
+      has_seqerr = true;
+      seqerr_cid = pmsg->cid;
+      seqerr_expected = pmsg->seq - dseq_in + 1;
+      seqerr_received = pmsg->seq;
+      seqerr_port = pmsg->destport;
+    }
     // dropout:
     if((dseq_in > 1) && (dseq_io > 1)) {
       buf1.copy(*pmsg);
+      t_buf1 = t;
       (*ppmsg)->valid = false;
       return false;
     }
-    stat[pmsg->cid].seqerr_in += (dseq_in < 0);
+    get_stat_slot(pmsg->cid).seqerr_in += (dseq_in < 0);
     if((dseq_in < -1) || ((dseq_io > 1) && (dseq_in > 0))) {
       if(buf1.valid && (buf1.cid == pmsg->cid) &&
          (buf1.destport == pmsg->destport) && (buf1.seq < pmsg->seq)) {
         buf2.copy(*pmsg);
         *ppmsg = &buf1;
         buf1.valid = false;
-        sequence_t dseq_out(deltaseq(seq_out, buf1));
-        stat[pmsg->cid].seqerr_out += (dseq_out < 0);
+        sequence_t dseq_out(deltaseq_out(buf1));
+        get_stat_slot(pmsg->cid).seqerr_out += (dseq_out < 0);
+        relaxed_add(get_stat_slot(buf1.cid).holdtime, t - t_buf1);
         return true;
       }
     }
-    sequence_t dseq_out(deltaseq(seq_out, *pmsg));
+    sequence_t dseq_out(deltaseq_out(*pmsg));
     pmsg->valid = false;
-    stat[pmsg->cid].seqerr_out += (dseq_out < 0);
+    get_stat_slot(pmsg->cid).seqerr_out += (dseq_out < 0);
     return true;
   }
   if(buf1.valid) {
     *ppmsg = &buf1;
-    sequence_t dseq_out(deltaseq(seq_out, buf1));
+    sequence_t dseq_out(deltaseq_out(buf1));
     buf1.valid = false;
-    stat[buf1.cid].seqerr_out += (dseq_out < 0);
+    get_stat_slot(buf1.cid).seqerr_out += (dseq_out < 0);
+    relaxed_add(get_stat_slot(buf1.cid).holdtime, t - t_buf1);
     return true;
   }
   if(buf2.valid) {
-    sequence_t dseq_out(deltaseq(seq_out, buf2));
+    sequence_t dseq_out(deltaseq_out(buf2));
     *ppmsg = &buf2;
     buf2.valid = false;
-    stat[buf2.cid].seqerr_out += (dseq_out < 0);
+    get_stat_slot(buf2.cid).seqerr_out += (dseq_out < 0);
+    return true;
+  }
+  return false;
+}
+
+message_stat_t message_sorter_t::get_stat(stage_device_id_t id) const
+{
+  message_stat_t ms;
+  const stat_t& st(stat[std::min((size_t)id, (size_t)MAX_STAGE_ID)]);
+  uint32_t s;
+  do {
+    s = statlock.read_begin();
+    ms.received = st.received.load(std::memory_order_relaxed);
+    ms.lost = st.lost.load(std::memory_order_relaxed);
+    ms.seqerr_in = st.seqerr_in.load(std::memory_order_relaxed);
+    ms.seqerr_out = st.seqerr_out.load(std::memory_order_relaxed);
+    ms.holdtime = st.holdtime.load(std::memory_order_relaxed);
+    for(size_t k = 0; k < MESSAGE_STAT_STREAMS; ++k) {
+      const stream_t& src(st.streams[k]);
+      stream_stat_t& dest(ms.streams[k]);
+      dest.port = src.port.load(std::memory_order_relaxed);
+      dest.jitter = src.jitter.load(std::memory_order_relaxed);
+      dest.period = src.period.load(std::memory_order_relaxed);
+      for(size_t b = 0; b < IAT_BINS; ++b)
+        dest.iat[b] = src.iat[b].load(std::memory_order_relaxed);
+      dest.good = src.good.load(std::memory_order_relaxed);
+      dest.lost = src.lost.load(std::memory_order_relaxed);
+      dest.bursts = src.bursts.load(std::memory_order_relaxed);
+      for(size_t b = 0; b < LOSS_BINS; ++b)
+        dest.burst[b] = src.burst[b].load(std::memory_order_relaxed);
+      for(size_t b = 0; b < GAP_BINS; ++b)
+        dest.gap[b] = src.gap[b].load(std::memory_order_relaxed);
+    }
+  } while(statlock.read_retry(s));
+  // fit a two-state Gilbert-Elliott model to all packets since start,
+  // assuming that all packets are lost in the bad state and none in
+  // the good state:
+  for(auto& st : ms.streams) {
+    if(st.good)
+      st.ge_p = (double)st.bursts / (double)st.good;
+    if(st.lost)
+      st.ge_r = (double)st.bursts / (double)st.lost;
+  }
+  return ms;
+}
+
+ping_rate_t::ping_rate_t()
+    : interval(1), steady(0), waiting(false), srtt(-1.0), rttvar(0.0),
+      since_sent(0)
+{
+}
+
+bool ping_rate_t::tick()
+{
+  ++since_sent;
+  // a ping is lost if it was not answered within twice the smoothed
+  // round trip time:
+  if(waiting && (since_sent * PINGPERIODMS > 2.0 * srtt + PINGPERIODMS)) {
+    waiting = false;
+    set_unstable();
+  }
+  if(since_sent >= interval) {
+    since_sent = 0;
+    waiting = true;
     return true;
   }
   return false;
 }
 
-message_stat_t message_sorter_t::get_stat(stage_device_id_t id)
+void ping_rate_t::add_value(double tms)
+{
+  waiting = false;
+  double rtt(srtt);
+  if(rtt < 0) {
+    srtt = tms;
+    rttvar = 0.5 * tms;
+    return;
+  }
+  // smoothed round trip time and variation as in RFC 6298:
+  double dev(fabs(tms - rtt));
+  if(dev > std::max(2.0, 4.0 * rttvar)) {
+    set_unstable();
+  } else if(++steady >= steadycount) {
+    steady = 0;
+    interval = std::min(2u * interval, maxinterval);
+  }
+  rttvar += 0.25 * (dev - rttvar);
+  srtt = rtt + 0.125 * (tms - rtt);
+}
+
+void ping_rate_t::set_unstable()
+{
+  steady = 0;
+  interval = 1;
+}
+
+ping_histogram_t::ping_histogram_t()
+{
+  clear();
+}
+
+void ping_histogram_t::clear()
+{
+  for(auto& c : count)
+    c.store(0, std::memory_order_relaxed);
+  n.store(0, std::memory_order_relaxed);
+  sum.store(0.0, std::memory_order_relaxed);
+  vmin.store(0.0, std::memory_order_relaxed);
+  vmax.store(0.0, std::memory_order_relaxed);
+}
+
+size_t ping_histogram_t::get_bin(double pt)
+{
+  if(!(pt > minvalue))
+    return 0;
+  size_t bin(binsperoctave * log2(pt / minvalue));
+  return std::min(bin, numbins - 1);
+}
+
+double ping_histogram_t::get_bin_value(size_t bin)
 {
-  return stat[id];
+  return minvalue * exp2((bin + 0.5) / binsperoctave);
 }
 
-ping_stat_collecor_t::ping_stat_collecor_t(size_t N)
-    : sent(0), received(0), data(N, 0.0), idx(0), filled(0), sum(0.0)
+void ping_histogram_t::add_value(double pt)
 {
+  size_t cn(n.load(std::memory_order_relaxed));
+  relaxed_add(count[get_bin(pt)], 1u);
+  if(!cn || (pt < vmin.load(std::memory_order_relaxed)))
+    vmin.store(pt, std::memory_order_relaxed);
+  if(!cn || (pt > vmax.load(std::memory_order_relaxed)))
+    vmax.store(pt, std::memory_order_relaxed);
+  relaxed_add(sum, pt);
+  n.store(cn + 1, std::memory_order_relaxed);
+}
+
+void ping_histogram_t::add(const ping_histogram_t& h)
+{
+  size_t hn(h.n.load(std::memory_order_relaxed));
+  if(!hn)
+    return;
+  size_t cn(n.load(std::memory_order_relaxed));
+  for(size_t k = 0; k < numbins; ++k)
+    relaxed_add(count[k], h.count[k].load(std::memory_order_relaxed));
+  double hmin(h.vmin.load(std::memory_order_relaxed));
+  double hmax(h.vmax.load(std::memory_order_relaxed));
+  if(!cn || (hmin < vmin.load(std::memory_order_relaxed)))
+    vmin.store(hmin, std::memory_order_relaxed);
+  if(!cn || (hmax > vmax.load(std::memory_order_relaxed)))
+    vmax.store(hmax, std::memory_order_relaxed);
+  relaxed_add(sum, h.sum.load(std::memory_order_relaxed));
+  n.store(cn + hn, std::memory_order_relaxed);
+}
+
+double ping_histogram_t::get_min() const
+{
+  return get_count() ? vmin.load(std::memory_order_relaxed) : -1.0;
+}
+
+double ping_histogram_t::get_max() const
+{
+  return get_count() ? vmax.load(std::memory_order_relaxed) : -1.0;
+}
+
+double ping_histogram_t::get_mean() const
+{
+  size_t cn(get_count());
+  return cn ? sum.load(std::memory_order_relaxed) / cn : -1.0;
+}
+
+double ping_histogram_t::get_sample(size_t k) const
+{
+  // exact values of smallest and largest sample are known:
+  double lmin(get_min());
+  double lmax(get_max());
+  if(k == 0)
+    return lmin;
+  if(k + 1 >= get_count())
+    return lmax;
+  size_t cum(0);
+  for(size_t bin = 0; bin < numbins; ++bin) {
+    cum += count[bin].load(std::memory_order_relaxed);
+    if(cum > k)
+      return std::min(lmax, std::max(lmin, get_bin_value(bin)));
+  }
+  return lmax;
+}
+
+double ping_histogram_t::get_quantile(double q) const
+{
+  size_t cn(get_count());
+  if(!cn)
+    return -1.0;
+  double r(q * (cn - 1));
+  size_t k(floor(r));
+  double w(r - k);
+  if(w == 0)
+    return get_sample(k);
+  return (1.0 - w) * get_sample(k) + w * get_sample(k + 1);
+}
+
+ping_window_t::ping_window_t(double duration)
+    : halfduration(0.5 * duration), epoch(0)
+{
+}
+
+void ping_window_t::add_value(double pt, double t)
+{
+  int64_t e(floor(t / halfduration));
+  int64_t cur(epoch.load(std::memory_order_relaxed));
+  if(e == cur + 1) {
+    // start new half window, drop oldest:
+    hist[e & 1].clear();
+    epoch.store(e, std::memory_order_relaxed);
+  } else if(e != cur) {
+    hist[0].clear();
+    hist[1].clear();
+    epoch.store(e, std::memory_order_relaxed);
+  }
+  hist[e & 1].add_value(pt);
+}
+
+void ping_window_t::get_histogram(ping_histogram_t& h, double t) const
+{
+  h.clear();
+  int64_t e(floor(t / halfduration));
+  int64_t cur(epoch.load(std::memory_order_relaxed));
+  if(e == cur) {
+    h.add(hist[0]);
+    h.add(hist[1]);
+  } else if(e == cur + 1) {
+    h.add(hist[cur & 1]);
+  }
+}
+
+ping_snapshot_t::ping_snapshot_t() : sent(0), received(0) {}
+
+ping_stat_collecor_t::ping_stat_collecor_t()
+    : sent(0), received(0), win_1s(1.0), win_10s(10.0), win_60s(60.0),
+      win_up(60.0), win_down(60.0)
+{
+}
+
+void ping_stat_collecor_t::add_oneway(double up, double down)
+{
+  add_oneway(up, down, 1e-9 * get_timestamp_ns());
+}
+
+void ping_stat_collecor_t::add_oneway(double up, double down, double t)
+{
+  seqlock_t::write_guard_t guard(lock);
+  win_up.add_value(up, t);
+  win_down.add_value(down, t);
 }
 
 void ping_stat_collecor_t::add_value(double pt)
 {
-  ++received;
-  sum -= data[idx];
-  data[idx] = pt;
-  sum += pt;
+  add_value(pt, 1e-9 * get_timestamp_ns());
+}
+
+void ping_stat_collecor_t::add_value(double pt, double t)
+{
+  seqlock_t::write_guard_t guard(lock);
+  relaxed_add(received, (size_t)1);
+  win_1s.add_value(pt, t);
+  win_10s.add_value(pt, t);
+  win_60s.add_value(pt, t);
+}
+
+void ping_stat_collecor_t::get_snapshot(ping_snapshot_t& snap, double t) const
+{
+  uint32_t s;
+  do {
+    s = lock.read_begin();
+    snap.received = received.load(std::memory_order_relaxed);
+    win_1s.get_histogram(snap.win_1s, t);
+    win_10s.get_histogram(snap.win_10s, t);
+    win_60s.get_histogram(snap.win_60s, t);
+    win_up.get_histogram(snap.up, t);
+    win_down.get_histogram(snap.down, t);
+  } while(lock.read_retry(s));
+  snap.sent = sent;
+}
+
+void ping_stat_collecor_t::update_ping_stat(ping_stat_t& ps) const
+{
+  update_ping_stat(ps, 1e-9 * get_timestamp_ns());
+}
+
+void ping_stat_collecor_t::update_ping_stat(ping_stat_t& ps, double t) const
+{
+  ping_snapshot_t snap;
+  get_snapshot(snap, t);
+  ps.received = snap.received - ps.state_received;
+  ps.lost = snap.sent - ps.state_sent;
+  ps.lost -= std::min(ps.received, ps.lost);
+  ps.state_sent = snap.sent;
+  ps.state_received = snap.received;
+  ps.win_1s.t_med = snap.win_1s.get_quantile(0.5);
+  ps.win_1s.t_p99 = snap.win_1s.get_quantile(0.99);
+  ps.win_1s.n = snap.win_1s.get_count();
+  ps.win_10s.t_med = snap.win_10s.get_quantile(0.5);
+  ps.win_10s.t_p99 = snap.win_10s.get_quantile(0.99);
+  ps.win_10s.n = snap.win_10s.get_count();
+  ps.t_up = snap.up.get_quantile(0.5);
+  ps.t_down = snap.down.get_quantile(0.5);
+  ps.t_min = snap.win_60s.get_min();
+  ps.t_med = snap.win_60s.get_quantile(0.5);
+  ps.t_p99 = snap.win_60s.get_quantile(0.99);
+  ps.t_mean = snap.win_60s.get_mean();
+}
+
+clock_offset_estimator_t::clock_offset_estimator_t(size_t N)
+    : samples(N), idx(0), filled(0), offset(0), valid(false)
+{
+}
+
+void clock_offset_estimator_t::add_sample(timestamp_ns_t t1, timestamp_ns_t t2,
+                                          timestamp_ns_t t4)
+{
+  samples[idx].first = t4 - t1;
+  samples[idx].second = t2 - t1 / 2 - t4 / 2;
   ++idx;
-  if(idx >= data.size())
+  if(idx >= samples.size())
     idx = 0;
-  if(filled < data.size())
+  if(filled < samples.size())
     ++filled;
+  // use offset of sample with shortest round trip time:
+  size_t best(0);
+  for(size_t k = 1; k < filled; ++k)
+    if(samples[k].first < samples[best].first)
+      best = k;
+  offset.store(samples[best].second, std::memory_order_relaxed);
+  valid.store(true, std::memory_order_release);
 }
 
-void ping_stat_collecor_t::update_ping_stat(ping_stat_t& ps) const
+void clock_offset_estimator_t::get_oneway(timestamp_ns_t t1, timestamp_ns_t t2,
+                                          timestamp_ns_t t4, double& up,
+                                          double& down) const
 {
-  ps.t_min = -1.0;
-  ps.t_med = -1.0;
-  ps.t_p99 = -1.0;
-  ps.t_mean = -1.0;
-  ps.received = received - ps.state_received;
-  ps.lost = sent - ps.state_sent;
-  ps.lost -= std::min(ps.received, ps.lost);
-  ps.state_sent = sent;
-  ps.state_received = received;
-  if(!filled)
-    return;
-  std::vector<double> sb(data);
-  sb.resize(filled);
-  std::sort(sb.begin(), sb.end());
-  size_t idx_med(std::round(0.5 * (filled - 1)));
-  size_t idx_99(std::round(0.99 * (filled - 1)));
-  ps.t_med = sb[idx_med];
-  if((filled & 1) == 0) {
-    // even number of samples, median is mean of two neighbours
-    if(idx_med)
-      ps.t_med += sb[idx_med - 1];
-    else
-      ps.t_med += sb[idx_med + 1];
-    ps.t_med *= 0.5;
+  timestamp_ns_t off(get_offset());
+  up = 1e-6 * (double)(t2 - off - t1);
+  down = 1e-6 * (double)(t4 - t2 + off);
+}
+
+path_selector_t::path_selector_t()
+    : candidate(PATH_P2P), count(0), selected(-1)
+{
+}
+
+void path_selector_t::add_sent(path_t p)
+{
+  if(p < numpaths)
+    ++stat[p].sent;
+}
+
+void path_selector_t::add_value(path_t p, double tms)
+{
+  if(p < numpaths)
+    stat[p].add_value(tms);
+}
+
+double path_selector_t::score(const ping_stat_t& ps)
+{
+  if((ps.received == 0) || (ps.win_10s.n == 0))
+    return HUGE_VAL;
+  // one percent loss is rated like 10 ms additional delay:
+  double loss((double)ps.lost / (double)(ps.received + ps.lost));
+  return ps.win_10s.t_med + 0.5 * (ps.win_10s.t_p99 - ps.win_10s.t_med) +
+         1000.0 * loss;
+}
+
+bool path_selector_t::update()
+{
+  double sc[numpaths];
+  path_t best(PATH_P2P);
+  for(uint32_t p = 0; p < numpaths; ++p) {
+    stat[p].update_ping_stat(ps[p]);
+    sc[p] = score(ps[p]);
+    if(sc[p] < sc[best])
+      best = (path_t)p;
   }
-  ps.t_min = sb[0];
-  ps.t_p99 = sb[idx_99];
-  ps.t_mean = sum / filled;
-  return;
+  if(sc[best] == HUGE_VAL)
+    return false;
+  path_t cur;
+  if(!get_path(cur)) {
+    selected.store(best, std::memory_order_relaxed);
+    count = 0;
+    return true;
+  }
+  if((best != cur) && (sc[best] + margin < sc[cur])) {
+    if(best != candidate) {
+      candidate = best;
+      count = 0;
+    }
+    if(++count >= holdcount) {
+      selected.store(best, std::memory_order_relaxed);
+      count = 0;
+      return true;
+    }
+  } else {
+    count = 0;
+  }
+  return false;
+}
+
+void path_selector_t::set_path(path_t p)
+{
+  if(p < numpaths)
+    selected.store(p, std::memory_order_relaxed);
+}
+
+std::string get_session_multicast_group(secret_t secret)
+{
+  return "239.255." + std::to_string((secret >> 8) & 0xff) + "." +
+         std::to_string(secret & 0xff);
 }
 
 std::string to_string(const ping_stat_t& ps)
@@ -662,7 +2088,8 @@ std::string to_string(const message_stat_t& ms)
   return "received=" + std::to_string(ms.received) +
          " lost=" + std::to_string(ms.lost) + ctmp +
          std::to_string(ms.seqerr_in) +
-         " recovered=" + std::to_string(ms.seqerr_in - ms.seqerr_out);
+         " recovered=" + std::to_string(ms.seqerr_in - ms.seqerr_out) +
+         " jitter=" + std::to_string(ms.get_jitter()) + "ms";
 }
 
 /*
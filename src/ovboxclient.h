@@ -22,27 +22,483 @@
 #define OVBOXCLIENT
 
 #include "callerlist.h"
+#include "liveconfig.h"
+#include "packettrace.h"
+#include "seqlock.h"
+#include "spscqueue.h"
+#include "trafficcounter.h"
 #include <functional>
 
+class trace_replay_t;
+
 std::string to_string(const ping_stat_t& ps);
 std::string to_string(const message_stat_t& ms);
 
-class ping_stat_collecor_t {
+/**
+ * \brief Default multicast group of a session
+ * \ingroup proxymode
+ *
+ * \param secret Access code of session
+ * \return IP address of a multicast group in the organization-local
+ * scope (239.255.0.0/16), derived from the session secret
+ */
+std::string get_session_multicast_group(secret_t secret);
+
+// number of messages after which a missing message is counted as
+// lost, late messages within this window are counted as received:
+#define MESSAGE_REORDER_WINDOW 8
+
+// maximum number of destination ports per sender in the message
+// sorter and in the duplicate filter; in the sorter further ports
+// share the last slot, the filter does not check them:
+#define MESSAGE_SORTER_PORTS 8
+
+// period time of path selection, in ping periods:
+#define PATHSELPERIOD 10
+// interval of multicast reception confirmations of proxy clients, in ms:
+#define MCASTACKPERIODMS 500
+// proxy clients without confirmation within this time are served by
+// unicast, in ms:
+#define MCASTACKTIMEOUTMS 2000
+
+/**
+ * Histogram of ping times with logarithmic bins.
+ *
+ * The bins start at 0.05 ms with 16 bins per octave, thus 256 bins
+ * cover ping times up to 3.2 s with a relative resolution of 4.4
+ * percent. Larger values are counted in the last bin. Minimum,
+ * maximum and sum are stored exactly.
+ *
+ * All fields are atomic, so the histogram can be read while one
+ * other thread is adding values. Use a seqlock_t to get a consistent
+ * view.
+ */
+class ping_histogram_t {
 public:
-  ping_stat_collecor_t(size_t N = 2048);
+  ping_histogram_t();
+  void clear();
   void add_value(double pt);
-  // std::vector<double> get_min_med_99_mean_lost() const;
-  void update_ping_stat(ping_stat_t& ps) const;
+  /**
+   * Add all values of another histogram.
+   */
+  void add(const ping_histogram_t& h);
+  /**
+   * Return the approximate quantile.
+   * @param q Quantile, between 0 and 1
+   * @return Ping time in milliseconds, or -1 if empty
+   *
+   * The value is interpolated between neighbouring samples like the
+   * median of an even number of samples.
+   */
+  double get_quantile(double q) const;
+  double get_min() const;
+  double get_max() const;
+  double get_mean() const;
+  size_t get_count() const { return n.load(std::memory_order_relaxed); };
+  static size_t get_bin(double pt);
+  /**
+   * Return the center of a bin, in milliseconds.
+   */
+  static double get_bin_value(size_t bin);
+  static constexpr size_t numbins = 256;
+  static constexpr size_t binsperoctave = 16;
+  static constexpr double minvalue = 0.05;
+
+private:
+  double get_sample(size_t k) const;
+  std::atomic<uint32_t> count[numbins];
+  std::atomic<size_t> n;
+  std::atomic<double> sum;
+  std::atomic<double> vmin;
+  std::atomic<double> vmax;
+};
+
+/**
+ * Ping time histogram of a sliding time window.
+ *
+ * Two histograms cover one half of the window each. The window
+ * contains all values of the last half window, and of the previous
+ * half window, thus between one half and the full window duration.
+ */
+class ping_window_t {
+public:
+  /**
+   * @param duration Window duration in seconds
+   */
+  ping_window_t(double duration);
+  /**
+   * Add a value.
+   * @param pt Ping time in milliseconds
+   * @param t Time in seconds
+   */
+  void add_value(double pt, double t);
+  /**
+   * Get the values of the window at a given time.
+   * @param[out] h Histogram to store the values
+   * @param t Time in seconds
+   */
+  void get_histogram(ping_histogram_t& h, double t) const;
+
+private:
+  double halfduration;
+  std::atomic<int64_t> epoch;
+  ping_histogram_t hist[2];
+};
+
+/**
+ * Consistent copy of the statistics of one peer and path.
+ */
+class ping_snapshot_t {
+public:
+  ping_snapshot_t();
+  /// number of pings sent:
   size_t sent;
+  /// number of pongs received:
   size_t received;
+  ping_histogram_t win_1s;
+  ping_histogram_t win_10s;
+  ping_histogram_t win_60s;
+  /// one-way delays to peer, 60 s window:
+  ping_histogram_t up;
+  /// one-way delays from peer, 60 s window:
+  ping_histogram_t down;
+};
+
+/**
+ * Collect ping statistics of one peer and path.
+ *
+ * Ping times are stored in histograms of time windows of 1 s, 10 s
+ * and 60 s. Minimum, median, 99th percentile and mean of the
+ * statistics are taken from the 60 s window.
+ *
+ * Values are added by the receiver thread, sent pings are counted by
+ * the ping thread. Any thread can read a consistent snapshot without
+ * locking.
+ */
+class alignas(64) ping_stat_collecor_t {
+public:
+  ping_stat_collecor_t();
+  void add_value(double pt);
+  /**
+   * Add a value at a given time.
+   * @param pt Ping time in milliseconds
+   * @param t Time in seconds
+   */
+  void add_value(double pt, double t);
+  /**
+   * Add one-way delays of a ping.
+   * @param up Delay to peer in milliseconds
+   * @param down Delay from peer in milliseconds
+   */
+  void add_oneway(double up, double down);
+  void add_oneway(double up, double down, double t);
+  void update_ping_stat(ping_stat_t& ps) const;
+  /**
+   * Update statistics at a given time.
+   * @param ps Statistics to be updated
+   * @param t Time in seconds
+   */
+  void update_ping_stat(ping_stat_t& ps, double t) const;
+  /**
+   * Get a consistent copy of the statistics.
+   * @param[out] s Snapshot
+   * @param t Time in seconds
+   */
+  void get_snapshot(ping_snapshot_t& s, double t) const;
+  std::atomic<size_t> sent;
+  std::atomic<size_t> received;
 
 private:
-  std::vector<double> data;
+  seqlock_t lock;
+  ping_window_t win_1s;
+  ping_window_t win_10s;
+  ping_window_t win_60s;
+  ping_window_t win_up;
+  ping_window_t win_down;
+};
+
+/**
+ * Estimate the clock offset of a peer from ping time stamps.
+ *
+ * Each ping provides the local send time t1, the time t2 when the
+ * peer answered, and the local receive time t4. Assuming equal delay
+ * in both directions, the peer clock offset is t2 - (t1 + t4) / 2. Of
+ * the last N pings, the one with the shortest round trip time is
+ * used, since it has the least queueing delay. A constant asymmetry
+ * of the network path can not be observed by this method; it is
+ * attributed half to each direction. Variable delay, e.g., from
+ * queueing in a DSL uplink, is attributed to the correct direction.
+ *
+ * Samples are added by one thread, the offset can be read from any
+ * thread.
+ */
+class clock_offset_estimator_t {
+public:
+  clock_offset_estimator_t(size_t N = 64);
+  /**
+   * Add a ping.
+   * @param t1 Local send time in nanoseconds
+   * @param t2 Peer time stamp in nanoseconds
+   * @param t4 Local receive time in nanoseconds
+   */
+  void add_sample(timestamp_ns_t t1, timestamp_ns_t t2, timestamp_ns_t t4);
+  /**
+   * Return true if at least one sample was added.
+   */
+  bool is_valid() const { return valid.load(std::memory_order_acquire); };
+  /**
+   * Offset of peer clock relative to local clock, in nanoseconds.
+   */
+  timestamp_ns_t get_offset() const
+  {
+    return offset.load(std::memory_order_relaxed);
+  };
+  /**
+   * Split a round trip into one-way delays, using the current offset.
+   * @param t1 Local send time in nanoseconds
+   * @param t2 Peer time stamp in nanoseconds
+   * @param t4 Local receive time in nanoseconds
+   * @param[out] up Delay to peer in milliseconds
+   * @param[out] down Delay from peer in milliseconds
+   */
+  void get_oneway(timestamp_ns_t t1, timestamp_ns_t t2, timestamp_ns_t t4,
+                  double& up, double& down) const;
+
+private:
+  // pairs of round trip time and offset, used only by the writer
+  // thread:
+  std::vector<std::pair<timestamp_ns_t, timestamp_ns_t>> samples;
   size_t idx;
   size_t filled;
-  double sum;
+  // the result is published to other threads:
+  std::atomic<timestamp_ns_t> offset;
+  std::atomic_bool valid;
+};
+
+/**
+ * Adaptive ping interval of one peer and path.
+ *
+ * While the round trip time is unstable or pings are lost, a ping is
+ * sent in every ping period. After a number of steady round trip
+ * times the interval is doubled, up to a maximum interval. tick() is
+ * called from the ping thread, add_value() from the receiver thread.
+ */
+class ping_rate_t {
+public:
+  ping_rate_t();
+  /**
+   * Advance by one ping period.
+   * @return True if a ping should be sent in this period
+   */
+  bool tick();
+  /**
+   * Register a received pong.
+   * @param tms Round trip time in milliseconds
+   */
+  void add_value(double tms);
+  /**
+   * Current ping interval, in ping periods.
+   */
+  uint32_t get_interval() const { return interval; };
+  /**
+   * Smoothed round trip time in milliseconds, or -1 if unknown.
+   */
+  double get_srtt() const { return srtt; };
+  /**
+   * Number of steady round trip times after which the interval is doubled.
+   */
+  static constexpr uint32_t steadycount = 10;
+  /**
+   * Maximum ping interval, in ping periods.
+   */
+  static constexpr uint32_t maxinterval = 10;
+
+private:
+  void set_unstable();
+  std::atomic<uint32_t> interval;
+  std::atomic<uint32_t> steady;
+  std::atomic_bool waiting;
+  std::atomic<double> srtt;
+  double rttvar;
+  uint32_t since_sent;
+};
+
+/**
+ * Transmission path to a peer.
+ */
+enum path_t {
+  /// direct to public address of peer
+  PATH_P2P,
+  /// direct to local address of peer in same network
+  PATH_LOCAL,
+  /// via relay server
+  PATH_SERVER
+};
+
+/**
+ * Select the transmission path to a peer from ping statistics.
+ *
+ * The direct paths (peer-to-peer and local network) are scored by
+ * their median round trip time, with a penalty for jitter (difference
+ * between 99th percentile and median) and for loss. The selected path
+ * is changed only if another path is better by a margin in a number
+ * of consecutive updates. The server path is not a candidate, since
+ * the server does not forward messages between peer-to-peer devices.
+ *
+ * update() is called by one thread, set_path() by another one; both
+ * write only the atomic selection, which can be read from any thread.
+ */
+class path_selector_t {
+public:
+  path_selector_t();
+  /**
+   * Register a sent ping.
+   * @param p Path of ping, pings on other paths than the candidates
+   * are ignored
+   */
+  void add_sent(path_t p);
+  /**
+   * Register a received pong.
+   * @param p Path of ping
+   * @param tms Round trip time in milliseconds
+   */
+  void add_value(path_t p, double tms);
+  /**
+   * Evaluate the statistics since the last update.
+   * @return True if the selected path has changed
+   */
+  bool update();
+  /**
+   * Use a path selected by the peer.
+   * @param p New path, other paths than the candidates are ignored
+   */
+  void set_path(path_t p);
+  /**
+   * Get the selected path.
+   * @param[out] p Selected path, unchanged if no path was selected
+   * @return True if a path was selected
+   */
+  bool get_path(path_t& p) const
+  {
+    int sel(selected.load(std::memory_order_relaxed));
+    if(sel < 0)
+      return false;
+    p = (path_t)sel;
+    return true;
+  };
+  /**
+   * Return the selected path, or PATH_P2P if no path was selected.
+   */
+  path_t get_path() const
+  {
+    path_t p(PATH_P2P);
+    get_path(p);
+    return p;
+  };
+  /**
+   * Return true if a path was selected.
+   */
+  bool is_valid() const
+  {
+    return selected.load(std::memory_order_relaxed) >= 0;
+  };
+  /**
+   * Score of a path, lower is better.
+   * @param ps Ping statistics of path, the 10 s window is used
+   * @return Score in milliseconds, or HUGE_VAL if the path was not
+   * measured
+   */
+  static double score(const ping_stat_t& ps);
+  /**
+   * Score difference required for a change of path, in milliseconds.
+   */
+  static constexpr double margin = 5.0;
+  /**
+   * Number of consecutive updates required for a change of path.
+   */
+  static constexpr uint32_t holdcount = 3;
+  /**
+   * Number of candidate paths, PATH_P2P and PATH_LOCAL.
+   */
+  static constexpr uint32_t numpaths = 2;
+
+private:
+  ping_stat_collecor_t stat[numpaths];
+  // used only by update():
+  ping_stat_t ps[numpaths];
+  path_t candidate;
+  uint32_t count;
+  // selected path, or -1 if none:
+  std::atomic<int> selected;
 };
 
+/**
+ * Estimate the trend of a delay.
+ *
+ * A line is fitted by least squares to the last N pairs of time and
+ * delay. A positive slope indicates growing queues on the path, long
+ * before packets are dropped. The state is overuse if the slope is
+ * above the threshold, and underuse if it is below the negative
+ * threshold.
+ *
+ * Samples are added by one thread into storage of fixed size, only
+ * the atomic gradient is read by other threads.
+ */
+class delay_gradient_t {
+public:
+  /**
+   * @param N Number of samples, at most maxsize
+   */
+  delay_gradient_t(size_t N = 20);
+  /**
+   * Add a delay sample.
+   * @param t Time in seconds
+   * @param delay Delay in milliseconds
+   */
+  void add_value(double t, double delay);
+  /**
+   * Slope of delay in milliseconds per second.
+   */
+  double get_gradient() const { return gradient; };
+  /**
+   * Congestion state derived from gradient.
+   */
+  congestion_t get_state() const;
+  /**
+   * Gradient threshold in ms/s.
+   */
+  static constexpr double threshold = 5.0;
+  /**
+   * Maximum number of samples.
+   */
+  static constexpr size_t maxsize = 64;
+
+private:
+  std::pair<double, double> data[maxsize];
+  size_t size;
+  size_t idx;
+  size_t filled;
+  std::atomic<double> gradient;
+};
+
+/**
+ * Select peers which are served via relay to meet an upload budget.
+ *
+ * If sending one copy of the stream to each peer exceeds the budget,
+ * the peers with the longest round trip time are served by a single
+ * copy via the relay, and the remaining budget is used for direct
+ * transmission to the peers with the shortest round trip time.
+ *
+ * @param peers Pairs of round trip time and device ID of peers which
+ * are served directly
+ * @param streamrate Rate of one copy of the stream, in kbit/s
+ * @param budget Upload budget in kbit/s, or zero for no limit
+ * @return Device IDs of peers which should be served via relay
+ */
+std::vector<stage_device_id_t>
+get_relayed_peers(std::vector<std::pair<double, stage_device_id_t>> peers,
+                  double streamrate, double budget);
+
 /**
  * Sort out-of-order messages.
  *
@@ -52,28 +508,180 @@ private:
  */
 class message_sorter_t {
 public:
+  message_sorter_t();
   bool process(msgbuf_t** msg);
-  message_stat_t get_stat(stage_device_id_t id);
+  /**
+   * Process a message which arrived at a given time.
+   * @param msg Pointer to message buffer pointer
+   * @param t Arrival time in milliseconds
+   */
+  bool process(msgbuf_t** msg, double t);
+  /**
+   * Get a consistent copy of the message statistics of a sender.
+   *
+   * This method can be called from any thread.
+   */
+  message_stat_t get_stat(stage_device_id_t id) const;
+  /**
+   * Get the sequence error detected in the last received message.
+   *
+   * @param[out] cid Device ID of sender
+   * @param[out] expected Expected sequence number
+   * @param[out] received Received sequence number
+   * @param[out] destport Destination port of message
+   * @return True if a sequence error was detected since the last call
+   */
+  bool get_seqerr(stage_device_id_t& cid, sequence_t& expected,
+                  sequence_t& received, port_t& destport);
 
 private:
-  inline sequence_t deltaseq(std::map<stage_device_id_t, sequence_map_t>& seq,
-                             const msgbuf_t& msg)
-  {
-    sequence_t dseq_(msg.seq - seq[msg.cid][msg.destport]);
-    seq[msg.cid][msg.destport] = msg.seq;
-    return dseq_;
+  /**
+   * Last input and output sequence numbers of one stream.
+   */
+  class seqslot_t {
+  public:
+    seqslot_t() : port(0), has_in(false), in(0), out(0){};
+    // destination port, 0 marks unused slots:
+    port_t port;
+    bool has_in;
+    sequence_t in;
+    sequence_t out;
   };
-  inline sequence_t
-  deltaseq_const(std::map<stage_device_id_t, sequence_map_t>& seq,
-                 const msgbuf_t& msg)
+  // return the sequence slot of the stream of a message:
+  seqslot_t& get_seq(const msgbuf_t& msg);
+  // return the output sequence difference, and store the sequence
+  // number:
+  sequence_t deltaseq_out(const msgbuf_t& msg)
   {
-    return msg.seq - seq[msg.cid][msg.destport];
+    seqslot_t& sq(get_seq(msg));
+    sequence_t dseq(msg.seq - sq.out);
+    sq.out = msg.seq;
+    return dseq;
   };
-  std::map<stage_device_id_t, sequence_map_t> seq_in;
-  std::map<stage_device_id_t, sequence_map_t> seq_out;
+  // sequence numbers by device ID and stream, the last device entry
+  // collects invalid device IDs; no lookup allocates memory:
+  seqslot_t seqs[MAX_STAGE_ID + 1][MESSAGE_SORTER_PORTS];
   msgbuf_t buf1;
   msgbuf_t buf2;
-  std::map<stage_device_id_t, message_stat_t> stat;
+  // arrival time of the held back message in buf1, in ms:
+  double t_buf1;
+  /**
+   * Arrival timing of one stream.
+   *
+   * Messages carry no sender time stamp, thus the sender spacing of
+   * two messages is the difference of their sequence numbers times
+   * the mean packet period.
+   */
+  class stream_t {
+  public:
+    stream_t();
+    /**
+     * Register an arrival.
+     *
+     * Missing messages are counted as lost when they are
+     * MESSAGE_REORDER_WINDOW messages older than the newest one, thus
+     * late messages within the window are counted as received.
+     */
+    void add_arrival(sequence_t seq, double t);
+    std::atomic<port_t> port;
+    std::atomic<double> jitter;
+    std::atomic<double> period;
+    std::atomic<size_t> iat[IAT_BINS];
+    std::atomic<size_t> good;
+    std::atomic<size_t> lost;
+    std::atomic<size_t> bursts;
+    std::atomic<size_t> burst[LOSS_BINS];
+    std::atomic<size_t> gap[GAP_BINS];
+
+  private:
+    void add_loss(size_t n);
+    // count messages which left the reorder window, up to seq:
+    void commit(sequence_t seq);
+    // used only by the writer thread:
+    size_t run;
+    size_t burstlen;
+    bool has_last;
+    sequence_t seq_last;
+    double t_last;
+    // next message to be counted as received or lost:
+    sequence_t seq_commit;
+    // bit k is set if message seq_last-k is missing:
+    uint64_t missing;
+  };
+  class alignas(64) stat_t {
+  public:
+    stat_t();
+    stream_t& get_stream(port_t port);
+    std::atomic<size_t> received;
+    std::atomic<size_t> lost;
+    std::atomic<size_t> seqerr_in;
+    std::atomic<size_t> seqerr_out;
+    std::atomic<double> holdtime;
+    stream_t streams[MESSAGE_STAT_STREAMS];
+  };
+  bool process_(msgbuf_t** msg, double t);
+  stat_t& get_stat_slot(stage_device_id_t cid)
+  {
+    return stat[std::min((size_t)cid, (size_t)MAX_STAGE_ID)];
+  };
+  // message statistics, the last entry collects invalid device IDs:
+  stat_t stat[MAX_STAGE_ID + 1];
+  seqlock_t statlock;
+  bool has_seqerr;
+  stage_device_id_t seqerr_cid;
+  sequence_t seqerr_expected;
+  sequence_t seqerr_received;
+  port_t seqerr_port;
+};
+
+/**
+ * Event for callbacks which are called outside of the real-time
+ * threads.
+ */
+class callback_event_t {
+public:
+  enum { PING, SEQERR } type;
+  stage_device_id_t cid;
+  // ping time in milliseconds:
+  double tms;
+  endpoint_t ep;
+  sequence_t expected;
+  sequence_t received;
+  port_t destport;
+};
+
+/**
+ * Detect duplicate messages.
+ *
+ * For each sender and destination port, the sequence numbers of the
+ * most recent messages are stored. A message is a duplicate if its
+ * sequence number was seen before. Messages which are much older
+ * than the most recent message restart the sequence, e.g., after a
+ * restart of the sending device.
+ */
+class duplicate_filter_t {
+public:
+  /**
+   * Check if a message is a duplicate, and store its sequence number.
+   * @param msg Message to test
+   * @return True if the message was processed before
+   */
+  bool is_duplicate(const msgbuf_t& msg);
+
+private:
+  class window_t {
+  public:
+    window_t() : port(0), seq(0), mask(0){};
+    // destination port, 0 marks unused slots:
+    port_t port;
+    // most recent sequence number:
+    sequence_t seq;
+    // bit k is set if message seq-k was received:
+    uint64_t mask;
+  };
+  // windows by device ID and stream, the last device entry collects
+  // invalid device IDs; no lookup allocates memory:
+  window_t windows[MAX_STAGE_ID + 1][MESSAGE_SORTER_PORTS];
 };
 
 /**
@@ -113,6 +721,36 @@ public:
   void announce_latency(stage_device_id_t cid, double lmin, double lmean,
                         double lmax, uint32_t received, uint32_t lost);
   void add_extraport(port_t dest);
+  /**
+   * Replace the list of additional local port offsets.
+   * @param dest Port offsets, data is sent to destination port plus offset
+   */
+  void set_extraports(const std::vector<port_t>& dest);
+  /**
+   * Deliver data messages for a local port to a function instead of
+   * sending them to localhost.
+   * @param port Local port, i.e., destination port plus offset
+   * @param sink Function which is called by the network threads with
+   * message and length, or an empty function to remove the sink
+   *
+   * After removal or replacement of a function this method returns
+   * when no network thread is calling the old function any more.
+   */
+  void set_local_sink(port_t port,
+                      std::function<void(const char*, size_t)> sink);
+  /**
+   * Change the operation mode while the session is running.
+   * @param mode New mode bit mask, see \ref operationmodes
+   *
+   * The new mode is used by all threads for the next message, and is
+   * announced to the server with the next registration.
+   */
+  void set_mode(epmode_t mode);
+  epmode_t get_mode() const { return mode; };
+  /**
+   * Allow or disallow sending to local IP address if in same network.
+   */
+  void set_sendlocal(bool sendlocal);
   /**
      \brief Add a proxy client
      \ingroup proxymode
@@ -125,11 +763,87 @@ public:
      own audio will be forwarded to the proxy clients.
    */
   void add_proxy_client(stage_device_id_t cid, const std::string& host);
+  /**
+     \brief Replace the list of proxy clients
+     \ingroup proxymode
+
+     \param clients Map of device IDs to hostname or IP address
+   */
+  void set_proxy_clients(
+      const std::map<stage_device_id_t, std::string>& clients);
+  /**
+     \brief Publish data to proxy clients via a multicast group
+     \ingroup proxymode
+
+     \param group IP address of multicast group
+     \param port Port number of multicast group
+
+     If a multicast group is set, then a proxy device sends each
+     message from outside the local network only once to the
+     multicast group instead of sending a copy to each proxy
+     client. Proxy clients confirm the reception of the group with
+     PORT_MCASTACK messages. Clients without a recent confirmation,
+     e.g., because they could not join the group, are still served by
+     unicast. If the socket can not be configured for multicast, all
+     proxy clients are served by unicast.
+   */
+  void set_proxy_multicast(const std::string& group, port_t port);
+  /**
+     \brief Receive data from the proxy via a multicast group
+     \ingroup proxymode
+
+     \param group IP address of multicast group
+     \param port Port number of multicast group
+
+     Messages received from the multicast group are forwarded to
+     localhost like messages received from the server or from peers,
+     and their reception is confirmed to the proxy. If the group can
+     not be joined, the proxy continues to send by unicast.
+   */
+  void join_proxy_multicast(const std::string& group, port_t port);
+  /**
+     \brief Add a relay client
+     \ingroup proxymode
+
+     \param cid Device ID of relay client
+
+     A device with relay clients serves as a node in a relay tree: All
+     messages received from the server or from peers are forwarded
+     to the relay clients, except those originating from the client
+     itself. Also the own audio is sent to the relay clients. Relay
+     clients can be in any network, their address is taken from the
+     session endpoint list. Only clients which use a proxy (mode flag
+     B_USINGPROXY) are served. A relay client can have relay clients
+     itself.
+   */
+  void add_relay_client(stage_device_id_t cid);
+  /**
+     \brief Replace the list of relay clients
+     \ingroup proxymode
+   */
+  void set_relay_clients(const std::vector<stage_device_id_t>& clients);
   void add_receiverport(port_t srcport_t, port_t destport_t);
+  /**
+   * Replace all receiver ports.
+   * @param ports List of pairs of local source port and destination port
+   *
+   * Receivers of ports which are not in the list are stopped, new
+   * receivers are started.
+   */
+  void set_receiverports(const std::vector<std::pair<port_t, port_t>>& ports);
   void set_ping_callback(
       std::function<void(stage_device_id_t, double, const endpoint_t&, void*)>
           f,
       void* d);
+  /**
+   * Return the bit rates since the previous call.
+   * @param[out] txrate Sent bits per second
+   * @param[out] rxrate Received bits per second
+   *
+   * The rates are computed from a private snapshot of the traffic
+   * counters, thus only one thread should call this method. Other
+   * readers should use get_traffic() with their own snapshots.
+   */
   void getbitrate(double& txrate, double& rxrate);
   void set_seqerr_callback(std::function<void(stage_device_id_t, sequence_t,
                                               sequence_t, port_t, void*)>
@@ -147,16 +861,168 @@ public:
    * socket
    */
   void set_expedited_forwarding_PHB();
+  /**
+   * Adapt the ping rate to the stability of the connection.
+   * @param adaptive Use adaptive ping rate (true) or send pings in each
+   * ping period (false, default)
+   */
+  void set_adaptive_ping(bool adaptive) { adaptive_ping = adaptive; };
+  /**
+   * Send pings via server to all peers in a single message.
+   *
+   * This requires a server which can distribute messages of type
+   * PORT_PING_SRV_MULTI to the listed peers. The server announces this
+   * with B_SRVMULTIPING in the device list, without it single pings
+   * are sent.
+   */
+  void set_multi_server_ping(bool multi) { multi_server_ping = multi; };
+  /**
+   * Select the transmission path to each peer automatically.
+   *
+   * The direct path (peer-to-peer or local network) is selected from
+   * the ping statistics of the last seconds, and announced to the
+   * peer with PORT_PATHSEL. Of two peers, the device with the lower
+   * device ID decides, the other follows. Peers which do not announce
+   * B_EXTCONTROL keep the default path.
+   */
+  void set_path_selection(bool enable) { path_selection = enable; };
+  /**
+   * Set the upload budget for peer-to-peer transmission.
+   * @param kbps Budget in kbit/s, or zero for no limit
+   *
+   * If the rate of the own stream times the number of peer-to-peer
+   * peers exceeds the budget, the peers with the longest round trip
+   * time are served via server. This is done only if the server
+   * forwards messages between peer-to-peer devices, see
+   * set_server_relay(), otherwise the budget has no effect.
+   */
+  void set_upload_budget(double kbps) { upload_budget = kbps; };
+  /**
+   * Declare that the server forwards messages between peer-to-peer
+   * devices.
+   * @param relay True if the server forwards to peer-to-peer devices
+   *
+   * The default server forwards only to devices in server mode, thus
+   * the default is false.
+   */
+  void set_server_relay(bool relay) { server_relay = relay; };
+  /**
+   * Return the measured rate of the own stream in kbit/s.
+   */
+  double get_stream_rate() const { return streamrate; };
+  /**
+   * Return the congestion state of the path to and from a peer.
+   * @param cid Device ID of peer
+   * @param[out] up Congestion state of path to peer
+   * @param[out] down Congestion state of path from peer
+   */
+  void get_congestion(stage_device_id_t cid, congestion_t& up,
+                      congestion_t& down) const;
+  /**
+   * Get a consistent copy of the ping statistics of a peer.
+   * @param cid Device ID of peer
+   * @param path Path of pings
+   * @param[out] s Snapshot
+   *
+   * This method can be called from any thread.
+   */
+  void get_ping_snapshot(stage_device_id_t cid, path_t path,
+                         ping_snapshot_t& s) const;
+  /**
+   * Return the path currently used for sending to a peer.
+   */
+  path_t get_path(stage_device_id_t cid) const;
+  /**
+   * Start recording of packet headers.
+   * @param filename Name of trace file, see packet_trace_t
+   */
+  void start_trace(const std::string& filename) { trace.start(filename); };
+  /**
+   * Stop recording of packet headers.
+   */
+  void stop_trace() { trace.stop(); };
+  /**
+   * Pass the data messages of a packet trace through a new message
+   * sorter and the message processing of this client.
+   * @param replay Loaded trace, receives processing cost and delivery
+   * order
+   * @param realtime Keep the recorded timing if true, otherwise replay
+   * as fast as possible
+   * @param deadline Reorder deadline in ms, see set_reorder_deadline()
+   *
+   * Messages are forwarded like received ones, i.e., to the local
+   * ports and to proxy and relay clients. For benchmarking, create a
+   * client with unused local ports and without a running session.
+   */
+  void replay(trace_replay_t& replay, bool realtime, double deadline = 5.0);
+  /**
+   * Return all counters in Prometheus text exposition format.
+   *
+   * Only lock-free snapshots are read, thus this method can be
+   * called from any thread without disturbing the network threads.
+   */
+  std::string get_metrics() const;
+  /**
+   * Read the traffic counters of all network threads.
+   * @param[out] s Snapshot
+   *
+   * Reading does not modify the counters. Rates can be computed from
+   * two snapshots, see traffic_snapshot_t::get_rate(). This method
+   * can be called from any thread.
+   */
+  void get_traffic(traffic_snapshot_t& s) const { traffic.get_snapshot(s); };
 
 private:
   void sendsrv();
   void recsrv();
-  void xrecsrv(port_t srcport, port_t destport);
+  void xrecsrv(port_t srcport, port_t destport, stop_signal_t* stop);
+  void mcrecsrv(endpoint_t group);
   void pingservice();
+  void update_path(stage_device_id_t cid, const ep_desc_t& ep,
+                   traffic_counter_t::writer_t& trafficw);
+  void update_fanout(double dt);
+  bool is_data_path(port_t pongport) const;
+  void cbservice();
   void handle_endpoint_list_update(stage_device_id_t cid, const endpoint_t& ep);
-  void process_msg(msgbuf_t& msg);
-  void process_ping_msg(msgbuf_t& msg);
+  // process a received message; each thread which calls this needs
+  // its own duplicate filter:
+  void process_msg(msgbuf_t& msg, duplicate_filter_t& dupl,
+                   packet_trace_t::writer_t& tracew,
+                   traffic_counter_t::writer_t& trafficw);
+  void process_ping_msg(msgbuf_t& msg, packet_trace_t::writer_t& tracew,
+                        traffic_counter_t::writer_t& trafficw);
   void process_pong_msg(msgbuf_t& msg);
+  // deliver a data message to a local port or its sink:
+  void send_local(udpsocket_t& sock, const char* msg, size_t len, port_t port);
+  bool is_relay_client(stage_device_id_t cid) const;
+  void send_to_relay_clients(const char* msg, size_t len,
+                             stage_device_id_t origin,
+                             const endpoint_t& sender,
+                             packet_trace_t::writer_t& tracew,
+                             traffic_counter_t::writer_t& trafficw);
+  // send a packed message, count it in the traffic slot of the
+  // receiver and add it to the packet trace:
+  void send_packed(const char* msg, size_t len, const endpoint_t& ep,
+                   size_t slot, packet_trace_t::writer_t& tracew,
+                   traffic_counter_t::writer_t& trafficw)
+  {
+    if(remote_server.send(msg, len, ep) > 0)
+      trafficw.add_tx(slot, msg_port((char*)msg), len);
+    tracew.add_sent(msg, len, ep);
+  };
+  // send a packed message to the server:
+  void send_packed(const char* msg, size_t len, port_t port,
+                   packet_trace_t::writer_t& tracew,
+                   traffic_counter_t::writer_t& trafficw)
+  {
+    if(remote_server.send(msg, len, port) > 0)
+      trafficw.add_tx(TRAFFIC_SERVER, msg_port((char*)msg), len);
+    if(trace.is_active()) {
+      endpoint_t ep(remote_server.get_destination());
+      ep.sin_port = htons(port);
+      tracew.add_sent(msg, len, ep);
+    }
+  };
 
   // real time priority:
   const int prio;
@@ -167,12 +1033,31 @@ private:
   // local UDP receiver:
   udpsocket_t local_server;
   // additional port offsets to send data to locally:
-  std::vector<port_t> xdest;
+  live_config_t<std::vector<port_t>> xdest;
+  // functions receiving data messages instead of local ports:
+  live_config_t<std::map<port_t, std::function<void(const char*, size_t)>>>
+      localsinks;
   /**
    * \brief list of proxy clients:
    * \ingroup proxymode
    */
-  std::map<stage_device_id_t, endpoint_t> proxyclients;
+  live_config_t<std::map<stage_device_id_t, endpoint_t>> proxyclients;
+  /**
+   * \brief multicast group for serving proxy clients
+   * \ingroup proxymode
+   */
+  endpoint_t proxy_mcast_ep;
+  bool proxy_mcast;
+  /**
+   * \brief time of last multicast confirmation of each proxy client
+   * \ingroup proxymode
+   */
+  std::atomic<timestamp_ns_t> mcast_ack[MAX_STAGE_ID];
+  /**
+   * \brief list of relay clients
+   * \ingroup proxymode
+   */
+  live_config_t<std::vector<stage_device_id_t>> relayclients;
   // destination port of relay server:
   port_t toport;
   // receiver ports:
@@ -182,31 +1067,68 @@ private:
   port_t portoffset;
   // client/caller identification (aka 'chair' in the lobby system):
   stage_device_id_t callerid;
-  bool runsession;
+  // stop request of all threads, which also interrupts their waits:
+  stop_signal_t stopsig;
   std::thread sendthread;
   std::thread recthread;
   std::thread pingthread;
-  std::vector<std::thread> xrecthread;
-  epmode_t mode;
+  class xrecthread_t {
+  public:
+    port_t destport;
+    stop_signal_t stop;
+    std::thread thread;
+  };
+  // receiver threads, key is source port:
+  std::map<port_t, xrecthread_t*> xrecthreads;
+  std::mutex xrecthreadlock;
+  std::thread mcrecthread;
+  std::thread cbthread;
+  std::atomic<epmode_t> mode;
   endpoint_t localep;
   std::function<void(stage_device_id_t, double, const endpoint_t&, void*)>
       cb_ping;
   void* cb_ping_data;
-  bool sendlocal;
-  size_t last_tx;
-  size_t last_rx;
-  std::chrono::high_resolution_clock::time_point t_bitrate;
+  std::atomic_bool sendlocal;
+  // previous traffic counts of getbitrate():
+  traffic_snapshot_t bitrate_state;
   std::function<void(stage_device_id_t sender, sequence_t expected,
                      sequence_t received, port_t destport, void* data)>
       cb_seqerr;
   void* cb_seqerr_data;
+  // events from receive thread to callback thread:
+  spsc_queue_t<callback_event_t, 256> cb_events;
   msgbuf_t* msgbuffers;
   message_sorter_t sorter;
-  // std::map<stage_device_id_t, message_stat_t> stats;
-  std::map<stage_device_id_t, ping_stat_collecor_t> ping_stat_collecors_p2p;
-  std::map<stage_device_id_t, ping_stat_collecor_t> ping_stat_collecors_srv;
-  std::map<stage_device_id_t, ping_stat_collecor_t> ping_stat_collecors_local;
-  std::map<stage_device_id_t, client_stats_t> client_stats_announce;
+  duplicate_filter_t duplicates;
+  ping_stat_collecor_t ping_stat_collecors_p2p[MAX_STAGE_ID];
+  ping_stat_collecor_t ping_stat_collecors_srv[MAX_STAGE_ID];
+  ping_stat_collecor_t ping_stat_collecors_local[MAX_STAGE_ID];
+  std::atomic_bool adaptive_ping;
+  std::atomic_bool multi_server_ping;
+  ping_rate_t ping_rates_p2p[MAX_STAGE_ID];
+  ping_rate_t ping_rates_srv[MAX_STAGE_ID];
+  ping_rate_t ping_rates_local[MAX_STAGE_ID];
+  clock_offset_estimator_t clock_offsets[MAX_STAGE_ID];
+  std::atomic_bool path_selection;
+  path_selector_t path_selectors[MAX_STAGE_ID];
+  // upload budget in kbit/s:
+  std::atomic<double> upload_budget;
+  // the server forwards messages between peer-to-peer devices:
+  std::atomic_bool server_relay;
+  // rate of own stream in kbit/s:
+  std::atomic<double> streamrate;
+  std::atomic<size_t> streambytes;
+  size_t last_streambytes;
+  // peers which are served via server to meet the upload budget:
+  std::atomic_bool fanout_relayed[MAX_STAGE_ID];
+  // traffic counters of the network threads:
+  traffic_counter_t traffic;
+  // delay trends of the data path:
+  delay_gradient_t gradient_up[MAX_STAGE_ID];
+  delay_gradient_t gradient_down[MAX_STAGE_ID];
+  delay_gradient_t gradient_rtt[MAX_STAGE_ID];
+  client_stats_t client_stats_announce[MAX_STAGE_ID];
+  packet_trace_t trace;
 };
 
 #endif
@@ -0,0 +1,265 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packettrace.h"
+#include "errmsg.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <vector>
+
+#define TRACE_MAGIC "OVTRACE1"
+
+packet_trace_t::packet_trace_t()
+    : active(false), runflush(false), dropped(0u), fh(NULL)
+{
+}
+
+packet_trace_t::~packet_trace_t()
+{
+  stop();
+}
+
+void packet_trace_t::start(const std::string& filename)
+{
+  stop();
+  std::lock_guard<std::mutex> lk(mtx);
+  fh = fopen(filename.c_str(), "wb");
+  if(!fh)
+    throw ErrMsg("Unable to create trace file \"" + filename + "\"", errno);
+  uint32_t recsize(sizeof(trace_record_t));
+  int64_t t_wall(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count());
+  int64_t t_steady(get_timestamp_ns());
+  fwrite(TRACE_MAGIC, 1, 8, fh);
+  fwrite(&recsize, sizeof(recsize), 1, fh);
+  fwrite(&t_wall, sizeof(t_wall), 1, fh);
+  fwrite(&t_steady, sizeof(t_steady), 1, fh);
+  // discard records from previous traces:
+  trace_record_t r;
+  for(auto& ring : rings)
+    while(ring.pop(r)) {
+    }
+  runflush = true;
+  flushthread = std::thread(&packet_trace_t::flushsrv, this);
+  active = true;
+}
+
+void packet_trace_t::stop()
+{
+  active = false;
+  runflush = false;
+  if(flushthread.joinable())
+    flushthread.join();
+  std::lock_guard<std::mutex> lk(mtx);
+  if(fh) {
+    flush();
+    fclose(fh);
+    fh = NULL;
+  }
+}
+
+void packet_trace_t::flush()
+{
+  if(!fh)
+    return;
+  trace_record_t r;
+  for(auto& ring : rings)
+    while(ring.pop(r))
+      fwrite(&r, sizeof(r), 1, fh);
+  fflush(fh);
+}
+
+void packet_trace_t::flushsrv()
+{
+  while(runflush) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::lock_guard<std::mutex> lk(mtx);
+    flush();
+  }
+}
+
+packet_trace_t::writer_t::writer_t(packet_trace_t& trace) : trace(trace)
+{
+  std::lock_guard<std::mutex> lk(trace.mtx);
+  trace.rings.emplace_back();
+  ring = &(trace.rings.back());
+  // use the lowest free index, more than 256 writers share the last:
+  thread = 0;
+  while((thread < 255) && trace.threads.count(thread))
+    ++thread;
+  trace.threads.insert(thread);
+}
+
+packet_trace_t::writer_t::~writer_t()
+{
+  std::lock_guard<std::mutex> lk(trace.mtx);
+  // write remaining records before the ring is removed:
+  trace_record_t r;
+  while(ring->pop(r))
+    if(trace.fh)
+      fwrite(&r, sizeof(r), 1, trace.fh);
+  trace.threads.erase(trace.threads.find(thread));
+  for(auto it = trace.rings.begin(); it != trace.rings.end(); ++it)
+    if(&(*it) == ring) {
+      trace.rings.erase(it);
+      break;
+    }
+}
+
+std::vector<trace_record_t> read_packet_trace(const std::string& tracefile,
+                                              int64_t& t_wall,
+                                              int64_t& t_steady)
+{
+  FILE* fh(fopen(tracefile.c_str(), "rb"));
+  if(!fh)
+    throw ErrMsg("Unable to open trace file \"" + tracefile + "\"", errno);
+  char magic[8];
+  uint32_t recsize(0);
+  bool ok((fread(magic, 1, 8, fh) == 8) &&
+          (memcmp(magic, TRACE_MAGIC, 8) == 0) &&
+          (fread(&recsize, sizeof(recsize), 1, fh) == 1) &&
+          (recsize == sizeof(trace_record_t)) &&
+          (fread(&t_wall, sizeof(t_wall), 1, fh) == 1) &&
+          (fread(&t_steady, sizeof(t_steady), 1, fh) == 1));
+  if(!ok) {
+    fclose(fh);
+    throw ErrMsg("Invalid trace file \"" + tracefile + "\"");
+  }
+  std::vector<trace_record_t> recs;
+  trace_record_t r;
+  while(fread(&r, sizeof(r), 1, fh) == 1)
+    recs.push_back(r);
+  fclose(fh);
+  std::stable_sort(recs.begin(), recs.end(),
+                   [](const trace_record_t& a, const trace_record_t& b) {
+                     return a.t < b.t;
+                   });
+  return recs;
+}
+
+static const char* decision_name(uint8_t d)
+{
+  switch(d) {
+  case TRACE_DELIVERED:
+    return "delivered";
+  case TRACE_BUFFERED:
+    return "buffered";
+  case TRACE_REORDERED:
+    return "reordered";
+  case TRACE_RELEASED:
+    return "released";
+  case TRACE_SENT:
+    return "sent";
+  }
+  return "unknown";
+}
+
+void packet_trace_to_csv(const std::string& tracefile, std::ostream& out)
+{
+  int64_t t_wall(0);
+  int64_t t_steady(0);
+  std::vector<trace_record_t> recs(
+      read_packet_trace(tracefile, t_wall, t_steady));
+  out << "time,thread,dir,cid,destport,seq,size,addr,ipport,decision\n";
+  char ctmp[1024];
+  for(const auto& r : recs) {
+    endpoint_t ep;
+    memset(&ep, 0, sizeof(ep));
+    ep.sin_addr.s_addr = r.addr;
+    ep.sin_port = r.ipport;
+    snprintf(ctmp, sizeof(ctmp), "%1.6f,%d,%s,%d,%d,%d,%d,%s,%d,%s\n",
+             1e-9 * (double)(r.t - t_steady), r.thread,
+             (r.dir == TRACE_RX) ? "rx" : "tx", r.cid, r.destport, r.seq,
+             r.size, addr2str(ep.sin_addr).c_str(), ntohs(r.ipport),
+             decision_name(r.decision));
+    out << ctmp;
+  }
+}
+
+// internet checksum of an IPv4 header:
+static uint16_t ip_checksum(const uint8_t* p, size_t len)
+{
+  uint32_t sum(0);
+  for(size_t k = 0; k + 1 < len; k += 2)
+    sum += ((uint32_t)p[k] << 8) | p[k + 1];
+  while(sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t)(~sum);
+}
+
+void packet_trace_to_pcap(const std::string& tracefile,
+                          const std::string& pcapfile)
+{
+  int64_t t_wall(0);
+  int64_t t_steady(0);
+  std::vector<trace_record_t> recs(
+      read_packet_trace(tracefile, t_wall, t_steady));
+  FILE* fh(fopen(pcapfile.c_str(), "wb"));
+  if(!fh)
+    throw ErrMsg("Unable to create pcap file \"" + pcapfile + "\"", errno);
+  // pcap global header, link type 101 is raw IP:
+  uint32_t ghdr[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 101};
+  fwrite(ghdr, sizeof(ghdr), 1, fh);
+  const size_t caplen(20 + 8 + HEADERLEN);
+  for(const auto& r : recs) {
+    int64_t t(r.t - t_steady + t_wall);
+    size_t origlen(caplen + r.size);
+    uint32_t phdr[4] = {(uint32_t)(t / 1000000000),
+                        (uint32_t)((t % 1000000000) / 1000), (uint32_t)caplen,
+                        (uint32_t)origlen};
+    uint8_t pkg[caplen];
+    memset(pkg, 0, caplen);
+    // IPv4 header:
+    pkg[0] = 0x45;
+    pkg[2] = (uint8_t)(origlen >> 8);
+    pkg[3] = (uint8_t)(origlen & 0xff);
+    pkg[8] = 64;
+    pkg[9] = IPPROTO_UDP;
+    // addresses and ports are in network byte order:
+    uint16_t udplen(htons((uint16_t)(origlen - 20)));
+    if(r.dir == TRACE_RX) {
+      memcpy(&pkg[12], &r.addr, 4);
+      memcpy(&pkg[20], &r.ipport, 2);
+    } else {
+      memcpy(&pkg[16], &r.addr, 4);
+      memcpy(&pkg[22], &r.ipport, 2);
+    }
+    uint16_t csum(ip_checksum(pkg, 20));
+    pkg[10] = (uint8_t)(csum >> 8);
+    pkg[11] = (uint8_t)(csum & 0xff);
+    // UDP header, no checksum:
+    memcpy(&pkg[24], &udplen, 2);
+    // ovbox header without secret:
+    char* hdr((char*)(&pkg[28]));
+    msg_callerid(hdr) = r.cid;
+    msg_port(hdr) = r.destport;
+    msg_seq(hdr) = r.seq;
+    fwrite(phdr, sizeof(phdr), 1, fh);
+    fwrite(pkg, caplen, 1, fh);
+  }
+  fclose(fh);
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
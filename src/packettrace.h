@@ -0,0 +1,229 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PACKETTRACE_H
+#define PACKETTRACE_H
+
+#include "spscqueue.h"
+#include "udpsocket.h"
+#include <list>
+#include <mutex>
+#include <set>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/**
+ * Direction of a traced packet.
+ */
+enum trace_dir_t { TRACE_RX, TRACE_TX };
+
+/**
+ * Decision of the message sorter on a received packet, or TRACE_SENT
+ * for sent packets.
+ */
+enum trace_decision_t {
+  /// received packet was delivered immediately:
+  TRACE_DELIVERED,
+  /// received packet was held back to wait for a missing packet:
+  TRACE_BUFFERED,
+  /// a held back packet was delivered before the received packet:
+  TRACE_REORDERED,
+  /// a held back packet was delivered:
+  TRACE_RELEASED,
+  /// packet was sent:
+  TRACE_SENT
+};
+
+/**
+ * One entry of a packet trace, as stored in the trace file.
+ */
+class trace_record_t {
+public:
+  /// time stamp in nanoseconds, see get_timestamp_ns():
+  int64_t t;
+  /// IPv4 address of sender or receiver, network byte order:
+  uint32_t addr;
+  /// UDP port of sender or receiver, network byte order:
+  uint16_t ipport;
+  port_t destport;
+  /// size of unpacked message in bytes:
+  uint16_t size;
+  sequence_t seq;
+  stage_device_id_t cid;
+  /// direction, see trace_dir_t:
+  uint8_t dir;
+  /// sorter decision, see trace_decision_t:
+  uint8_t decision;
+  /// index of the writing thread, indices of closed threads are reused:
+  uint8_t thread;
+};
+
+/**
+ * Recorder of packet headers.
+ *
+ * Each network thread writes into its own lock-free ring buffer
+ * (packet_trace_t::writer_t). A background thread flushes the rings
+ * to a binary file. The file starts with the 8 characters "OVTRACE1",
+ * followed by the size of one record (uint32), the wall clock time
+ * in nanoseconds since 1970 at start (int64) and the matching
+ * get_timestamp_ns() value (int64). Then trace_record_t entries
+ * follow in host byte order, grouped by thread, i.e., not sorted by
+ * time.
+ *
+ * When tracing is not active, writing a record costs one atomic
+ * load. If a ring overflows, records are dropped.
+ */
+class packet_trace_t {
+public:
+  typedef spsc_queue_t<trace_record_t, 4096> ring_t;
+  packet_trace_t();
+  ~packet_trace_t();
+  /**
+   * Start recording into a file.
+   * @param filename Name of trace file, will be overwritten
+   */
+  void start(const std::string& filename);
+  /**
+   * Stop recording and close the file.
+   */
+  void stop();
+  bool is_active() const { return active.load(std::memory_order_relaxed); };
+  /**
+   * Number of records which were lost due to full rings.
+   *
+   * This method is lock-free and can be called from any thread.
+   */
+  size_t get_dropped() const
+  {
+    return dropped.load(std::memory_order_relaxed);
+  };
+
+  /**
+   * Ring buffer of one thread. It is registered while the writer
+   * exists.
+   */
+  class writer_t {
+  public:
+    writer_t(packet_trace_t& trace);
+    ~writer_t();
+    /**
+     * Add a record, if tracing is active.
+     * @param dir Direction
+     * @param decision Sorter decision
+     * @param cid Sender device ID
+     * @param destport Destination port of message
+     * @param seq Sequence number
+     * @param size Size of unpacked message
+     * @param ep Address of sender (rx) or receiver (tx)
+     */
+    void add(trace_dir_t dir, trace_decision_t decision, stage_device_id_t cid,
+             port_t destport, sequence_t seq, size_t size,
+             const endpoint_t& ep)
+    {
+      if(trace.is_active()) {
+        trace_record_t r;
+        r.t = get_timestamp_ns();
+        r.addr = ep.sin_addr.s_addr;
+        r.ipport = ep.sin_port;
+        r.destport = destport;
+        r.size = (uint16_t)size;
+        r.seq = seq;
+        r.cid = cid;
+        r.dir = dir;
+        r.decision = decision;
+        r.thread = thread;
+        if(!ring->push(r))
+          trace.dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    };
+    /**
+     * Add a record of a sent packed message.
+     * @param msg Packed message
+     * @param len Length of packed message
+     * @param ep Address of receiver
+     */
+    void add_sent(const char* msg, size_t len, const endpoint_t& ep)
+    {
+      if(trace.is_active() && (len >= HEADERLEN))
+        add(TRACE_TX, TRACE_SENT, msg_callerid((char*)msg),
+            msg_port((char*)msg), msg_seq((char*)msg), len - HEADERLEN, ep);
+    };
+
+  private:
+    packet_trace_t& trace;
+    ring_t* ring;
+    uint8_t thread;
+  };
+
+private:
+  void flushsrv();
+  // write all records in the rings to the file, needs lock:
+  void flush();
+  std::atomic_bool active;
+  std::atomic_bool runflush;
+  std::atomic<size_t> dropped;
+  mutable std::mutex mtx;
+  std::list<ring_t> rings;
+  // thread indices of the registered writers:
+  std::multiset<uint8_t> threads;
+  FILE* fh;
+  std::thread flushthread;
+};
+
+/**
+ * Read a trace file.
+ * @param tracefile Name of trace file
+ * @param[out] t_wall Wall clock time at start of trace in ns since 1970
+ * @param[out] t_steady Time stamp at start of trace, see get_timestamp_ns()
+ * @return Records sorted by time
+ */
+std::vector<trace_record_t> read_packet_trace(const std::string& tracefile,
+                                              int64_t& t_wall,
+                                              int64_t& t_steady);
+
+/**
+ * Convert a trace file to comma separated values, sorted by time.
+ * @param tracefile Name of trace file
+ * @param out Output stream
+ */
+void packet_trace_to_csv(const std::string& tracefile, std::ostream& out);
+
+/**
+ * Convert a trace file to a pcap file, sorted by time.
+ *
+ * Each record is stored as an IPv4/UDP packet with the ovbox header
+ * (without session secret) as payload. The audio data is not
+ * recorded, thus the captured length is shorter than the original
+ * length. The address of the local device is 0.0.0.0.
+ *
+ * @param tracefile Name of trace file
+ * @param pcapfile Name of pcap file, will be overwritten
+ */
+void packet_trace_to_pcap(const std::string& tracefile,
+                          const std::string& pcapfile);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
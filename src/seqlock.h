@@ -0,0 +1,117 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <thread>
+
+/**
+ * Add to an atomic variable which is written by one thread only.
+ *
+ * This is cheaper than fetch_add(), since no atomic read-modify-write
+ * operation is needed.
+ */
+template <class T> inline void relaxed_add(std::atomic<T>& a, T v)
+{
+  a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+/**
+ * Sequence lock for data with one writer thread and any number of
+ * reader threads.
+ *
+ * The writer never waits. A reader repeats reading until no write
+ * happened in between, thus it gets a consistent snapshot. The
+ * protected data itself must be stored in atomic variables, which
+ * can be accessed with relaxed memory order.
+ *
+ * Writer:
+ * \code
+ * {
+ *   seqlock_t::write_guard_t guard(lock);
+ *   relaxed_add(counter, 1u);
+ * }
+ * \endcode
+ *
+ * Reader:
+ * \code
+ * uint32_t s;
+ * do {
+ *   s = lock.read_begin();
+ *   value = counter.load(std::memory_order_relaxed);
+ * } while(lock.read_retry(s));
+ * \endcode
+ */
+class seqlock_t {
+public:
+  seqlock_t() : seq(0){};
+  void write_begin()
+  {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  };
+  void write_end()
+  {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+  };
+  uint32_t read_begin() const
+  {
+    uint32_t s(seq.load(std::memory_order_acquire));
+    while(s & 1) {
+      std::this_thread::yield();
+      s = seq.load(std::memory_order_acquire);
+    }
+    return s;
+  };
+  /**
+   * Return true if the data was modified since read_begin().
+   */
+  bool read_retry(uint32_t s) const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed) != s;
+  };
+  /**
+   * Mark a write section for the lifetime of the guard.
+   */
+  class write_guard_t {
+  public:
+    write_guard_t(seqlock_t& l) : lock(l) { lock.write_begin(); };
+    ~write_guard_t() { lock.write_end(); };
+
+  private:
+    seqlock_t& lock;
+  };
+
+private:
+  std::atomic<uint32_t> seq;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
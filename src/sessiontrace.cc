@@ -0,0 +1,122 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sessiontrace.h"
+#include "errmsg.h"
+#include <algorithm>
+#include <errno.h>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+session_trace_t::span_t::span_t(session_trace_t& trace,
+                                const std::string& name,
+                                const std::string& category)
+    : trace(trace), name(name), category(category),
+      t_start(get_timestamp_ns()), active(true)
+{
+}
+
+session_trace_t::span_t::~span_t()
+{
+  end();
+}
+
+void session_trace_t::span_t::end()
+{
+  if(active)
+    trace.add(name, category, t_start, get_timestamp_ns());
+  active = false;
+}
+
+session_trace_t::session_trace_t() {}
+
+uint32_t session_trace_t::get_thread_index()
+{
+  std::thread::id id(std::this_thread::get_id());
+  auto it(threads.find(id));
+  if(it != threads.end())
+    return it->second;
+  uint32_t idx(threads.size() + 1);
+  threads[id] = idx;
+  return idx;
+}
+
+void session_trace_t::add(const std::string& name, const std::string& category,
+                          int64_t t_start, int64_t t_end)
+{
+  std::lock_guard<std::mutex> lk(mtx);
+  event_t ev;
+  ev.name = name;
+  ev.category = category;
+  ev.t_start = t_start;
+  ev.t_end = t_end;
+  ev.thread = get_thread_index();
+  events.push_back(ev);
+}
+
+std::vector<session_trace_t::event_t> session_trace_t::get_events() const
+{
+  std::lock_guard<std::mutex> lk(mtx);
+  return events;
+}
+
+void session_trace_t::clear()
+{
+  std::lock_guard<std::mutex> lk(mtx);
+  events.clear();
+}
+
+std::string session_trace_t::to_json() const
+{
+  std::vector<event_t> evs(get_events());
+  // time stamps are relative to the first span:
+  int64_t t0(0);
+  if(!evs.empty())
+    t0 = evs.front().t_start;
+  for(const auto& ev : evs)
+    t0 = std::min(t0, ev.t_start);
+  nlohmann::json jsevs(nlohmann::json::array());
+  for(const auto& ev : evs)
+    jsevs.push_back({{"name", ev.name},
+                     {"cat", ev.category},
+                     {"ph", "X"},
+                     {"ts", 1e-3 * (double)(ev.t_start - t0)},
+                     {"dur", 1e-3 * (double)(ev.t_end - ev.t_start)},
+                     {"pid", 1},
+                     {"tid", ev.thread}});
+  nlohmann::json js({{"traceEvents", jsevs}, {"displayTimeUnit", "ms"}});
+  // invalid UTF-8 in names is replaced instead of throwing:
+  return js.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) +
+         "\n";
+}
+
+void session_trace_t::write(const std::string& filename) const
+{
+  std::ofstream ofh(filename);
+  if(!ofh.good())
+    throw ErrMsg("Unable to create session trace file \"" + filename + "\"",
+                 errno);
+  ofh << to_json();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,118 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SESSIONTRACE_H
+#define SESSIONTRACE_H
+
+#include "common.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Recorder of time spans, e.g., of the steps of a session start.
+ *
+ * Spans are collected in memory and written as a JSON file in the
+ * Chrome trace event format, which can be viewed in chrome://tracing
+ * or https://ui.perfetto.dev/. Recording a span costs two time stamps
+ * and one locked insertion, thus it is intended for non-real-time
+ * code only.
+ */
+class session_trace_t {
+public:
+  /**
+   * One recorded span.
+   */
+  class event_t {
+  public:
+    std::string name;
+    std::string category;
+    /// start time in ns, see get_timestamp_ns():
+    int64_t t_start;
+    /// end time in ns:
+    int64_t t_end;
+    /// index of the recording thread:
+    uint32_t thread;
+  };
+  /**
+   * Scoped span. The span starts on construction and ends on
+   * destruction or on end(), whatever comes first.
+   */
+  class span_t {
+  public:
+    span_t(session_trace_t& trace, const std::string& name,
+           const std::string& category = "session");
+    ~span_t();
+    span_t(const span_t&) = delete;
+    void end();
+
+  private:
+    session_trace_t& trace;
+    std::string name;
+    std::string category;
+    int64_t t_start;
+    bool active;
+  };
+  session_trace_t();
+  /**
+   * Add a span.
+   * @param name Name of span
+   * @param category Category of span
+   * @param t_start Start time in ns, see get_timestamp_ns()
+   * @param t_end End time in ns
+   */
+  void add(const std::string& name, const std::string& category,
+           int64_t t_start, int64_t t_end);
+  /**
+   * Return all spans which were recorded since the last clear().
+   */
+  std::vector<event_t> get_events() const;
+  /**
+   * Remove all spans.
+   */
+  void clear();
+  /**
+   * Return all spans in Chrome trace event format.
+   */
+  std::string to_json() const;
+  /**
+   * Write all spans in Chrome trace event format to a file.
+   * @param filename Name of output file, will be overwritten
+   *
+   * Upon error, an exception of type ErrMsg is thrown.
+   */
+  void write(const std::string& filename) const;
+
+private:
+  uint32_t get_thread_index();
+  mutable std::mutex mtx;
+  std::vector<event_t> events;
+  std::map<std::thread::id, uint32_t> threads;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -20,7 +20,15 @@
 #include "spawn_process.h"
 #include "errmsg.h"
 #include "string.h"
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
 #include <signal.h>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 spawn_process_t::spawn_process_t(const std::string& command)
     : h_pipe(NULL), pid(0)
@@ -51,6 +59,42 @@ spawn_process_t::~spawn_process_t()
     fclose(h_pipe);
 }
 
+bool spawn_process_t::is_running() const
+{
+  return (pid != 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+bool spawn_process_t::terminate(double timeout)
+{
+  if(pid == 0)
+    return true;
+  // open the pidfd before sending the signal, to avoid a race with
+  // reuse of the PID:
+  int fd(-1);
+#ifdef SYS_pidfd_open
+  fd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+  kill(pid, SIGTERM);
+  bool done(false);
+  if(fd >= 0) {
+    // the pidfd becomes readable when the process has terminated:
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    done = (poll(&pfd, 1, (int)(1000.0 * timeout)) > 0);
+    close(fd);
+  } else {
+    auto t_end(std::chrono::steady_clock::now() +
+               std::chrono::microseconds((int64_t)(1e6 * timeout)));
+    while(is_running() && (std::chrono::steady_clock::now() < t_end))
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    done = !is_running();
+  }
+  if(done)
+    pid = 0;
+  return done;
+}
+
 /*
  * Local Variables:
  * mode: c++
@@ -29,6 +29,19 @@ class spawn_process_t {
 public:
   spawn_process_t(const std::string& command);
   ~spawn_process_t();
+  /**
+   * Test if the process is still running.
+   */
+  bool is_running() const;
+  /**
+   * Stop the process and wait until it has terminated.
+   * @param timeout Maximum waiting time in seconds
+   * @return True if the process has terminated within the timeout
+   *
+   * On Linux the termination is signalled via a process file
+   * descriptor (pidfd), otherwise the process is polled.
+   */
+  bool terminate(double timeout);
 
 private:
   // on Linux we start the process in a pipe:
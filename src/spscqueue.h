@@ -0,0 +1,89 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lock-free queue for one producer thread and one consumer thread.
+ *
+ * Neither push() nor pop() allocate memory or block, thus they can
+ * be used in real-time threads.
+ *
+ * @tparam T Element type, needs to be copy-assignable
+ * @tparam N Number of elements, must be a power of two
+ */
+template <class T, size_t N> class spsc_queue_t {
+public:
+  spsc_queue_t() : wpos(0), rpos(0), dropped(0){};
+  /**
+   * Add an element to the queue (producer thread only).
+   * @param v Element to be added
+   * @return True on success, false if the queue is full
+   */
+  bool push(const T& v)
+  {
+    size_t w(wpos.load(std::memory_order_relaxed));
+    if(w - rpos.load(std::memory_order_acquire) >= N) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buf[w & (N - 1)] = v;
+    wpos.store(w + 1, std::memory_order_release);
+    return true;
+  };
+  /**
+   * Remove the oldest element from the queue (consumer thread only).
+   * @param v Reference to store element
+   * @return True on success, false if the queue is empty
+   */
+  bool pop(T& v)
+  {
+    size_t r(rpos.load(std::memory_order_relaxed));
+    if(r == wpos.load(std::memory_order_acquire))
+      return false;
+    v = buf[r & (N - 1)];
+    rpos.store(r + 1, std::memory_order_release);
+    return true;
+  };
+  /**
+   * Number of elements which were dropped because the queue was full.
+   */
+  size_t get_dropped() const { return dropped.load(std::memory_order_relaxed); };
+
+private:
+  static_assert((N & (N - 1)) == 0, "queue size must be a power of two");
+  std::array<T, N> buf;
+  alignas(64) std::atomic<size_t> wpos;
+  alignas(64) std::atomic<size_t> rpos;
+  std::atomic<size_t> dropped;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,151 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracereplay.h"
+#include <algorithm>
+#include <string.h>
+
+trace_replay_t::trace_replay_t(const std::string& tracefile)
+{
+  int64_t t_wall(0);
+  int64_t t_steady(0);
+  for(const auto& r : read_packet_trace(tracefile, t_wall, t_steady))
+    if((r.dir == TRACE_RX) && (r.decision != TRACE_RELEASED) &&
+       (r.destport > MAXSPECIALPORT))
+      packets.push_back(r);
+}
+
+void trace_replay_t::run(message_sorter_t& sorter,
+                         std::function<void(msgbuf_t&)> process,
+                         bool realtime, double deadline)
+{
+  cost.clear();
+  delivery.clear();
+  cost.reserve(packets.size());
+  delivery.reserve(2 * packets.size());
+  if(packets.empty())
+    return;
+  msgbuf_t msg;
+  msgbuf_t empty;
+  std::vector<char> payload(BUFSIZE, 0);
+  int64_t deadline_ns(1e6 * deadline);
+  int64_t t0(packets[0].t);
+  int64_t t_prev(t0);
+  std::chrono::steady_clock::time_point t_start(
+      std::chrono::steady_clock::now());
+  auto deliver = [&](msgbuf_t* pmsg, int64_t t, trace_decision_t decision) {
+    trace_record_t d;
+    memset(&d, 0, sizeof(d));
+    d.t = t;
+    d.cid = pmsg->cid;
+    d.destport = pmsg->destport;
+    d.seq = pmsg->seq;
+    d.size = pmsg->size;
+    d.dir = TRACE_RX;
+    d.decision = decision;
+    delivery.push_back(d);
+    process(*pmsg);
+  };
+  for(const auto& r : packets) {
+    if(realtime)
+      std::this_thread::sleep_until(t_start +
+                                    std::chrono::nanoseconds(r.t - t0));
+    if(r.t - t_prev > deadline_ns) {
+      // the receive timeout of the network thread releases held back
+      // messages:
+      int64_t t_timeout(t_prev + deadline_ns);
+      msgbuf_t* pmsg(&empty);
+      while(sorter.process(&pmsg, 1e-6 * t_timeout))
+        deliver(pmsg, t_timeout, TRACE_RELEASED);
+    }
+    t_prev = r.t;
+    msg.pack(0, r.cid, r.destport, r.seq, payload.data(),
+             std::min((size_t)r.size, (size_t)(BUFSIZE - HEADERLEN)));
+    memset(&msg.sender, 0, sizeof(msg.sender));
+    msg.sender.sin_family = AF_INET;
+    msg.sender.sin_addr.s_addr = r.addr;
+    msg.sender.sin_port = r.ipport;
+    timestamp_ns_t t1(get_timestamp_ns());
+    msgbuf_t* pmsg(&msg);
+    while(sorter.process(&pmsg, 1e-6 * r.t))
+      deliver(pmsg, r.t, (pmsg == &msg) ? TRACE_DELIVERED : TRACE_RELEASED);
+    cost.push_back(get_timestamp_ns() - t1);
+  }
+  // release remaining messages:
+  int64_t t_timeout(t_prev + deadline_ns);
+  msgbuf_t* pmsg(&empty);
+  while(sorter.process(&pmsg, 1e-6 * t_timeout))
+    deliver(pmsg, t_timeout, TRACE_RELEASED);
+}
+
+void trace_replay_t::write_cost(std::ostream& out) const
+{
+  out << "time,cid,destport,seq,size,cost_ns\n";
+  if(packets.empty())
+    return;
+  char ctmp[1024];
+  for(size_t k = 0; k < std::min(packets.size(), cost.size()); ++k) {
+    const trace_record_t& r(packets[k]);
+    snprintf(ctmp, sizeof(ctmp), "%1.6f,%d,%d,%d,%d,%lld\n",
+             1e-9 * (double)(r.t - packets[0].t), r.cid, r.destport, r.seq,
+             r.size, (long long)cost[k]);
+    out << ctmp;
+  }
+}
+
+void trace_replay_t::write_delivery(std::ostream& out) const
+{
+  out << "time,cid,destport,seq,decision\n";
+  if(packets.empty())
+    return;
+  char ctmp[1024];
+  for(const auto& d : delivery) {
+    snprintf(ctmp, sizeof(ctmp), "%1.6f,%d,%d,%d,%s\n",
+             1e-9 * (double)(d.t - packets[0].t), d.cid, d.destport, d.seq,
+             (d.decision == TRACE_DELIVERED) ? "delivered" : "released");
+    out << ctmp;
+  }
+}
+
+std::string trace_replay_t::get_summary() const
+{
+  if(cost.empty())
+    return "packets=0";
+  std::vector<int64_t> sorted(cost);
+  std::sort(sorted.begin(), sorted.end());
+  double sum(0);
+  for(auto c : sorted)
+    sum += c;
+  char ctmp[1024];
+  snprintf(ctmp, sizeof(ctmp),
+           "packets=%zu delivered=%zu mean=%1.3fus median=%1.3fus "
+           "p99=%1.3fus max=%1.3fus",
+           sorted.size(), delivery.size(), 1e-3 * sum / sorted.size(),
+           1e-3 * sorted[sorted.size() / 2],
+           1e-3 * sorted[std::min(sorted.size() - 1,
+                                  (size_t)(0.99 * sorted.size()))],
+           1e-3 * sorted.back());
+  return ctmp;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,91 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include "ovboxclient.h"
+
+/**
+ * Replay the received packets of a packet trace.
+ *
+ * The packets are rebuilt from the trace records, with the recorded
+ * header, sender and payload size, and passed through a message
+ * sorter to a processing function, e.g., ovboxclient_t::replay().
+ * The processing cost of each received packet (sorter and processing
+ * of all delivered messages) and the delivery order are recorded.
+ *
+ * Only messages to data ports are replayed, since control messages
+ * like pings or peer lists would modify the state of the client or
+ * send answers to the recorded peers. Sent packets and packets which
+ * were released by the sorter during recording are skipped. The
+ * receive timeout of the network thread is emulated from the
+ * recorded time stamps, thus the sorter decisions do not depend on
+ * the replay speed.
+ */
+class trace_replay_t {
+public:
+  /**
+   * Load a trace file.
+   * @param tracefile Name of trace file, see packet_trace_t
+   */
+  trace_replay_t(const std::string& tracefile);
+  /**
+   * Replay all received packets.
+   * @param sorter Message sorter
+   * @param process Function which is called for each delivered message
+   * @param realtime Keep the recorded timing if true, otherwise replay
+   * as fast as possible
+   * @param deadline Time in ms after which the sorter releases held
+   * back messages, see ovboxclient_t::set_reorder_deadline()
+   */
+  void run(message_sorter_t& sorter, std::function<void(msgbuf_t&)> process,
+           bool realtime, double deadline = 5.0);
+  /**
+   * Write processing cost of each received packet as comma separated
+   * values.
+   */
+  void write_cost(std::ostream& out) const;
+  /**
+   * Write delivered messages in delivery order as comma separated
+   * values.
+   */
+  void write_delivery(std::ostream& out) const;
+  /**
+   * Return a one-line summary of the processing cost.
+   */
+  std::string get_summary() const;
+  /// received packets in the trace:
+  std::vector<trace_record_t> packets;
+  /// processing cost of each received packet in ns:
+  std::vector<int64_t> cost;
+  /// delivered messages in delivery order; the time stamp is the
+  /// time of the received packet which caused the delivery, and the
+  /// decision is TRACE_DELIVERED or TRACE_RELEASED:
+  std::vector<trace_record_t> delivery;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
@@ -0,0 +1,220 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trafficcounter.h"
+#include "seqlock.h"
+#include <algorithm>
+
+enum { RX_PACKETS, RX_BYTES, TX_PACKETS, TX_BYTES, NUM_COUNTS };
+
+/*
+ * Counters of one thread. The block is aligned to cache lines, so
+ * blocks of different threads never share a cache line.
+ */
+class alignas(64) traffic_counter_t::block_t {
+public:
+  block_t();
+  // only called by the writing thread:
+  void add(size_t slot, port_t p, size_t k, size_t packets, size_t bytes);
+  void get(traffic_stat_t& s, const std::atomic<size_t>* c) const;
+  std::atomic<size_t> peer[TRAFFIC_SLOTS][NUM_COUNTS];
+  // port + 1 of each entry of the port table, 0 marks unused entries:
+  std::atomic<uint32_t> ports[TRAFFIC_PORTS];
+  // counters of the port table, the last entry collects other ports:
+  std::atomic<size_t> port[TRAFFIC_PORTS + 1][NUM_COUNTS];
+  // block is used by a writer, protected by the counter mutex:
+  bool in_use;
+};
+
+traffic_counter_t::block_t::block_t() : in_use(false)
+{
+  for(auto& p : peer)
+    for(auto& c : p)
+      c = 0;
+  for(auto& p : ports)
+    p = 0;
+  for(auto& p : port)
+    for(auto& c : p)
+      c = 0;
+}
+
+void traffic_counter_t::block_t::add(size_t slot, port_t p, size_t k,
+                                     size_t packets, size_t bytes)
+{
+  if(slot >= TRAFFIC_SLOTS)
+    slot = TRAFFIC_OTHER;
+  relaxed_add(peer[slot][k], packets);
+  relaxed_add(peer[slot][k + 1], bytes);
+  uint32_t tag((uint32_t)p + 1u);
+  size_t idx(0);
+  while(idx < TRAFFIC_PORTS) {
+    uint32_t t(ports[idx].load(std::memory_order_relaxed));
+    if(t == tag)
+      break;
+    if(t == 0) {
+      ports[idx].store(tag, std::memory_order_release);
+      break;
+    }
+    ++idx;
+  }
+  relaxed_add(port[idx][k], packets);
+  relaxed_add(port[idx][k + 1], bytes);
+}
+
+void traffic_counter_t::block_t::get(traffic_stat_t& s,
+                                     const std::atomic<size_t>* c) const
+{
+  s.rx_packets += c[RX_PACKETS].load(std::memory_order_relaxed);
+  s.rx_bytes += c[RX_BYTES].load(std::memory_order_relaxed);
+  s.tx_packets += c[TX_PACKETS].load(std::memory_order_relaxed);
+  s.tx_bytes += c[TX_BYTES].load(std::memory_order_relaxed);
+}
+
+traffic_stat_t::traffic_stat_t()
+    : rx_packets(0), rx_bytes(0), tx_packets(0), tx_bytes(0)
+{
+}
+
+traffic_stat_t& traffic_stat_t::operator+=(const traffic_stat_t& src)
+{
+  rx_packets += src.rx_packets;
+  rx_bytes += src.rx_bytes;
+  tx_packets += src.tx_packets;
+  tx_bytes += src.tx_bytes;
+  return *this;
+}
+
+traffic_rate_t::traffic_rate_t() : rx_kbps(0), rx_pps(0), tx_kbps(0), tx_pps(0)
+{
+}
+
+traffic_rate_t::traffic_rate_t(const traffic_stat_t& cur,
+                               const traffic_stat_t& prev, double dt)
+{
+  dt = std::max(1e-3, dt);
+  rx_kbps = 0.008 * (double)(cur.rx_bytes - prev.rx_bytes) / dt;
+  rx_pps = (double)(cur.rx_packets - prev.rx_packets) / dt;
+  tx_kbps = 0.008 * (double)(cur.tx_bytes - prev.tx_bytes) / dt;
+  tx_pps = (double)(cur.tx_packets - prev.tx_packets) / dt;
+}
+
+traffic_snapshot_t::traffic_snapshot_t() : t(0) {}
+
+traffic_rate_t
+traffic_snapshot_t::get_rate(const traffic_snapshot_t& prev) const
+{
+  return traffic_rate_t(total, prev.total, t - prev.t);
+}
+
+traffic_rate_t traffic_snapshot_t::get_peer_rate(const traffic_snapshot_t& prev,
+                                                 size_t slot) const
+{
+  if(slot >= TRAFFIC_SLOTS)
+    return traffic_rate_t();
+  return traffic_rate_t(peer[slot], prev.peer[slot], t - prev.t);
+}
+
+traffic_rate_t traffic_snapshot_t::get_port_rate(const traffic_snapshot_t& prev,
+                                                 port_t p) const
+{
+  auto it(port.find(p));
+  if(it == port.end())
+    return traffic_rate_t();
+  auto pit(prev.port.find(p));
+  return traffic_rate_t(it->second,
+                        (pit == prev.port.end()) ? traffic_stat_t()
+                                                 : pit->second,
+                        t - prev.t);
+}
+
+traffic_counter_t::traffic_counter_t() {}
+
+traffic_counter_t::~traffic_counter_t() {}
+
+void traffic_counter_t::get_snapshot(traffic_snapshot_t& s) const
+{
+  s = traffic_snapshot_t();
+  s.t = 1e-9 * (double)get_timestamp_ns();
+  std::lock_guard<std::mutex> lk(mtx);
+  for(const auto& b : blocks) {
+    for(size_t k = 0; k < TRAFFIC_SLOTS; ++k)
+      b.get(s.peer[k], b.peer[k]);
+    for(size_t k = 0; k < TRAFFIC_PORTS; ++k) {
+      uint32_t tag(b.ports[k].load(std::memory_order_acquire));
+      if(tag == 0)
+        break;
+      b.get(s.port[(port_t)(tag - 1u)], b.port[k]);
+    }
+    b.get(s.other_ports, b.port[TRAFFIC_PORTS]);
+  }
+  for(const auto& p : s.peer)
+    s.total += p;
+}
+
+traffic_stat_t traffic_counter_t::get_peer(size_t slot) const
+{
+  traffic_stat_t s;
+  if(slot >= TRAFFIC_SLOTS)
+    return s;
+  std::lock_guard<std::mutex> lk(mtx);
+  for(const auto& b : blocks)
+    b.get(s, b.peer[slot]);
+  return s;
+}
+
+traffic_counter_t::writer_t::writer_t(traffic_counter_t& counter)
+    : counter(counter), block(NULL)
+{
+  std::lock_guard<std::mutex> lk(counter.mtx);
+  // reuse the block of a thread which has ended:
+  for(auto& b : counter.blocks)
+    if(!b.in_use) {
+      block = &b;
+      break;
+    }
+  if(!block) {
+    counter.blocks.emplace_back();
+    block = &(counter.blocks.back());
+  }
+  block->in_use = true;
+}
+
+traffic_counter_t::writer_t::~writer_t()
+{
+  std::lock_guard<std::mutex> lk(counter.mtx);
+  block->in_use = false;
+}
+
+void traffic_counter_t::writer_t::add_rx(size_t slot, port_t port,
+                                         size_t bytes)
+{
+  block->add(slot, port, RX_PACKETS, 1, bytes);
+}
+
+void traffic_counter_t::writer_t::add_tx(size_t slot, port_t port,
+                                         size_t bytes, size_t packets)
+{
+  block->add(slot, port, TX_PACKETS, packets, bytes);
+}
+
+/*
+ * Local Variables:
+ * compile-command: "make -C .."
+ * End:
+ */
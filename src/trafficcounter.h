@@ -0,0 +1,177 @@
+/*
+ * This file is part of the ovbox software tool, see <http://orlandoviols.com/>.
+ *
+ * Copyright (c) 2021 Giso Grimm
+ */
+/*
+ * ovbox is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, version 3 of the License.
+ *
+ * ovbox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHATABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License, version 3 for more details.
+ *
+ * You should have received a copy of the GNU General Public License,
+ * Version 3 along with ovbox. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRAFFICCOUNTER_H
+#define TRAFFICCOUNTER_H
+
+#include "common.h"
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+
+/// traffic slot of messages to or from the server:
+#define TRAFFIC_SERVER MAX_STAGE_ID
+/// traffic slot of multicast messages and unknown devices:
+#define TRAFFIC_OTHER (MAX_STAGE_ID + 1)
+/// number of traffic slots, i.e., peers, server and others:
+#define TRAFFIC_SLOTS (MAX_STAGE_ID + 2)
+/// number of destination ports which are counted separately per thread:
+#define TRAFFIC_PORTS 32
+
+/**
+ * Packet and byte counts.
+ */
+class traffic_stat_t {
+public:
+  traffic_stat_t();
+  traffic_stat_t& operator+=(const traffic_stat_t& src);
+  size_t rx_packets;
+  size_t rx_bytes;
+  size_t tx_packets;
+  size_t tx_bytes;
+};
+
+/**
+ * Packet and bit rates.
+ */
+class traffic_rate_t {
+public:
+  traffic_rate_t();
+  /**
+   * Rates from the difference of two counts.
+   * @param cur Current counts
+   * @param prev Previous counts
+   * @param dt Time between both counts in seconds
+   */
+  traffic_rate_t(const traffic_stat_t& cur, const traffic_stat_t& prev,
+                 double dt);
+  double rx_kbps;
+  double rx_pps;
+  double tx_kbps;
+  double tx_pps;
+};
+
+/**
+ * Counts of all threads at one point in time.
+ */
+class traffic_snapshot_t {
+public:
+  traffic_snapshot_t();
+  /**
+   * Rates of all traffic since an earlier snapshot.
+   */
+  traffic_rate_t get_rate(const traffic_snapshot_t& prev) const;
+  /**
+   * Rates of one slot since an earlier snapshot.
+   * @param prev Earlier snapshot
+   * @param slot Device ID, TRAFFIC_SERVER or TRAFFIC_OTHER
+   */
+  traffic_rate_t get_peer_rate(const traffic_snapshot_t& prev,
+                               size_t slot) const;
+  /**
+   * Rates of one destination port since an earlier snapshot.
+   */
+  traffic_rate_t get_port_rate(const traffic_snapshot_t& prev,
+                               port_t port) const;
+  /// time of snapshot in seconds, see get_timestamp_ns():
+  double t;
+  traffic_stat_t total;
+  /// counts by device ID, then server, then others:
+  traffic_stat_t peer[TRAFFIC_SLOTS];
+  /// counts by destination port:
+  std::map<port_t, traffic_stat_t> port;
+  /// counts of ports which did not fit into the port table:
+  traffic_stat_t other_ports;
+};
+
+/**
+ * Packet and byte counters of network threads.
+ *
+ * Each thread counts into its own block of counters
+ * (traffic_counter_t::writer_t), thus the counters are never shared
+ * between cores on the hot path. Each counter has a single writer and
+ * is updated with relaxed atomic load and store. Readers sum up all
+ * blocks; reading does not modify the counters, so any number of
+ * readers can compute rates from their own previous snapshot.
+ *
+ * The blocks are kept when a thread ends and are reused by the next
+ * thread, thus the counts never decrease.
+ */
+class traffic_counter_t {
+public:
+  class block_t;
+  traffic_counter_t();
+  ~traffic_counter_t();
+  traffic_counter_t(const traffic_counter_t&) = delete;
+  /**
+   * Sum up the counters of all threads.
+   */
+  void get_snapshot(traffic_snapshot_t& s) const;
+  /**
+   * Sum up the counters of one slot.
+   * @param slot Device ID, TRAFFIC_SERVER or TRAFFIC_OTHER
+   */
+  traffic_stat_t get_peer(size_t slot) const;
+
+  /**
+   * Counter block of one thread. It is reserved while the writer
+   * exists.
+   */
+  class writer_t {
+  public:
+    writer_t(traffic_counter_t& counter);
+    ~writer_t();
+    writer_t(const writer_t&) = delete;
+    /**
+     * Count a received packet.
+     * @param slot Sender device ID, TRAFFIC_SERVER or TRAFFIC_OTHER
+     * @param port Destination port of message
+     * @param bytes Size of packed message in bytes
+     *
+     * Invalid slots are counted as TRAFFIC_OTHER.
+     */
+    void add_rx(size_t slot, port_t port, size_t bytes);
+    /**
+     * Count sent packets.
+     * @param slot Receiver device ID, TRAFFIC_SERVER or TRAFFIC_OTHER
+     * @param port Destination port of message
+     * @param bytes Size of packed messages in bytes
+     * @param packets Number of packets
+     */
+    void add_tx(size_t slot, port_t port, size_t bytes, size_t packets = 1);
+
+  private:
+    traffic_counter_t& counter;
+    block_t* block;
+  };
+
+private:
+  mutable std::mutex mtx;
+  std::list<block_t> blocks;
+};
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: c++
+ * compile-command: "make -C .."
+ * End:
+ */
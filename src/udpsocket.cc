@@ -30,20 +30,25 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <unistd.h>
 #endif
 
 #include "MACAddressUtility.h"
 #include "errmsg.h"
 #include "udpsocket.h"
+#include <algorithm>
 #include <errno.h>
+#include <limits.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
 
 #if defined(__linux__)
 #include <linux/wireless.h>
+#include <sys/eventfd.h>
 #endif
 
 #ifdef __APPLE__
@@ -55,10 +60,118 @@
 
 const size_t
     pingbufsize(HEADERLEN +
-                sizeof(std::chrono::high_resolution_clock::time_point) +
-                sizeof(stage_device_id_t) + sizeof(endpoint_t) + 100);
+                sizeof(timestamp_ns_t) + sizeof(stage_device_id_t) +
+                sizeof(endpoint_t) + 100);
 
-udpsocket_t::udpsocket_t() : tx_bytes(0), rx_bytes(0)
+stop_signal_t::stop_signal_t() : stopped(false), rfd(-1), wfd(-1)
+{
+#if defined(__linux__)
+  rfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  wfd = rfd;
+#elif !(defined(WIN32) || defined(UNDER_CE))
+  int fds[2];
+  if(pipe(fds) == 0) {
+    rfd = fds[0];
+    wfd = fds[1];
+  }
+#endif
+}
+
+stop_signal_t::~stop_signal_t()
+{
+#if !(defined(WIN32) || defined(UNDER_CE))
+  if(rfd >= 0)
+    ::close(rfd);
+  if((wfd >= 0) && (wfd != rfd))
+    ::close(wfd);
+#endif
+}
+
+void stop_signal_t::stop()
+{
+  std::lock_guard<std::mutex> lk(mtx);
+  if(stopped.exchange(true))
+    return;
+#if !(defined(WIN32) || defined(UNDER_CE))
+  if(wfd >= 0) {
+    // the eventfd counter or the pipe content is never read, thus the
+    // descriptor stays readable:
+    uint64_t v(1);
+    if(write(wfd, &v, sizeof(v)) < 0)
+      DEBUG(strerror(errno));
+  }
+#endif
+  cv.notify_all();
+}
+
+bool stop_signal_t::wait_for(int64_t usec)
+{
+  std::unique_lock<std::mutex> lk(mtx);
+  return cv.wait_for(lk, std::chrono::microseconds(usec),
+                     [this] { return is_stopped(); });
+}
+
+semaphore_t::semaphore_t()
+{
+#if defined(__APPLE__)
+  sem = dispatch_semaphore_create(0);
+  if(!sem)
+    throw ErrMsg("Unable to create semaphore.");
+#elif defined(WIN32) || defined(UNDER_CE)
+  sem = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+  if(!sem)
+    throw ErrMsg("Unable to create semaphore.");
+#else
+  if(sem_init(&sem, 0, 0) != 0)
+    throw ErrMsg("Unable to create semaphore: ", errno);
+#endif
+}
+
+semaphore_t::~semaphore_t()
+{
+#if defined(__APPLE__)
+  dispatch_release(sem);
+#elif defined(WIN32) || defined(UNDER_CE)
+  CloseHandle(sem);
+#else
+  sem_destroy(&sem);
+#endif
+}
+
+void semaphore_t::post()
+{
+#if defined(__APPLE__)
+  dispatch_semaphore_signal(sem);
+#elif defined(WIN32) || defined(UNDER_CE)
+  ReleaseSemaphore(sem, 1, NULL);
+#else
+  sem_post(&sem);
+#endif
+}
+
+bool semaphore_t::wait_for(int64_t usec)
+{
+#if defined(__APPLE__)
+  return dispatch_semaphore_wait(
+             sem, dispatch_time(DISPATCH_TIME_NOW, 1000 * usec)) == 0;
+#elif defined(WIN32) || defined(UNDER_CE)
+  return WaitForSingleObject(sem, (DWORD)(usec / 1000)) == WAIT_OBJECT_0;
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  int64_t nsec(t.tv_nsec + 1000 * usec);
+  t.tv_sec += nsec / 1000000000;
+  t.tv_nsec = nsec % 1000000000;
+  int r;
+  while(((r = sem_timedwait(&sem, &t)) != 0) && (errno == EINTR))
+    ;
+  return r == 0;
+#endif
+}
+
+udpsocket_t::udpsocket_t()
+    : count_bytes(true), timeout_usec(0), stopsig(NULL), tx_bytes(0),
+      rx_bytes(0)
 {
   // linux part, sets value pointed to by &serv_addr to 0 value:
   // bzero((char*)&serv_addr, sizeof(serv_addr));
@@ -109,6 +222,32 @@ void udpsocket_t::set_expedited_forwarding_PHB()
   set_netpriority(6);
 }
 
+bool udpsocket_t::join_multicast_group(const endpoint_t& group)
+{
+  struct ip_mreq mreq;
+  memset(&mreq, 0, sizeof(mreq));
+  mreq.imr_multiaddr = group.sin_addr;
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  return setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                    (const char*)&mreq, sizeof(mreq)) == 0;
+}
+
+bool udpsocket_t::set_multicast_options(int ttl, bool loop)
+{
+#if defined(WIN32) || defined(UNDER_CE)
+  DWORD cttl(ttl);
+  DWORD cloop(loop);
+#else
+  unsigned char cttl(ttl);
+  unsigned char cloop(loop);
+#endif
+  if(setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&cttl,
+                sizeof(cttl)) != 0)
+    return false;
+  return setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&cloop,
+                    sizeof(cloop)) == 0;
+}
+
 udpsocket_t::~udpsocket_t()
 {
   close();
@@ -116,6 +255,7 @@ udpsocket_t::~udpsocket_t()
 
 void udpsocket_t::set_timeout_usec(int usec)
 {
+  timeout_usec = usec;
   struct timeval tv;
   tv.tv_sec = 0;
   tv.tv_usec = usec;
@@ -205,7 +345,7 @@ ssize_t udpsocket_t::send(const char* buf, size_t len, int portno)
   serv_addr.sin_port = htons(portno);
   ssize_t tx(sendto(sockfd, buf, len, MSG_CONFIRM, (struct sockaddr*)&serv_addr,
                     sizeof(serv_addr)));
-  if(tx > 0)
+  if((tx > 0) && count_bytes)
     tx_bytes += tx;
   return tx;
 }
@@ -214,7 +354,7 @@ ssize_t udpsocket_t::send(const char* buf, size_t len, const endpoint_t& ep)
 {
   ssize_t tx(
       sendto(sockfd, buf, len, MSG_CONFIRM, (struct sockaddr*)&ep, sizeof(ep)));
-  if(tx > 0)
+  if((tx > 0) && count_bytes)
     tx_bytes += tx;
   return tx;
 }
@@ -224,9 +364,39 @@ ssize_t udpsocket_t::recvfrom(char* buf, size_t len, endpoint_t& addr)
   memset(&addr, 0, sizeof(endpoint_t));
   addr.sin_family = AF_INET;
   socklen_t socklen(sizeof(endpoint_t));
+#if !(defined(WIN32) || defined(UNDER_CE))
+  if(stopsig && (stopsig->get_fd() >= 0)) {
+    // read without waiting if a message is pending, otherwise wait
+    // for a message, a stop request or the timeout:
+    ssize_t rx(::recvfrom(sockfd, buf, len, MSG_DONTWAIT,
+                          (struct sockaddr*)&addr, &socklen));
+    if((rx >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+      if((rx > 0) && count_bytes)
+        rx_bytes += rx;
+      return rx;
+    }
+    int stopfd(stopsig->get_fd());
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(sockfd, &fds);
+    FD_SET(stopfd, &fds);
+    int usec(timeout_usec);
+    struct timeval tv;
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
+    int r(select(std::max(sockfd, stopfd) + 1, &fds, NULL, NULL,
+                 (usec > 0) ? &tv : NULL));
+    if((r <= 0) || FD_ISSET(stopfd, &fds)) {
+      if(r == 0)
+        errno = EAGAIN;
+      return -1;
+    }
+    socklen = sizeof(endpoint_t);
+  }
+#endif
   ssize_t rx(
       ::recvfrom(sockfd, buf, len, 0, (struct sockaddr*)&addr, &socklen));
-  if(rx > 0)
+  if((rx > 0) && count_bytes)
     rx_bytes += rx;
   return rx;
 }
@@ -254,24 +424,43 @@ ovbox_udpsocket_t::ovbox_udpsocket_t(secret_t secret, stage_device_id_t cid)
 {
 }
 
-void ovbox_udpsocket_t::send_ping(const endpoint_t& ep,
-                                  stage_device_id_t destid, port_t proto)
+size_t ovbox_udpsocket_t::send_ping(const endpoint_t& ep,
+                                    stage_device_id_t destid, port_t proto)
 {
   char buffer[pingbufsize];
-  std::chrono::high_resolution_clock::time_point t1(
-      std::chrono::high_resolution_clock::now());
+  timestamp_ns_t t1(get_timestamp_ns());
   size_t n(0);
   n = packmsg(buffer, pingbufsize, proto, "", 0);
   if(proto == PORT_PING_SRV)
     n = addmsg(buffer, pingbufsize, n, (char*)(&destid), sizeof(destid));
   n = addmsg(buffer, pingbufsize, n, (const char*)(&t1), sizeof(t1));
   n = addmsg(buffer, pingbufsize, n, (char*)(&ep), sizeof(ep));
-  send(buffer, n, ep);
+  return std::max((ssize_t)0, send(buffer, n, ep));
 }
 
-void ovbox_udpsocket_t::send_registration(epmode_t mode, port_t port,
-                                          const endpoint_t& localep)
+size_t ovbox_udpsocket_t::send_multi_ping(const endpoint_t& ep,
+                                          const stage_device_id_t* destids,
+                                          size_t n)
 {
+  if(n > MAX_STAGE_ID)
+    n = MAX_STAGE_ID;
+  char buffer[pingbufsize + MAX_STAGE_ID * sizeof(stage_device_id_t)];
+  timestamp_ns_t t1(get_timestamp_ns());
+  uint8_t num(n);
+  size_t len(0);
+  len = packmsg(buffer, sizeof(buffer), PORT_PING_SRV_MULTI, "", 0);
+  len = addmsg(buffer, sizeof(buffer), len, (char*)(&num), sizeof(num));
+  len = addmsg(buffer, sizeof(buffer), len, (const char*)destids,
+               n * sizeof(stage_device_id_t));
+  len = addmsg(buffer, sizeof(buffer), len, (const char*)(&t1), sizeof(t1));
+  len = addmsg(buffer, sizeof(buffer), len, (char*)(&ep), sizeof(ep));
+  return std::max((ssize_t)0, send(buffer, len, ep));
+}
+
+size_t ovbox_udpsocket_t::send_registration(epmode_t mode, port_t port,
+                                            const endpoint_t& localep)
+{
+  size_t tx(0);
   std::string rver(OVBOXVERSION);
   {
     size_t buflen(HEADERLEN + rver.size() + 1);
@@ -281,15 +470,16 @@ void ovbox_udpsocket_t::send_registration(epmode_t mode, port_t port,
     // message is handled only by the server, not by peers
     size_t n(::packmsg(buffer, buflen, secret, callerid, PORT_REGISTER, mode,
                        rver.c_str(), rver.size() + 1));
-    send(buffer, n, port);
+    tx += std::max((ssize_t)0, send(buffer, n, port));
   }
   {
     size_t buflen(HEADERLEN + sizeof(endpoint_t));
     char buffer[buflen];
     size_t n(packmsg(buffer, buflen, PORT_SETLOCALIP, (const char*)(&localep),
                      sizeof(endpoint_t)));
-    send(buffer, n, port);
+    tx += std::max((ssize_t)0, send(buffer, n, port));
   }
+  return tx;
 }
 
 size_t ovbox_udpsocket_t::packmsg(char* destbuf, size_t maxlen, port_t destport,
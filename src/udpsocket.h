@@ -23,6 +23,8 @@
 
 #include "common.h"
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #if defined(LINUX) || defined(linux) || defined(__APPLE__)
 #include <netinet/ip.h>
 #include <sys/socket.h>
@@ -34,6 +36,12 @@
 #include <winsock.h>
 #endif
 
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#elif !(defined(WIN32) || defined(UNDER_CE))
+#include <semaphore.h>
+#endif
+
 #include <sys/types.h>
 
 #include <unistd.h>
@@ -53,6 +61,80 @@ inline bool is_same_network(const endpoint_t& a, const endpoint_t& b)
          (a.sin_addr.s_addr != 0) && (b.sin_addr.s_addr != 0);
 };
 
+/**
+ * Signal to stop threads which wait for sockets or sleep.
+ *
+ * It combines an atomic flag with a file descriptor which becomes
+ * readable upon stop(), an eventfd on Linux and a pipe on other POSIX
+ * systems. Sockets to which the signal is attached (see
+ * udpsocket_t::set_stop_signal()) and wait_for() return immediately
+ * after a stop request, instead of after their timeout. On Windows no
+ * file descriptor is available, and sockets return after their
+ * timeout.
+ */
+class stop_signal_t {
+public:
+  stop_signal_t();
+  ~stop_signal_t();
+  stop_signal_t(const stop_signal_t&) = delete;
+  /**
+   * Request all threads to stop. This can be called from any thread.
+   */
+  void stop();
+  bool is_stopped() const { return stopped.load(std::memory_order_acquire); };
+  /**
+   * Sleep until a timeout or a stop request.
+   * @param usec Timeout in microseconds
+   * @return True if stop was requested
+   */
+  bool wait_for(int64_t usec);
+  /**
+   * File descriptor which becomes readable upon stop, or -1 if not
+   * available.
+   */
+  int get_fd() const { return rfd; };
+
+private:
+  std::atomic_bool stopped;
+  int rfd;
+  int wfd;
+  std::mutex mtx;
+  std::condition_variable cv;
+};
+
+/**
+ * Counting semaphore to wake up a thread from the audio thread.
+ *
+ * post() does not lock, and it enters the kernel only if a thread is
+ * waiting. An unnamed POSIX semaphore is used on Linux, a dispatch
+ * semaphore on macOS and a semaphore object on Windows.
+ */
+class semaphore_t {
+public:
+  semaphore_t();
+  ~semaphore_t();
+  semaphore_t(const semaphore_t&) = delete;
+  /**
+   * Increment the semaphore and wake up a waiting thread.
+   */
+  void post();
+  /**
+   * Wait until the semaphore was posted or a timeout elapsed.
+   * @param usec Timeout in microseconds
+   * @return True if the semaphore was posted
+   */
+  bool wait_for(int64_t usec);
+
+private:
+#if defined(__APPLE__)
+  dispatch_semaphore_t sem;
+#elif defined(WIN32) || defined(UNDER_CE)
+  HANDLE sem;
+#else
+  sem_t sem;
+#endif
+};
+
 /**
  * Send and receive UDP messages
  */
@@ -92,6 +174,21 @@ public:
    * bandwidth, end-to-end service according to RFC2598
    */
   void set_expedited_forwarding_PHB();
+  /**
+   * Join a multicast group on the default interface.
+   *
+   * @param group Address of multicast group
+   * @return True on success, false if the group could not be joined
+   */
+  bool join_multicast_group(const endpoint_t& group);
+  /**
+   * Configure sending of multicast messages.
+   *
+   * @param ttl Time to live of outgoing multicast packages (1 = local network)
+   * @param loop Deliver outgoing multicast packages also to local host
+   * @return True on success
+   */
+  bool set_multicast_options(int ttl, bool loop);
   /**
    * Bind the socket to a port.
    *
@@ -116,7 +213,7 @@ public:
    * Send a message to a port at the previously configured destination
    *
    * Upon success, the tx_bytes counter is increased by the number of
-   * bytes sent.
+   * bytes sent, unless byte counting is disabled.
    *
    * @param buf Start of memory area containing the message
    * @param len Length of message in bytes
@@ -128,7 +225,7 @@ public:
    * Send a message to a destination.
    *
    * Upon success, the tx_bytes counter is increased by the number of
-   * bytes sent.
+   * bytes sent, unless byte counting is disabled.
    *
    * @param buf Start of memory area containing the message
    * @param len Length of message in bytes
@@ -140,7 +237,7 @@ public:
    * Receive a message.
    *
    * Upon success, the rx_bytes counter is increased by the number of
-   * bytes received.
+   * bytes received, unless byte counting is disabled.
    *
    * @param buf Start of memory area where the message should be stored
    * @param len Lnegth of provided memory area in bytes
@@ -166,11 +263,34 @@ public:
    * Return address of default destination.
    */
   const endpoint_t& get_destination() const { return serv_addr; };
+  /**
+   * Enable or disable the tx_bytes and rx_bytes counters.
+   *
+   * Sockets which are used by several threads may disable the shared
+   * counters and count traffic per thread instead. Call this before
+   * the socket is used by other threads.
+   */
+  void set_byte_counting(bool enable) { count_bytes = enable; };
+  /**
+   * Attach a stop signal, which interrupts waiting in recvfrom().
+   *
+   * Upon a stop request, recvfrom() returns -1 without receiving a
+   * message. Call this before the socket is used by other threads.
+   *
+   * @param sig Stop signal, or NULL to detach; must outlive the use
+   * of the socket
+   */
+  void set_stop_signal(stop_signal_t* sig) { stopsig = sig; };
 
 private:
   int sockfd;
   endpoint_t serv_addr;
   bool isopen;
+  bool count_bytes;
+  // receive timeout in microseconds, or zero for blocking mode; may
+  // be changed while another thread is waiting:
+  std::atomic_int timeout_usec;
+  stop_signal_t* stopsig;
 
 public:
   /**
@@ -257,9 +377,35 @@ private:
 class ovbox_udpsocket_t : public udpsocket_t {
 public:
   ovbox_udpsocket_t(secret_t secret, stage_device_id_t id);
-  void send_ping(const endpoint_t& ep, stage_device_id_t destid = 0,
-                 port_t proto = PORT_PING);
-  void send_registration(epmode_t, port_t port, const endpoint_t& localep);
+  /**
+   * Send a ping message.
+   *
+   * @return Number of bytes sent, or 0 in case of failure
+   */
+  size_t send_ping(const endpoint_t& ep, stage_device_id_t destid = 0,
+                   port_t proto = PORT_PING);
+  /**
+   * Send one ping message via server to several peers.
+   *
+   * @param ep Server address
+   * @param destids Device IDs of peers
+   * @param n Number of peers
+   *
+   * The payload contains the number of peers, their device IDs, the
+   * time stamp and the server address. The server is expected to
+   * forward a PORT_PING_SRV message with the same time stamp to each
+   * of the peers, which then answer with PORT_PONG_SRV as usual.
+   *
+   * @return Number of bytes sent, or 0 in case of failure
+   */
+  size_t send_multi_ping(const endpoint_t& ep,
+                         const stage_device_id_t* destids, size_t n);
+  /**
+   * Send registration and local IP address to the server.
+   *
+   * @return Number of bytes sent in both messages
+   */
+  size_t send_registration(epmode_t, port_t port, const endpoint_t& localep);
   /**
    * Receive a message, extract header and validate secret.
    *
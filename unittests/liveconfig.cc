@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include "liveconfig.h"
+#include <string>
+
+TEST(liveconfig, reader)
+{
+  live_config_t<std::string> cfg;
+  cfg.set("first");
+  std::atomic_bool replaced(false);
+  std::thread writer;
+  {
+    live_config_t<std::string>::reader_t r(cfg);
+    EXPECT_EQ("first", *r);
+    writer = std::thread([&cfg, &replaced]() {
+      cfg.set("second");
+      replaced = true;
+    });
+    // the value of an active reader is not deleted:
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(replaced);
+    EXPECT_EQ("first", *r);
+    EXPECT_EQ(5u, r->size());
+  }
+  writer.join();
+  EXPECT_TRUE(replaced);
+  EXPECT_EQ("second", cfg.copy());
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include "metricsserver.h"
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string http_get(port_t port, const std::string& path)
+{
+  int fd(socket(AF_INET, SOCK_STREAM, 0));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return "";
+  }
+  std::string req("GET " + path + " HTTP/1.0\r\n\r\n");
+  send(fd, req.c_str(), req.size(), 0);
+  std::string res;
+  char buf[1024];
+  ssize_t n;
+  while((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    res.append(buf, n);
+  close(fd);
+  return res;
+}
+
+TEST(metricsserver, get)
+{
+  metrics_server_t srv(0, []() {
+    return metric_header("ov_test", "gauge", "Test value.") +
+           metric_value("ov_test", "cid=\"3\"", 1.5);
+  });
+  EXPECT_NE(0u, srv.get_port());
+  std::string res(http_get(srv.get_port(), "/metrics"));
+  EXPECT_EQ(0u, res.find("HTTP/1.0 200 OK"));
+  EXPECT_NE(std::string::npos,
+            res.find("\r\n\r\n# HELP ov_test Test value.\n# TYPE ov_test "
+                     "gauge\nov_test{cid=\"3\"} 1.5\n"));
+  res = http_get(srv.get_port(), "/other");
+  EXPECT_EQ(0u, res.find("HTTP/1.0 404"));
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+
+#include "errmsg.h"
+#include "netaudio.h"
+#include <string.h>
+
+// send packets of a constant signal to a receiver:
+static void send_block(netaudio_encoder_t& enc, netaudio_receiver_t& rec,
+                       uint32_t nframes, float value)
+{
+  std::vector<float> data(nframes, value);
+  const float* chs[2] = {data.data(), data.data()};
+  enc.encode(chs, nframes, [&rec](const char* buf, size_t len) {
+    rec.put_packet(buf, len);
+  });
+}
+
+TEST(netaudio, encoder)
+{
+  netaudio_encoder_t enc(2, 48000, NETAUDIO_INT16, 1400);
+  EXPECT_EQ((1400u - 32u) / 4u, enc.get_frames_per_packet());
+  std::vector<size_t> sizes;
+  std::vector<netaudio_header_t> headers;
+  std::vector<float> data(1024, 0.25f);
+  const float* chs[2] = {data.data(), data.data()};
+  for(size_t k = 0; k < 2; ++k)
+    enc.encode(chs, 1024, [&](const char* buf, size_t len) {
+      netaudio_header_t h;
+      EXPECT_TRUE(h.read(buf, len));
+      headers.push_back(h);
+      sizes.push_back(len);
+    });
+  ASSERT_EQ(6u, sizes.size());
+  EXPECT_EQ(1400u, sizes[0]);
+  EXPECT_EQ(32u + 4u * (1024u - 2u * 342u), sizes[2]);
+  EXPECT_EQ(48000u, headers[0].srate);
+  EXPECT_EQ(2u, headers[0].channels);
+  EXPECT_EQ(NETAUDIO_INT16, headers[0].format);
+  EXPECT_EQ(1024u, headers[0].period);
+  EXPECT_EQ(342u, headers[1].offset);
+  EXPECT_EQ(342u, headers[1].get_frame());
+  EXPECT_EQ(1u, headers[3].cycle);
+  EXPECT_EQ(0u, headers[3].offset);
+  EXPECT_EQ(1024u, headers[3].get_frame());
+  EXPECT_THROW(netaudio_encoder_t(255, 48000, NETAUDIO_FLOAT, 1000), ErrMsg);
+}
+
+TEST(netaudio, zitaformat)
+{
+  // packet with two channels of 24 bit samples, two frames of cycle 5
+  // with 64 frames per cycle, starting at frame 16 of the cycle:
+  const unsigned char pkt[32 + 12] = {
+      'z',  'i',  't',  'a',  1,    0,    2,    2,    0,    0,    0xbb,
+      0x80, 0,    64,   0,    2,    0,    0,    0,    5,    0,    16,
+      0,    0,    0,    0,    0,    7,    0x80, 0,    0,    0,    0x40,
+      0,    0,    0xc0, 0,    0,    0x20, 0,    0,    0xe0, 0,    0};
+  netaudio_header_t h;
+  ASSERT_TRUE(h.read((const char*)pkt, sizeof(pkt)));
+  EXPECT_EQ(1u, h.version);
+  EXPECT_EQ(2u, h.channels);
+  EXPECT_EQ(NETAUDIO_INT24, h.format);
+  EXPECT_EQ(48000u, h.srate);
+  EXPECT_EQ(64u, h.period);
+  EXPECT_EQ(2u, h.nframes);
+  EXPECT_EQ(5u, h.cycle);
+  EXPECT_EQ(16u, h.offset);
+  EXPECT_EQ(5u * 64u + 16u, h.get_frame());
+  EXPECT_EQ(7u, h.tsec);
+  EXPECT_EQ(0x80000000u, h.tfrac);
+  // writing the header gives the same bytes:
+  char hbuf[NETAUDIO_HEADERLEN];
+  h.write(hbuf);
+  EXPECT_EQ(0, memcmp(hbuf, pkt, sizeof(hbuf)));
+  EXPECT_FALSE(h.read("zipa", 4));
+  netaudio_encoder_t enc(2, 48000, NETAUDIO_INT24, 32 + 2 * 6);
+  std::vector<float> d1({0.5f, 0.25f}), d2({-0.5f, -0.25f});
+  const float* chs[2] = {d1.data(), d2.data()};
+  // a receiver with one channel uses the first channel:
+  netaudio_receiver_t rec(1, 48000, 1.0);
+  std::vector<float> o1(64);
+  float* out[1] = {o1.data()};
+  std::vector<char> sent;
+  for(size_t k = 0; k < 100; ++k)
+    enc.encode(chs, 2, [&](const char* buf, size_t len) {
+      sent.assign(buf, buf + len);
+      rec.put_packet(buf, len);
+    });
+  ASSERT_EQ(sizeof(pkt), sent.size());
+  // samples are identical to the hand-made packet:
+  EXPECT_EQ(0, memcmp(sent.data() + 32, pkt + 32, 12));
+  netaudio_stats_t st(rec.get_stats());
+  EXPECT_EQ(100u, st.received);
+  EXPECT_EQ(0u, st.invalid);
+  EXPECT_EQ(0u, st.lost);
+  // alternating 0.5 and 0.25 from the first channel:
+  rec.process(out, 64);
+  for(auto v : o1) {
+    EXPECT_GE(v, 0.24f);
+    EXPECT_LE(v, 0.51f);
+  }
+}
+
+TEST(netaudio, receive)
+{
+  netaudio_encoder_t enc(2, 48000);
+  netaudio_receiver_t rec(2, 48000, 5.0);
+  std::vector<float> o1(64), o2(64);
+  float* out[2] = {o1.data(), o2.data()};
+  // silence while the buffer is filled:
+  send_block(enc, rec, 64, 0.5f);
+  rec.process(out, 64);
+  EXPECT_EQ(0.0f, o1[0]);
+  for(size_t k = 0; k < 1000; ++k) {
+    send_block(enc, rec, 64, 0.5f);
+    rec.process(out, 64);
+  }
+  EXPECT_NEAR(0.5f, o1[63], 1e-3);
+  EXPECT_NEAR(0.5f, o2[0], 1e-3);
+  netaudio_stats_t s(rec.get_stats());
+  EXPECT_EQ(1001u, s.received);
+  EXPECT_EQ(0u, s.underrun);
+  EXPECT_EQ(0u, s.lost);
+  EXPECT_NEAR(1.0, s.ratio, 1e-4);
+  EXPECT_NEAR(240.0 + 64.0, s.fill, 64.0);
+  // invalid packets are rejected:
+  rec.put_packet("hello", 5);
+  netaudio_encoder_t enc1(1, 48000);
+  std::vector<float> data(64, 0.0f);
+  const float* chs[1] = {data.data()};
+  enc1.encode(chs, 64, [&rec](const char* buf, size_t len) {
+    rec.put_packet(buf, len);
+  });
+  EXPECT_EQ(2u, rec.get_stats().invalid);
+}
+
+TEST(netaudio, lostandlate)
+{
+  netaudio_encoder_t enc(2, 48000);
+  netaudio_receiver_t rec(2, 48000, 20.0);
+  std::vector<std::vector<char>> packets;
+  std::vector<float> data(64, 0.1f);
+  const float* chs[2] = {data.data(), data.data()};
+  for(size_t k = 0; k < 4; ++k)
+    enc.encode(chs, 64, [&packets](const char* buf, size_t len) {
+      packets.push_back(std::vector<char>(buf, buf + len));
+    });
+  rec.put_packet(packets[0].data(), packets[0].size());
+  rec.put_packet(packets[2].data(), packets[2].size());
+  rec.put_packet(packets[1].data(), packets[1].size());
+  rec.put_packet(packets[3].data(), packets[3].size());
+  rec.put_packet(packets[3].data(), packets[3].size());
+  netaudio_stats_t s(rec.get_stats());
+  EXPECT_EQ(5u, s.received);
+  EXPECT_EQ(64u, s.lost);
+  EXPECT_EQ(2u, s.late);
+}
+
+TEST(netaudio, drift)
+{
+  // the sender clock is 10 Hz faster than the receiver clock:
+  netaudio_encoder_t enc(2, 48000);
+  netaudio_receiver_t rec(2, 48000, 10.0);
+  std::vector<float> o1(128), o2(128);
+  float* out[2] = {o1.data(), o2.data()};
+  double srcframes(0);
+  uint64_t sent(0);
+  uint64_t underruns(0);
+  // simulate two minutes:
+  for(size_t k = 0; k < 45000; ++k) {
+    srcframes += 128.0 * 48010.0 / 48000.0;
+    while(sent + 32 <= srcframes) {
+      send_block(enc, rec, 32, 0.25f);
+      sent += 32;
+    }
+    rec.process(out, 128);
+    if(k == 5000)
+      underruns = rec.get_stats().underrun;
+  }
+  netaudio_stats_t s(rec.get_stats());
+  // no underruns after the control loop has settled:
+  EXPECT_EQ(underruns, s.underrun);
+  EXPECT_EQ(0u, s.overflow);
+  EXPECT_EQ(0u, s.resync);
+  EXPECT_NEAR(48010.0 / 48000.0, s.ratio, 1e-4);
+  EXPECT_NEAR(480.0 + 128.0, s.fill, 64.0);
+  EXPECT_NEAR(0.25f, o1[100], 1e-3);
+}
+
+TEST(netaudio, taps)
+{
+  netaudio_encoder_t enc(2, 48000);
+  netaudio_receiver_t rec(2, 48000, 5.0, {10.0});
+  EXPECT_EQ(1u, rec.get_taps());
+  std::vector<float> o1(64), o2(64), t1(64), t2(64);
+  float* out[2] = {o1.data(), o2.data()};
+  float* tap[2] = {t1.data(), t2.data()};
+  // position of a step in the main output and in the tap output:
+  int64_t step_out(-1);
+  int64_t step_tap(-1);
+  for(int64_t k = 0; k < 1000; ++k) {
+    send_block(enc, rec, 64, (k < 500) ? 0.0f : 0.5f);
+    rec.process(out, 64);
+    rec.process_tap(0, tap, 64);
+    for(int64_t n = 0; n < 64; ++n) {
+      if((step_out < 0) && (o1[n] > 0.25f))
+        step_out = 64 * k + n;
+      if((step_tap < 0) && (t2[n] > 0.25f))
+        step_tap = 64 * k + n;
+    }
+  }
+  ASSERT_GT(step_out, 0);
+  EXPECT_NEAR(480.0, (double)(step_tap - step_out), 2.0);
+  EXPECT_NEAR(0.5f, t1[63], 1e-3);
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "ov_types.h"
+
+static stage_device_t test_device(stage_device_id_t id)
+{
+  stage_device_t dev;
+  dev.id = id;
+  dev.label = "dev";
+  dev.position = {0, 0, 0};
+  dev.orientation = {0, 0, 0};
+  dev.gain = 1.0;
+  dev.mute = false;
+  dev.senderjitter = 5.0;
+  dev.receiverjitter = 5.0;
+  dev.sendlocal = true;
+  dev.receivedownmix = false;
+  dev.senddownmix = false;
+  dev.channels.push_back({"1", "system:capture_1", 1.0, {0, 0, 0}, "omni"});
+  return dev;
+}
+
+TEST(stage_diff_t, devices)
+{
+  std::map<stage_device_id_t, stage_device_t> prev;
+  for(stage_device_id_t k = 0; k < 20; ++k)
+    prev[k] = test_device(k);
+  EXPECT_TRUE(stage_diff_t(prev, prev).empty());
+  auto next(prev);
+  next[3].gain = 0.5;
+  next[4].channels[0].gain = 0.5;
+  next[5].position.x = 1;
+  next[6].channels[0].position.y = 1;
+  // mute is not used for rendering:
+  next[7].mute = true;
+  next.erase(8);
+  next[20] = test_device(20);
+  stage_diff_t diff(prev, next);
+  EXPECT_EQ(6u, diff.devices.size());
+  EXPECT_EQ(STAGE_CHANGE_GAIN, diff.devices[3]);
+  EXPECT_EQ(STAGE_CHANGE_CHANNELGAIN, diff.devices[4]);
+  EXPECT_EQ(STAGE_CHANGE_POSITION, diff.devices[5]);
+  EXPECT_EQ(STAGE_CHANGE_CHANNELPOSITION, diff.devices[6]);
+  EXPECT_EQ(STAGE_CHANGE_REMOVED, diff.devices[8]);
+  EXPECT_EQ(STAGE_CHANGE_ADDED, diff.devices[20]);
+  EXPECT_TRUE(diff.only(STAGE_CHANGE_GAIN | STAGE_CHANGE_CHANNELGAIN |
+                        STAGE_CHANGE_POSITION | STAGE_CHANGE_CHANNELPOSITION |
+                        STAGE_CHANGE_ADDED | STAGE_CHANGE_REMOVED));
+  EXPECT_FALSE(diff.only(STAGE_CHANGE_GAIN));
+  // jitter buffer and channel layout changes need a new receiver:
+  next = prev;
+  next[2].receiverjitter = 10;
+  next[3].channels.push_back(next[3].channels[0]);
+  next[4].label = "other";
+  next[5].channels[0].directivity = "cardioid";
+  diff = stage_diff_t(prev, next);
+  EXPECT_EQ(4u, diff.devices.size());
+  for(auto dev : diff.devices)
+    EXPECT_EQ(STAGE_CHANGE_STRUCTURE, dev.second);
+}
+
+TEST(stage_diff_t, render_settings)
+{
+  render_settings_t prev;
+  render_settings_t next(prev);
+  stage_diff_t diff;
+  diff.add_render_settings(prev, next, 2);
+  EXPECT_TRUE(diff.empty());
+  next.egogain = 0.5;
+  next.reverbgain = 0.5;
+  next.damping = 0.1;
+  next.peer2peer = !prev.peer2peer;
+  diff.add_render_settings(prev, next, 2);
+  EXPECT_EQ(STAGE_CHANGE_GAIN | STAGE_CHANGE_ROOM | STAGE_CHANGE_NETWORK,
+            diff.changes);
+  // self monitor gain is assigned to this device:
+  EXPECT_EQ(1u, diff.devices.size());
+  EXPECT_EQ(STAGE_CHANGE_GAIN, diff.devices[2]);
+  next.rectype = "ortf";
+  EXPECT_EQ(STAGE_CHANGE_STRUCTURE,
+            get_render_settings_changes(prev, next) & STAGE_CHANGE_STRUCTURE);
+  next = prev;
+  next.roomsize.x += 1;
+  EXPECT_EQ(STAGE_CHANGE_STRUCTURE, get_render_settings_changes(prev, next));
+}
+
+TEST(stage_hash, changes)
+{
+  stage_t a;
+  a.host = "localhost";
+  a.port = 4455;
+  a.pin = 1234;
+  a.thisdeviceid = "dev";
+  a.thisstagedeviceid = 1;
+  a.stage[1] = test_device(1);
+  a.stage[2] = test_device(2);
+  a.thisdevice = a.stage[1];
+  a.rendersettings.xports["a"] = "b";
+  a.rendersettings.xports["c"] = "d";
+  stage_t b(a);
+  EXPECT_EQ(get_stage_hash(a), get_stage_hash(b));
+  // same extra ports, inserted in different order:
+  b.rendersettings.xports.clear();
+  b.rendersettings.xports["c"] = "d";
+  b.rendersettings.xports["a"] = "b";
+  EXPECT_EQ(get_stage_hash(a), get_stage_hash(b));
+  // channel IDs are ignored by operator!=, but not by the hash:
+  b.stage[2].channels[0].id = "2";
+  EXPECT_FALSE(a.stage != b.stage);
+  EXPECT_NE(get_stage_hash(a), get_stage_hash(b));
+  b = a;
+  b.stage[2].mute = true;
+  EXPECT_NE(get_stage_hash(a), get_stage_hash(b));
+  b = a;
+  b.rendersettings.secrec = 10;
+  EXPECT_NE(get_stage_hash(a), get_stage_hash(b));
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -217,6 +217,39 @@ TEST(sorter, processSkip)
   EXPECT_EQ(0u, stat.seqerr_out);
 }
 
+TEST(sorter, seqerr)
+{
+  secret_t sec(1234567);
+  stage_device_id_t id(13);
+  port_t port(1234);
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  msgbuf_t* pmsg(&msg);
+  stage_device_id_t cid(0);
+  sequence_t expected(0);
+  sequence_t received(0);
+  port_t destport(0);
+  msg.pack(sec, id, port, 1, "", 0);
+  pmsg = &msg;
+  while(sorter.process(&pmsg))
+    ;
+  msg.pack(sec, id, port, 2, "", 0);
+  pmsg = &msg;
+  while(sorter.process(&pmsg))
+    ;
+  EXPECT_EQ(false, sorter.get_seqerr(cid, expected, received, destport));
+  msg.pack(sec, id, port, 5, "", 0);
+  pmsg = &msg;
+  while(sorter.process(&pmsg))
+    ;
+  EXPECT_EQ(true, sorter.get_seqerr(cid, expected, received, destport));
+  EXPECT_EQ(id, cid);
+  EXPECT_EQ(3, expected);
+  EXPECT_EQ(5, received);
+  EXPECT_EQ(port, destport);
+  EXPECT_EQ(false, sorter.get_seqerr(cid, expected, received, destport));
+}
+
 TEST(sorter, processSkip2)
 {
   secret_t sec(1234567);
@@ -333,9 +366,213 @@ TEST(sorter, processJumpFirst)
   EXPECT_EQ(0u, stat.seqerr_out);
 }
 
+TEST(duplicates, detect)
+{
+  secret_t sec(1234567);
+  stage_device_id_t id(13);
+  port_t port(1234);
+  duplicate_filter_t filter;
+  msgbuf_t msg;
+  msg.pack(sec, id, port, 1, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  EXPECT_EQ(true, filter.is_duplicate(msg));
+  // streams beyond the fixed number of slots are not filtered:
+  for(port_t p = 0; p < MESSAGE_SORTER_PORTS; ++p) {
+    msg.pack(sec, id + 2, port + p, 1, "", 0);
+    EXPECT_EQ(false, filter.is_duplicate(msg));
+  }
+  msg.pack(sec, id + 2, port + MESSAGE_SORTER_PORTS, 1, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  msg.pack(sec, id, port, 3, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  // late message is not a duplicate:
+  msg.pack(sec, id, port, 2, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  EXPECT_EQ(true, filter.is_duplicate(msg));
+  // other port and other sender are independent:
+  msg.pack(sec, id, port + 1, 2, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  msg.pack(sec, id + 1, port, 2, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  // restart of sequence:
+  msg.pack(sec, id, port, 1003, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  msg.pack(sec, id, port, 1, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  EXPECT_EQ(true, filter.is_duplicate(msg));
+  // wrap-around of sequence number:
+  msg.pack(sec, id, port, 32767, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  msg.pack(sec, id, port, -32768, "", 0);
+  EXPECT_EQ(false, filter.is_duplicate(msg));
+  msg.pack(sec, id, port, 32767, "", 0);
+  EXPECT_EQ(true, filter.is_duplicate(msg));
+}
+
+TEST(pingrate, adapt)
+{
+  ping_rate_t pr;
+  EXPECT_EQ(1u, pr.get_interval());
+  // steady round trip times increase the interval:
+  for(uint32_t k = 0; k < ping_rate_t::steadycount + 1; ++k) {
+    EXPECT_EQ(true, pr.tick());
+    pr.add_value(20.0);
+  }
+  EXPECT_EQ(2u, pr.get_interval());
+  EXPECT_EQ(false, pr.tick());
+  EXPECT_EQ(true, pr.tick());
+  for(uint32_t k = 0; k < 10 * ping_rate_t::steadycount; ++k)
+    pr.add_value(20.0);
+  EXPECT_EQ(ping_rate_t::maxinterval, pr.get_interval());
+  // a jump of the round trip time resets the interval:
+  pr.add_value(60.0);
+  EXPECT_EQ(1u, pr.get_interval());
+  for(uint32_t k = 0; k < 10 * ping_rate_t::steadycount; ++k)
+    pr.add_value(20.0);
+  EXPECT_EQ(ping_rate_t::maxinterval, pr.get_interval());
+  // a ping which is not answered within twice the round trip time
+  // resets the interval:
+  while(!pr.tick())
+    ;
+  EXPECT_EQ(false, pr.tick());
+  EXPECT_EQ(ping_rate_t::maxinterval, pr.get_interval());
+  EXPECT_EQ(true, pr.tick());
+  EXPECT_EQ(1u, pr.get_interval());
+}
+
+TEST(clockoffset, estimate)
+{
+  clock_offset_estimator_t est(4);
+  EXPECT_EQ(false, est.is_valid());
+  // peer clock is 1000 ms ahead, base delay 10 ms in each direction:
+  timestamp_ns_t offset(1000000000);
+  timestamp_ns_t d(10000000);
+  est.add_sample(0, offset + d, 2 * d);
+  EXPECT_EQ(true, est.is_valid());
+  EXPECT_EQ(offset, est.get_offset());
+  // additional 6 ms queueing delay in upstream direction:
+  timestamp_ns_t q(6000000);
+  est.add_sample(100, 100 + offset + d + q, 100 + 2 * d + q);
+  EXPECT_EQ(offset, est.get_offset());
+  double up(0);
+  double down(0);
+  est.get_oneway(100, 100 + offset + d + q, 100 + 2 * d + q, up, down);
+  EXPECT_NEAR(16.0, up, 1e-9);
+  EXPECT_NEAR(10.0, down, 1e-9);
+  // after N samples the first sample is discarded:
+  for(int k = 0; k < 4; ++k)
+    est.add_sample(200, 200 + offset + 2 * d, 200 + 3 * d);
+  EXPECT_EQ(offset + d / 2, est.get_offset());
+}
+
+TEST(pathselector, hysteresis)
+{
+  path_selector_t sel;
+  EXPECT_EQ(false, sel.is_valid());
+  EXPECT_EQ(false, sel.update());
+  // first measurement selects best path:
+  sel.add_sent(PATH_P2P);
+  sel.add_value(PATH_P2P, 20.0);
+  sel.add_sent(PATH_LOCAL);
+  sel.add_value(PATH_LOCAL, 30.0);
+  EXPECT_EQ(true, sel.update());
+  EXPECT_EQ(true, sel.is_valid());
+  EXPECT_EQ(PATH_P2P, sel.get_path());
+  // loss on p2p path, change after holdcount updates:
+  for(uint32_t k = 0; k < path_selector_t::holdcount; ++k) {
+    EXPECT_EQ(PATH_P2P, sel.get_path());
+    for(uint32_t c = 0; c < 10; ++c) {
+      sel.add_sent(PATH_P2P);
+      sel.add_sent(PATH_LOCAL);
+      sel.add_value(PATH_LOCAL, 30.0);
+    }
+    sel.add_value(PATH_P2P, 20.0);
+    sel.update();
+  }
+  EXPECT_EQ(PATH_LOCAL, sel.get_path());
+  // small differences do not change the path:
+  for(uint32_t k = 0; k < 2 * path_selector_t::holdcount; ++k) {
+    for(uint32_t c = 0; c < 10; ++c) {
+      sel.add_sent(PATH_P2P);
+      sel.add_sent(PATH_LOCAL);
+      sel.add_value(PATH_P2P, 28.0);
+      sel.add_value(PATH_LOCAL, 30.0);
+    }
+    EXPECT_EQ(false, sel.update());
+  }
+  EXPECT_EQ(PATH_LOCAL, sel.get_path());
+  sel.set_path(PATH_P2P);
+  path_t path(PATH_LOCAL);
+  EXPECT_EQ(true, sel.get_path(path));
+  EXPECT_EQ(PATH_P2P, path);
+}
+
+TEST(pathselector, noserver)
+{
+  // the server does not forward between peer-to-peer devices, thus
+  // it is never selected:
+  path_selector_t sel;
+  for(uint32_t k = 0; k < 2 * path_selector_t::holdcount; ++k) {
+    for(uint32_t c = 0; c < 10; ++c) {
+      sel.add_sent(PATH_P2P);
+      sel.add_sent(PATH_SERVER);
+      sel.add_value(PATH_P2P, 80.0);
+      sel.add_value(PATH_SERVER, 10.0);
+    }
+    sel.update();
+  }
+  EXPECT_EQ(PATH_P2P, sel.get_path());
+  sel.set_path(PATH_SERVER);
+  EXPECT_EQ(PATH_P2P, sel.get_path());
+}
+
+TEST(uploadbudget, relayedpeers)
+{
+  std::vector<std::pair<double, stage_device_id_t>> peers;
+  peers.push_back(std::make_pair(30.0, 1));
+  peers.push_back(std::make_pair(10.0, 2));
+  peers.push_back(std::make_pair(50.0, 3));
+  peers.push_back(std::make_pair(20.0, 4));
+  // no budget:
+  EXPECT_EQ(0u, get_relayed_peers(peers, 500.0, 0.0).size());
+  // sufficient budget:
+  EXPECT_EQ(0u, get_relayed_peers(peers, 500.0, 2000.0).size());
+  // budget for three copies: two direct peers and one relay copy:
+  std::vector<stage_device_id_t> relayed(
+      get_relayed_peers(peers, 500.0, 1600.0));
+  ASSERT_EQ(2u, relayed.size());
+  EXPECT_EQ(1, relayed[0]);
+  EXPECT_EQ(3, relayed[1]);
+  // budget below two copies, all peers via relay:
+  EXPECT_EQ(4u, get_relayed_peers(peers, 500.0, 900.0).size());
+}
+
+TEST(delaygradient, state)
+{
+  delay_gradient_t g(10);
+  EXPECT_EQ(0.0, g.get_gradient());
+  EXPECT_EQ(CONGESTION_NORMAL, g.get_state());
+  // constant delay:
+  for(int k = 0; k < 10; ++k)
+    g.add_value(0.1 * k, 20.0);
+  EXPECT_NEAR(0.0, g.get_gradient(), 1e-9);
+  EXPECT_EQ(CONGESTION_NORMAL, g.get_state());
+  // delay grows by 2 ms every 100 ms:
+  for(int k = 10; k < 20; ++k)
+    g.add_value(0.1 * k, 20.0 + 2.0 * (k - 10));
+  EXPECT_NEAR(20.0, g.get_gradient(), 1e-6);
+  EXPECT_EQ(CONGESTION_OVERUSE, g.get_state());
+  // queue drains:
+  for(int k = 20; k < 30; ++k)
+    g.add_value(0.1 * k, 40.0 - 1.0 * (k - 20));
+  EXPECT_NEAR(-10.0, g.get_gradient(), 1e-6);
+  EXPECT_EQ(CONGESTION_UNDERUSE, g.get_state());
+}
+
 TEST(pingstat, get)
 {
-  ping_stat_collecor_t ps(8);
+  ping_stat_collecor_t ps;
   ping_stat_t stat;
   EXPECT_EQ(0u, stat.received);
   EXPECT_EQ(0u, stat.lost);
@@ -343,7 +580,7 @@ TEST(pingstat, get)
   EXPECT_EQ(0.0, stat.t_med);
   EXPECT_EQ(0.0, stat.t_p99);
   EXPECT_EQ(0.0, stat.t_mean);
-  ps.update_ping_stat(stat);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(0u, stat.received);
   EXPECT_EQ(0u, stat.lost);
   EXPECT_EQ(-1.0, stat.t_min);
@@ -351,65 +588,259 @@ TEST(pingstat, get)
   EXPECT_EQ(-1.0, stat.t_p99);
   EXPECT_EQ(-1.0, stat.t_mean);
   ++ps.sent;
-  ps.update_ping_stat(stat);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(0u, stat.received);
   EXPECT_EQ(1u, stat.lost);
-  ps.add_value(7.0);
-  ps.update_ping_stat(stat);
+  // minimum and mean are exact, quantiles are accurate within the
+  // histogram resolution:
+  const double tol(0.05);
+  ps.add_value(7.0, 0.0);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(7.0, stat.t_min);
   EXPECT_EQ(7.0, stat.t_med);
   EXPECT_EQ(7.0, stat.t_p99);
   EXPECT_EQ(7.0, stat.t_mean);
   EXPECT_EQ(1u, stat.received);
   EXPECT_EQ(0u, stat.lost);
-  ps.add_value(2.0);
-  ps.update_ping_stat(stat);
+  ps.add_value(2.0, 0.0);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(2.0, stat.t_min);
-  EXPECT_EQ(4.5, stat.t_med);
-  EXPECT_EQ(7.0, stat.t_p99);
+  EXPECT_NEAR(4.5, stat.t_med, tol * 4.5);
+  EXPECT_NEAR(7.0, stat.t_p99, tol * 7.0);
   EXPECT_EQ(4.5, stat.t_mean);
-  ps.add_value(0.0);
-  ps.update_ping_stat(stat);
+  ps.add_value(0.0, 0.0);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(2.0, stat.t_med);
-  EXPECT_EQ(7.0, stat.t_p99);
-  EXPECT_EQ(3.0, stat.t_mean);
-  ps.add_value(3.0);
-  ps.update_ping_stat(stat);
-  EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(2.5, stat.t_med);
-  EXPECT_EQ(7.0, stat.t_p99);
+  EXPECT_NEAR(2.0, stat.t_med, tol * 2.0);
+  EXPECT_NEAR(7.0, stat.t_p99, tol * 7.0);
   EXPECT_EQ(3.0, stat.t_mean);
-  ps.add_value(13.0);
-  ps.update_ping_stat(stat);
-  EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(3.0, stat.t_med);
-  EXPECT_EQ(13.0, stat.t_p99);
-  EXPECT_EQ(5.0, stat.t_mean);
-  ps.add_value(5.0);
-  ps.update_ping_stat(stat);
-  EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(4.0, stat.t_med);
-  EXPECT_EQ(13.0, stat.t_p99);
-  EXPECT_EQ(5.0, stat.t_mean);
-  ps.add_value(12.0);
-  ps.update_ping_stat(stat);
-  EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(5.0, stat.t_med);
-  EXPECT_EQ(13.0, stat.t_p99);
-  EXPECT_EQ(6.0, stat.t_mean);
-  ps.add_value(38.0);
-  ps.update_ping_stat(stat);
+  for(auto v : {3.0, 13.0, 5.0, 12.0, 38.0, 47.0})
+    ps.add_value(v, 0.0);
+  ps.update_ping_stat(stat, 0.0);
   EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(6.0, stat.t_med);
-  EXPECT_EQ(38.0, stat.t_p99);
-  EXPECT_EQ(10.0, stat.t_mean);
-  ps.add_value(47.0);
-  ps.update_ping_stat(stat);
-  EXPECT_EQ(0.0, stat.t_min);
-  EXPECT_EQ(8.5, stat.t_med);
-  EXPECT_EQ(47.0, stat.t_p99);
-  EXPECT_EQ(15.0, stat.t_mean);
+  EXPECT_NEAR(7.0, stat.t_med, tol * 7.0);
+  EXPECT_NEAR(47.0, stat.t_p99, tol * 47.0);
+  EXPECT_NEAR(127.0 / 9.0, stat.t_mean, 1e-9);
+  EXPECT_EQ(9u, stat.win_1s.n);
+  EXPECT_EQ(9u, stat.win_10s.n);
+}
+
+TEST(pingstat, windows)
+{
+  ping_stat_collecor_t ps;
+  ping_stat_t stat;
+  for(int k = 0; k < 100; ++k)
+    ps.add_value(20.0, 0.01 * k);
+  ps.update_ping_stat(stat, 0.99);
+  EXPECT_EQ(100u, stat.win_1s.n);
+  EXPECT_NEAR(20.0, stat.win_1s.t_med, 1.0);
+  // the window contains the current and the previous half window:
+  ps.update_ping_stat(stat, 1.0);
+  EXPECT_EQ(50u, stat.win_1s.n);
+  ps.add_value(40.0, 1.6);
+  ps.update_ping_stat(stat, 1.6);
+  EXPECT_EQ(1u, stat.win_1s.n);
+  EXPECT_NEAR(40.0, stat.win_1s.t_med, 2.0);
+  EXPECT_EQ(101u, stat.win_10s.n);
+  EXPECT_NEAR(20.0, stat.win_10s.t_med, 1.0);
+  ps.update_ping_stat(stat, 2.1);
+  EXPECT_EQ(1u, stat.win_1s.n);
+  ps.update_ping_stat(stat, 2.6);
+  EXPECT_EQ(0u, stat.win_1s.n);
+  EXPECT_EQ(-1.0, stat.win_1s.t_med);
+  // after 60 s all values are dropped:
+  ps.update_ping_stat(stat, 61.0);
+  EXPECT_EQ(0u, stat.win_10s.n);
+  EXPECT_EQ(-1.0, stat.t_med);
+  EXPECT_EQ(-1.0, stat.t_min);
+}
+
+TEST(pinghistogram, resolution)
+{
+  ping_histogram_t h;
+  EXPECT_EQ(0u, ping_histogram_t::get_bin(0.0));
+  EXPECT_EQ(ping_histogram_t::numbins - 1, ping_histogram_t::get_bin(1e6));
+  for(size_t bin = 0; bin < ping_histogram_t::numbins; ++bin)
+    EXPECT_EQ(bin,
+              ping_histogram_t::get_bin(ping_histogram_t::get_bin_value(bin)));
+  for(double v = 0.1; v < 3000.0; v *= 1.1) {
+    h.clear();
+    h.add_value(0.0);
+    h.add_value(v);
+    h.add_value(1e4);
+    EXPECT_NEAR(v, h.get_quantile(0.5), 0.023 * v);
+  }
+}
+
+TEST(pingstat, snapshot)
+{
+  ping_stat_collecor_t c;
+  std::atomic_bool run(true);
+  std::thread writer([&c, &run]() {
+    while(run)
+      c.add_value(10.0, 1.0);
+  });
+  for(size_t k = 0; k < 1000; ++k) {
+    ping_snapshot_t s;
+    c.get_snapshot(s, 1.0);
+    EXPECT_EQ(s.received, s.win_60s.get_count());
+    if(s.win_60s.get_count()) {
+      EXPECT_NEAR(10.0, s.win_60s.get_mean(), 1e-6);
+    }
+  }
+  run = false;
+  writer.join();
+}
+
+TEST(sorter, invalidid)
+{
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  msgbuf_t* pmsg(&msg);
+  msg.pack(1234567, MAX_STAGE_ID + 5, 1234, 1, "", 0);
+  sorter.process(&pmsg);
+  // invalid IDs are collected in a separate slot:
+  EXPECT_EQ(1u, sorter.get_stat(MAX_STAGE_ID + 5).received);
+  for(stage_device_id_t id = 0; id < MAX_STAGE_ID; ++id)
+    EXPECT_EQ(0u, sorter.get_stat(id).received);
+}
+
+TEST(sorter, jitter)
+{
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  msgbuf_t* pmsg(&msg);
+  stage_device_id_t id(3);
+  port_t port(4464);
+  // constant period of 2 ms:
+  double t(0);
+  for(sequence_t seq = 1; seq < 200; ++seq) {
+    msg.pack(1234567, id, port, seq, "", 0);
+    pmsg = &msg;
+    t += 2.0;
+    sorter.process(&pmsg, t);
+  }
+  message_stat_t stat(sorter.get_stat(id));
+  EXPECT_EQ(port, stat.streams[0].port);
+  EXPECT_EQ(0u, stat.streams[1].port);
+  EXPECT_NEAR(2.0, stat.streams[0].period, 1e-9);
+  EXPECT_NEAR(0.0, stat.get_jitter(), 1e-9);
+  EXPECT_EQ(198u, stat.streams[0].iat[4]);
+  // alternating spacing of 1 ms and 3 ms, including one lost message:
+  for(sequence_t seq = 200; seq < 400; ++seq) {
+    if(seq == 300)
+      continue;
+    msg.pack(1234567, id, port, seq, "", 0);
+    pmsg = &msg;
+    t += 2.0 + ((seq & 1) ? 1.0 : -1.0);
+    if(seq == 301)
+      t += 2.0;
+    sorter.process(&pmsg, t);
+  }
+  stat = sorter.get_stat(id);
+  EXPECT_NEAR(1.0, stat.get_jitter(), 0.1);
+  // 3 ms intervals, without the gap at the lost message:
+  EXPECT_EQ(99u, stat.streams[0].iat[6]);
+}
+
+TEST(sorter, lossbursts)
+{
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  msgbuf_t* pmsg(&msg);
+  stage_device_id_t id(3);
+  port_t port(4464);
+  double t(0);
+  for(sequence_t seq = 1; seq <= 1000; ++seq) {
+    t += 2.0;
+    if((seq == 100) || ((seq >= 200) && (seq < 203)) ||
+       ((seq >= 500) && (seq < 520)))
+      continue;
+    msg.pack(1234567, id, port, seq, "", 0);
+    pmsg = &msg;
+    sorter.process(&pmsg, t);
+  }
+  message_stat_t stat(sorter.get_stat(id));
+  const stream_stat_t& st(stat.streams[0]);
+  EXPECT_EQ(976u, st.good);
+  EXPECT_EQ(24u, st.lost);
+  EXPECT_EQ(3u, st.bursts);
+  EXPECT_EQ(1u, st.burst[0]);
+  EXPECT_EQ(1u, st.burst[2]);
+  EXPECT_EQ(1u, st.burst[LOSS_BINS - 1]);
+  // gaps of 99, 99 and 297 packets:
+  EXPECT_EQ(2u, st.gap[6]);
+  EXPECT_EQ(1u, st.gap[8]);
+  EXPECT_NEAR(3.0 / 976.0, st.ge_p, 1e-9);
+  EXPECT_NEAR(3.0 / 24.0, st.ge_r, 1e-9);
+  EXPECT_NEAR(0.024, stat.get_loss_rate(), 1e-9);
+}
+
+TEST(sorter, reorder)
+{
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  msgbuf_t* pmsg(&msg);
+  stage_device_id_t id(3);
+  port_t port(4464);
+  double t(0);
+  // seq 11 and 13 arrive three messages late, seq 30 arrives after
+  // the reorder window and is counted as lost:
+  std::vector<sequence_t> order;
+  for(sequence_t seq = 1; seq <= 100; ++seq) {
+    if((seq == 11) || (seq == 13) || (seq == 30))
+      continue;
+    order.push_back(seq);
+    if(seq == 15) {
+      order.push_back(11);
+      order.push_back(13);
+    }
+    if(seq == 30 + MESSAGE_REORDER_WINDOW)
+      order.push_back(30);
+  }
+  for(auto seq : order) {
+    t += 2.0;
+    msg.pack(1234567, id, port, seq, "", 0);
+    pmsg = &msg;
+    sorter.process(&pmsg, t);
+  }
+  message_stat_t stat(sorter.get_stat(id));
+  const stream_stat_t& st(stat.streams[0]);
+  EXPECT_EQ(99u, st.good);
+  EXPECT_EQ(1u, st.lost);
+  EXPECT_EQ(1u, st.bursts);
+  EXPECT_EQ(1u, st.burst[0]);
+}
+
+TEST(sorter, holdtime)
+{
+  message_sorter_t sorter;
+  msgbuf_t msg;
+  stage_device_id_t id(3);
+  port_t port(4464);
+  // seq 4 is held back until seq 3 arrives one ms later, seq 6 is
+  // held back until the receive timeout five ms later:
+  std::vector<std::pair<sequence_t, double>> arrivals = {
+      {1, 2.0}, {2, 4.0}, {4, 6.0}, {3, 7.0}, {6, 10.0}, {0, 15.0}};
+  std::vector<sequence_t> delivered;
+  for(const auto& a : arrivals) {
+    if(a.first) {
+      msg.pack(1234567, id, port, a.first, "", 0);
+    } else {
+      msg.valid = false;
+    }
+    msgbuf_t* pmsg(&msg);
+    while(sorter.process(&pmsg, a.second)) {
+      delivered.push_back(pmsg->seq);
+      pmsg = &msg;
+    }
+  }
+  EXPECT_EQ(std::vector<sequence_t>({1, 2, 3, 4, 6}), delivered);
+  message_stat_t stat(sorter.get_stat(id));
+  EXPECT_NEAR(6.0, stat.holdtime, 1e-9);
+  message_stat_t prev(stat);
+  stat -= prev;
+  EXPECT_EQ(0.0, stat.holdtime);
 }
 
 // Local Variables:
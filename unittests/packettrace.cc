@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "packettrace.h"
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+
+TEST(packettrace, csv)
+{
+  char dir[] = "/tmp/ovbox_unittest_XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  std::string fname(std::string(dir) + "/packettrace.bin");
+  packet_trace_t trace;
+  endpoint_t ep;
+  memset(&ep, 0, sizeof(ep));
+  ep.sin_addr.s_addr = htonl(0x7f000001);
+  ep.sin_port = htons(4464);
+  {
+    packet_trace_t::writer_t tracew(trace);
+    // inactive trace, not recorded:
+    tracew.add(TRACE_RX, TRACE_DELIVERED, 2, 4466, 1, 100, ep);
+    trace.start(fname);
+    tracew.add(TRACE_RX, TRACE_BUFFERED, 3, 4466, 17, 100, ep);
+    char msg[HEADERLEN + 10];
+    packmsg(msg, sizeof(msg), 1234, 5, 4464, 42, "0123456789", 10);
+    tracew.add_sent(msg, sizeof(msg), ep);
+  }
+  trace.stop();
+  std::stringstream csv;
+  packet_trace_to_csv(fname, csv);
+  std::string line;
+  std::vector<std::string> lines;
+  while(std::getline(csv, line))
+    lines.push_back(line);
+  ASSERT_EQ(3u, lines.size());
+  EXPECT_EQ("time,thread,dir,cid,destport,seq,size,addr,ipport,decision",
+            lines[0]);
+  EXPECT_NE(std::string::npos,
+            lines[1].find(",0,rx,3,4466,17,100,127.0.0.1,4464,buffered"));
+  EXPECT_NE(std::string::npos,
+            lines[2].find(",0,tx,5,4464,42,10,127.0.0.1,4464,sent"));
+  remove(fname.c_str());
+  rmdir(dir);
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
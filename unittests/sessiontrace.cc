@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include "sessiontrace.h"
+#include <nlohmann/json.hpp>
+
+TEST(sessiontrace, spans)
+{
+  session_trace_t trace;
+  {
+    session_trace_t::span_t outer(trace, "start_session");
+    session_trace_t::span_t inner(trace, "build \"xml\"", "xml");
+    inner.end();
+    // ending twice adds only one span:
+    inner.end();
+  }
+  std::thread t([&trace]() { trace.add("spawn", "process", 1000, 3000); });
+  t.join();
+  auto evs(trace.get_events());
+  ASSERT_EQ(3u, evs.size());
+  // inner span ends first:
+  EXPECT_EQ("build \"xml\"", evs[0].name);
+  EXPECT_EQ("xml", evs[0].category);
+  EXPECT_EQ("start_session", evs[1].name);
+  EXPECT_EQ("session", evs[1].category);
+  EXPECT_LE(evs[1].t_start, evs[0].t_start);
+  EXPECT_GE(evs[1].t_end, evs[0].t_end);
+  EXPECT_EQ(evs[0].thread, evs[1].thread);
+  EXPECT_NE(evs[0].thread, evs[2].thread);
+  nlohmann::json js(nlohmann::json::parse(trace.to_json()));
+  ASSERT_EQ(3u, js["traceEvents"].size());
+  EXPECT_EQ("build \"xml\"", js["traceEvents"][0]["name"]);
+  EXPECT_EQ("X", js["traceEvents"][2]["ph"]);
+  // time stamps in us relative to the earliest span:
+  EXPECT_EQ("spawn", js["traceEvents"][2]["name"]);
+  EXPECT_EQ("process", js["traceEvents"][2]["cat"]);
+  EXPECT_EQ(0.0, js["traceEvents"][2]["ts"]);
+  EXPECT_EQ(2.0, js["traceEvents"][2]["dur"]);
+  trace.clear();
+  EXPECT_EQ(0u, trace.get_events().size());
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
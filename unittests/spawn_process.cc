@@ -0,0 +1,27 @@
+#include <gtest/gtest.h>
+
+#include "spawn_process.h"
+
+TEST(spawn_process, terminate)
+{
+  spawn_process_t proc("sleep 10");
+  EXPECT_TRUE(proc.is_running());
+  EXPECT_TRUE(proc.terminate(2.0));
+  EXPECT_FALSE(proc.is_running());
+  // terminating twice is harmless:
+  EXPECT_TRUE(proc.terminate(2.0));
+}
+
+TEST(spawn_process, empty)
+{
+  spawn_process_t proc("");
+  EXPECT_FALSE(proc.is_running());
+  EXPECT_TRUE(proc.terminate(0.1));
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include "tracereplay.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+TEST(tracereplay, order)
+{
+  char dir[] = "/tmp/ovbox_unittest_XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  std::string fname(std::string(dir) + "/tracereplay.bin");
+  packet_trace_t trace;
+  endpoint_t ep;
+  memset(&ep, 0, sizeof(ep));
+  {
+    packet_trace_t::writer_t tracew(trace);
+    trace.start(fname);
+    // swapped messages 3 and 4, and a ping which is not replayed:
+    for(sequence_t seq : {1, 2, 4, 3, 5})
+      tracew.add(TRACE_RX, TRACE_DELIVERED, 3, 4466, seq, 100, ep);
+    tracew.add(TRACE_RX, TRACE_DELIVERED, 3, PORT_PING, 0, 16, ep);
+    tracew.add(TRACE_TX, TRACE_SENT, 1, 4464, 1, 100, ep);
+  }
+  trace.stop();
+  trace_replay_t replay(fname);
+  remove(fname.c_str());
+  rmdir(dir);
+  ASSERT_EQ(5u, replay.packets.size());
+  message_sorter_t sorter;
+  std::vector<sequence_t> seqs;
+  replay.run(
+      sorter, [&seqs](msgbuf_t& msg) { seqs.push_back(msg.seq); }, false);
+  EXPECT_EQ(5u, replay.cost.size());
+  ASSERT_EQ(5u, seqs.size());
+  for(size_t k = 0; k < seqs.size(); ++k)
+    EXPECT_EQ((sequence_t)(k + 1), seqs[k]);
+  ASSERT_EQ(5u, replay.delivery.size());
+  // message 4 was held back until message 3 arrived:
+  EXPECT_EQ(TRACE_DELIVERED, replay.delivery[2].decision);
+  EXPECT_EQ(TRACE_RELEASED, replay.delivery[3].decision);
+  EXPECT_EQ(4, replay.delivery[3].seq);
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include "trafficcounter.h"
+
+TEST(trafficcounter, aggregate)
+{
+  traffic_counter_t counter;
+  {
+    traffic_counter_t::writer_t w1(counter);
+    traffic_counter_t::writer_t w2(counter);
+    w1.add_rx(3, 4464, 100);
+    w1.add_rx(3, 4464, 100);
+    w2.add_tx(3, 4464, 50);
+    w2.add_tx(TRAFFIC_SERVER, PORT_REGISTER, 80, 2);
+    // invalid device IDs are counted as others:
+    w2.add_rx(200, 4464, 10);
+  }
+  traffic_snapshot_t s;
+  counter.get_snapshot(s);
+  EXPECT_EQ(3u, s.peer[3].rx_packets + s.peer[3].tx_packets);
+  EXPECT_EQ(200u, s.peer[3].rx_bytes);
+  EXPECT_EQ(50u, s.peer[3].tx_bytes);
+  EXPECT_EQ(2u, s.peer[TRAFFIC_SERVER].tx_packets);
+  EXPECT_EQ(10u, s.peer[TRAFFIC_OTHER].rx_bytes);
+  EXPECT_EQ(3u, s.total.rx_packets);
+  EXPECT_EQ(130u, s.total.tx_bytes);
+  ASSERT_EQ(2u, s.port.size());
+  EXPECT_EQ(210u, s.port[4464].rx_bytes);
+  EXPECT_EQ(80u, s.port[PORT_REGISTER].tx_bytes);
+  EXPECT_EQ(0u, s.other_ports.rx_packets);
+  EXPECT_EQ(50u, counter.get_peer(3).tx_bytes);
+  // blocks of ended threads are reused and keep their counts:
+  {
+    traffic_counter_t::writer_t w(counter);
+    w.add_tx(3, 4464, 50);
+  }
+  EXPECT_EQ(100u, counter.get_peer(3).tx_bytes);
+}
+
+TEST(trafficcounter, porttable)
+{
+  traffic_counter_t counter;
+  traffic_counter_t::writer_t w(counter);
+  for(port_t p = 0; p < TRAFFIC_PORTS + 4; ++p)
+    w.add_rx(1, p, 1);
+  traffic_snapshot_t s;
+  counter.get_snapshot(s);
+  EXPECT_EQ((size_t)TRAFFIC_PORTS, s.port.size());
+  EXPECT_EQ(4u, s.other_ports.rx_packets);
+  EXPECT_EQ(TRAFFIC_PORTS + 4u, s.peer[1].rx_packets);
+}
+
+TEST(trafficcounter, rate)
+{
+  traffic_counter_t counter;
+  traffic_counter_t::writer_t w(counter);
+  traffic_snapshot_t s1;
+  counter.get_snapshot(s1);
+  for(size_t k = 0; k < 100; ++k)
+    w.add_tx(2, 4464, 125);
+  traffic_snapshot_t s2;
+  counter.get_snapshot(s2);
+  // reading is not destructive, thus two readers see the same rate:
+  s2.t = s1.t + 1.0;
+  traffic_rate_t r1(s2.get_rate(s1));
+  traffic_rate_t r2(s2.get_peer_rate(s1, 2));
+  EXPECT_NEAR(100.0, r1.tx_kbps, 1e-9);
+  EXPECT_NEAR(100.0, r1.tx_pps, 1e-9);
+  EXPECT_NEAR(100.0, r2.tx_kbps, 1e-9);
+  EXPECT_EQ(0.0, r1.rx_kbps);
+  EXPECT_NEAR(100.0, s2.get_port_rate(s1, 4464).tx_pps, 1e-9);
+  EXPECT_EQ(0.0, s2.get_port_rate(s1, 1).tx_pps);
+  traffic_snapshot_t s3;
+  counter.get_snapshot(s3);
+  EXPECT_EQ(s2.total.tx_bytes, s3.total.tx_bytes);
+}
+
+// Local Variables:
+// compile-command: "make -C .. unit-tests"
+// coding: utf-8-unix
+// c-basic-offset: 2
+// indent-tabs-mode: nil
+// End:
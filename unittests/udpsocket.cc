@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "udpsocket.h"
+#include <thread>
 
 TEST(msgbuf, age)
 {
@@ -74,6 +75,56 @@ TEST(ovboxsocket, packmsg)
   EXPECT_EQ(3, msg_seq(buf));
 }
 
+TEST(stopsignal, interrupt)
+{
+  stop_signal_t sig;
+  EXPECT_FALSE(sig.is_stopped());
+  EXPECT_FALSE(sig.wait_for(1000));
+  udpsocket_t sock;
+  sock.set_stop_signal(&sig);
+  sock.bind(0, true);
+  // a pending message is received:
+  sock.send("test", 4, sock.getsockep());
+  char buf[16];
+  endpoint_t sender;
+  EXPECT_EQ(4, sock.recvfrom(buf, sizeof(buf), sender));
+  // timeout without message:
+  sock.set_timeout_usec(1000);
+  EXPECT_EQ(-1, sock.recvfrom(buf, sizeof(buf), sender));
+  // a stop request interrupts a blocking wait:
+  sock.set_timeout_usec(0);
+  std::thread waiter([&sock]() {
+    char buf[16];
+    endpoint_t sender;
+    EXPECT_EQ(-1, sock.recvfrom(buf, sizeof(buf), sender));
+  });
+  auto t0(std::chrono::steady_clock::now());
+  sig.stop();
+  waiter.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(1));
+  EXPECT_TRUE(sig.is_stopped());
+  EXPECT_TRUE(sig.wait_for(10000000));
+}
+
+TEST(semaphore, post)
+{
+  semaphore_t sem;
+  // timeout without post:
+  EXPECT_FALSE(sem.wait_for(1000));
+  // posts are counted:
+  sem.post();
+  sem.post();
+  EXPECT_TRUE(sem.wait_for(1000));
+  EXPECT_TRUE(sem.wait_for(1000));
+  EXPECT_FALSE(sem.wait_for(1000));
+  // a post wakes up a waiting thread:
+  std::thread waiter([&sem]() { EXPECT_TRUE(sem.wait_for(10000000)); });
+  auto t0(std::chrono::steady_clock::now());
+  sem.post();
+  waiter.join();
+  EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(1));
+}
+
 // Local Variables:
 // compile-command: "make -C .. unit-tests"
 // coding: utf-8-unix